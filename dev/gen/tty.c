@@ -45,6 +45,7 @@
 #include <sys/signal.h>
 #include <sys/tty.h>
 #include <sys/termios.h>
+#include <sys/poll.h>
 #include <pm.h>
 
 /* #define DEBUG_TTY 1 */
@@ -215,6 +216,7 @@ tty_flush(struct tty *tp, int rw)
 		while (ttyq_getc(&tp->t_rawq) != -1)
 			;
 		sched_wakeup(&tp->t_input);
+		device_pollwakeup();
 	}
 	if (rw & FWRITE) {
 		tp->t_state &= ~TS_TTSTOP;
@@ -235,6 +237,7 @@ tty_done(struct tty *tp)
 		tp->t_state &= ~TS_ASLEEP;
 		sched_wakeup(&tp->t_output);
 	}
+	device_pollwakeup();
 }
 
 /*
@@ -353,9 +356,12 @@ tty_input(int c, struct tty *tp)
 		if (c == '\n' || c == cc[VEOF] || c == cc[VEOL]) {
 			tty_catq(&tp->t_rawq, &tp->t_canq);
 			sched_wakeup(&tp->t_input);
+			device_pollwakeup();
 		}
-	} else
+	} else {
 		sched_wakeup(&tp->t_input);
+		device_pollwakeup();
+	}
 
 	if (lflag & ECHO)
 		tty_echo(c, tp);
@@ -588,10 +594,39 @@ tty_ioctl(file_t file, u_long cmd, void *data)
 	return 0;
 }
 
+/*
+ * Check the readiness of a tty.
+ * Input is ready when a read would not block, and output is
+ * ready while the output queue is below its high water mark.
+ * The pollers are woken by device_pollwakeup() when input
+ * arrives or output completes.
+ */
+int
+tty_poll(struct tty *tp, int events)
+{
+	struct tty_queue *qp;
+	int revents = 0;
+
+	qp = (tp->t_lflag & ICANON) ? &tp->t_canq : &tp->t_rawq;
+	if (!ttyq_empty(qp))
+		revents |= events & (POLLIN | POLLRDNORM);
+	if (tp->t_outq.tq_count <= TTYQ_HIWAT)
+		revents |= events & POLLOUT;
+	return revents;
+}
+
+static int
+tty_devpoll(file_t file, int events)
+{
+
+	return tty_poll(file->priv, events);
+}
+
 static struct devio tty_io = {
 	.read = tty_read,
 	.write = tty_write,
 	.ioctl = tty_ioctl,
+	.poll = tty_devpoll,
 };
 
 /*
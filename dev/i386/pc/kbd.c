@@ -34,6 +34,7 @@
 #include <driver.h>
 #include <prex/keycode.h>
 #include <sys/tty.h>
+#include <sys/poll.h>
 #include <cpufunc.h>
 #include <console.h>
 #include "kmc.h"
@@ -42,6 +43,7 @@
 #define KBD_IRQ		1
 
 static int kbd_init(void);
+static int kbd_poll(file_t, int);
 
 /*
  * Driver structure
@@ -62,6 +64,7 @@ static struct devio kbd_io = {
 	/* write */	NULL,
 	/* ioctl */	NULL,
 	/* event */	NULL,
+	/* poll */	kbd_poll,
 };
 
 /*
@@ -263,6 +266,20 @@ kbd_ist(int irq)
 	return;
 }
 
+/*
+ * Keyboard input is queued on the console tty, so the keyboard
+ * is ready when the console has input to read.  tty_input()
+ * wakes the pollers.
+ */
+static int
+kbd_poll(file_t file, int events)
+{
+
+	if (tty == NULL)
+		return 0;
+	return tty_poll(tty, events & ~POLLOUT);
+}
+
 int
 kbd_init(void)
 {
@@ -66,6 +66,7 @@ struct devio {
 	int	(*write)(file_t, char *, size_t *, int);
 	int	(*ioctl)(file_t, u_long, void *);
 	int	(*event)(int);
+	int	(*poll)	(file_t, int);
 #ifdef __ppc__
 	ret64_t (*iofn)	(file_t, int, arg_t, arg_t,
 			 arg_t, arg_t, arg_t, arg_t);
@@ -76,6 +77,7 @@ __BEGIN_DECLS
 device_t device_create(const struct devio *, const char *, int, void *);
 int	 device_destroy(device_t);
 int	 device_broadcast(int, int);
+void	 device_pollwakeup(void);
 __BEGIN_DECLS
 
 #endif /* !_PREX_DEVICE_H */
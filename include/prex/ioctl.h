@@ -31,6 +31,23 @@
 #define _PREX_IOCTL_H
 
 #include <sys/time.h>
+#include <prex/types.h>
+
+/*
+ * Device poll control code
+ *
+ * The argument holds the poll events to check, and returns
+ * the events that are ready.  It is handled by the kernel with
+ * the poll routine of the driver.  If sem is given, it is
+ * posted once when a device may have become ready.
+ */
+struct devpoll {
+	int	events;		/* events to check */
+	int	revents;	/* events which are ready */
+	sem_t	sem;		/* semaphore to post, or SEM_NULL */
+};
+
+#define DEVIOC_POLL		_IOWR('D', 0, struct devpoll)
 
 /*
  * CPU I/O control code
@@ -36,9 +36,15 @@
 
 extern object_t __proc_obj;
 extern object_t __fs_obj;
+extern int __devfd_off;
 
 __BEGIN_DECLS
 int __posix_call(object_t obj, void *msg, size_t size, int restart);
+device_t __devfd_get(int fd, int flags);
+void	__devfd_open(int fd, const char *name, int flags);
+void	__devfd_close(int fd);
+void	__devfd_dup(int oldfd, int newfd);
+void	__devfd_fork(void);
 __END_DECLS
 
 #endif	/* __KERNEL__ */
@@ -38,6 +38,7 @@
 #include <sys/param.h>
 #include <prex/sysinfo.h>
 #include <prex/capability.h>
+#include <prex/object.h>
 
 /*
  * vm_option for task_crate()
@@ -94,6 +95,7 @@ __BEGIN_DECLS
 int	object_create(const char *name, object_t *obj);
 int	object_destroy(object_t obj);
 int	object_lookup(const char *name, object_t *obj);
+int	object_grant(object_t obj, task_t task, int rights, object_t *newobj);
 
 int	msg_send(object_t obj, void *msg, size_t size, u_long timeout);
 int	msg_receive(object_t obj, void *msg, size_t size, u_long timeout);
@@ -160,6 +162,7 @@ int	sem_wait(sem_t *sem, u_long timeout);
 int	sem_trywait(sem_t *sem);
 int	sem_post(sem_t *sem);
 int	sem_getvalue(sem_t *sem, u_int *value);
+int	sem_owner(sem_t *sem, task_t *task);
 
 int	sys_info(int type, void *buf);
 int	sys_log(const char *msg);
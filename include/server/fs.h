@@ -35,6 +35,8 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/poll.h>
+#include <sys/uio.h>
 #include <prex/message.h>
 
 #include <limits.h>
@@ -78,6 +80,16 @@
 #define FS_REGISTER	0x00000221
 #define FS_PIPE		0x00000222
 #define FS_MKFIFO	0x00000223
+#define FS_OPENAT	0x00000224
+#define FS_FSTATAT	0x00000225
+#define FS_MKDIRAT	0x00000226
+#define FS_UNLINKAT	0x00000227
+#define FS_RENAMEAT	0x00000228
+#define FS_GETDENTS	0x00000229
+#define FS_POLL		0x0000022A
+#define FS_PREADV	0x0000022B
+#define FS_PWRITEV	0x0000022C
+#define FS_COPY		0x0000022D
 
 /*
  * Mount message
@@ -93,6 +105,15 @@ struct mount_msg {
 
 /*
  * File open message
+ *
+ * For FS_OPENAT and FS_MKDIRAT, fd is the directory descriptor
+ * to start the lookup of path.
+ *
+ * When FS_OPEN or FS_OPENAT opens a character device for a task
+ * with CAP_DEVIO, the reply has the device name in path and the
+ * open flags in flags.  The task can then open the device with
+ * device_open() to read and write it directly.  Otherwise path
+ * is empty in the reply.
  */
 struct open_msg {
 	struct msg_header hdr;	/* message header */
@@ -104,16 +125,56 @@ struct open_msg {
 
 /*
  * I/O request message
+ *
+ * For FS_GETDENTS, offset returns the directory position of
+ * the first entry in buf.
  */
 struct io_msg {
 	struct msg_header hdr;	/* message header */
 	int	fd;		/* file descriptor */
 	char	*buf;		/* i/o buffer */
 	size_t	size;		/* read/write size */
+	off_t	offset;		/* file offset */
+};
+
+/*
+ * Vectored I/O request message
+ *
+ * Used by FS_PREADV and FS_PWRITEV.  If offset is -1, the
+ * transfer starts at the current file offset and advances it.
+ * Otherwise it starts at offset and the file offset is not
+ * changed.  size returns the number of bytes transferred.
+ */
+struct uio_msg {
+	struct msg_header hdr;	/* message header */
+	int	fd;		/* file descriptor */
+	const struct iovec *iov; /* i/o vector */
+	int	iovcnt;		/* number of elements in iov */
+	off_t	offset;		/* file offset, or -1 */
+	size_t	size;		/* bytes transferred */
+};
+
+/*
+ * File copy message
+ *
+ * FS_COPY copies up to size bytes from infd to outfd within the
+ * server.  An offset of -1 means the file offset of that
+ * descriptor is used and advanced, as for struct uio_msg.  size
+ * returns the number of bytes copied; 0 means end of file.
+ */
+struct copy_msg {
+	struct msg_header hdr;	/* message header */
+	int	infd;		/* source file descriptor */
+	off_t	inoff;		/* source offset, or -1 */
+	int	outfd;		/* destination file descriptor */
+	off_t	outoff;		/* destination offset, or -1 */
+	size_t	size;		/* bytes to copy / copied */
 };
 
 /*
  * File stat message
+ *
+ * For FS_FSTATAT, fd is the directory descriptor.
  */
 struct stat_msg {
 	struct msg_header hdr;	/* message header */
@@ -124,6 +185,10 @@ struct stat_msg {
 
 /*
  * Path management message
+ *
+ * For FS_UNLINKAT, fd is the directory descriptor and data[0]
+ * is the flags.  For FS_RENAMEAT, fd and data[0] are the
+ * directory descriptors for path and path2.
  */
 struct path_msg {
 	struct msg_header hdr;	/* message header */
@@ -163,6 +228,23 @@ struct fcntl_msg {
 	struct flock lock;	/* file lock data */
 };
 
+/*
+ * Poll message
+ *
+ * fds points to the nfds poll descriptors of the caller, and
+ * count returns the number of descriptors with events.  If none
+ * is ready, sem is posted when a polled file may have become
+ * ready.  A message with nfds 0 removes the waiters left for
+ * sem.
+ */
+struct poll_msg {
+	struct msg_header hdr;	/* message header */
+	struct pollfd *fds;	/* poll descriptors */
+	nfds_t	nfds;		/* number of descriptors */
+	sem_t	sem;		/* semaphore to post */
+	int	count;		/* number of ready descriptors */
+};
+
 
 #define MAX_FSMSG	sizeof(struct mount_msg)
 
@@ -38,12 +38,14 @@
  * Buffer header
  */
 struct buf {
-	struct list	b_link;		/* link to block list */
+	struct list	b_link;		/* link to clean/dirty list */
+	struct list	b_hash;		/* link to hash chain */
 	int		b_flags;	/* see defines below */
 	dev_t		b_dev;		/* device number */
 	int		b_blkno;	/* block # on device */
 	mutex_t		b_lock;		/* lock for access */
 	char		*b_data;	/* pointer to data buffer */
+	u_long		b_time;		/* time when it became dirty */
 };
 
 /*
@@ -54,16 +56,34 @@ struct buf {
 #define	B_INVAL		0x00000004	/* does not contain valid info. */
 #define	B_READ		0x00000008	/* read buffer. */
 #define	B_DONE		0x00000010	/* I/O completed. */
+#define	B_RAHEAD	0x00000020	/* read ahead, not yet referenced. */
+
+/*
+ * Read-ahead state kept per file
+ */
+struct readahead {
+	int		ra_next;	/* block expected by next read */
+	int		ra_last;	/* last block read ahead */
+	int		ra_win;		/* current window in blocks */
+};
+
+#define MINRABLKS	4		/* initial read-ahead window */
+#define MAXRABLKS	32		/* max read-ahead window */
 
 __BEGIN_DECLS
 struct buf *getblk(dev_t dev, int blkno);
 int	bread(dev_t dev, int blkno, struct buf **bpp);
+int	breada(dev_t dev, int blkno, int nra, struct readahead *ra,
+	       struct buf **bpp);
 int	bwrite(struct buf *bp);
 void	bdwrite(struct buf *bp);
+int	bread_cluster(dev_t dev, int blkno, int nblks, void *data);
+int	bread_direct(dev_t dev, int blkno, int nblks, void *data);
+int	bwrite_cluster(dev_t dev, int blkno, int nblks, void *data);
 void	binval(dev_t dev);
 void	brelse(struct buf *);
 void	bflush(struct buf *);
-void	bio_sync(void);
+int	bio_sync(void);
 void	bio_init(void);
 __END_DECLS
 
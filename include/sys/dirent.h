@@ -44,6 +44,10 @@
  * contained in the entry.  These are followed by the name padded to a 4
  * byte boundary with null bytes.  All names are guaranteed null terminated.
  * The maximum length of a name in a directory is MAXNAMLEN.
+ *
+ * The size and the permission bits are hints filled in by the file
+ * system, so that a directory can be listed without stat() calls.
+ * d_mode is 0 if they are not known.
  */
 
 struct dirent {
@@ -51,9 +55,19 @@ struct dirent {
 	uint16_t d_reclen;		/* length of this record */
 	uint8_t  d_type; 		/* file type, see below */
 	uint8_t  d_namlen;		/* length of string in d_name */
+	uint32_t d_size;		/* file size (hint) */
+	uint16_t d_mode;		/* permission bits (hint), or 0 */
+	uint16_t d_pad;
 	char	 d_name[NAME_MAX];	/* name must be no longer than this */
 };
 
+/*
+ * The length of a packed entry holding a name of namlen bytes,
+ * including the terminating null and padding to 4 bytes.
+ */
+#define	_DIRENT_RECLEN(namlen) \
+	((sizeof(struct dirent) - NAME_MAX + (namlen) + 1 + 3) & ~3)
+
 /*
  * File types
  */
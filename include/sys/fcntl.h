@@ -102,6 +102,13 @@
 /* file descriptor flags (F_GETFD, F_SETFD) */
 #define	FD_CLOEXEC	1		/* close-on-exec flag */
 
+/*
+ * Constants used for the *at() functions
+ */
+#define	AT_FDCWD		-100	/* relative to current directory */
+#define	AT_SYMLINK_NOFOLLOW	0x0200	/* do not follow symbolic links */
+#define	AT_REMOVEDIR		0x0800	/* remove directory, not file */
+
 /* record locking flags (F_GETLK, F_SETLK, F_SETLKW) */
 #define	F_RDLCK		1		/* shared or read lock */
 #define	F_UNLCK		2		/* unlock */
@@ -130,6 +137,7 @@ struct flock {
 
 __BEGIN_DECLS
 int	open(const char *, int, ...);
+int	openat(int, const char *, int, ...);
 int	creat(const char *, mode_t);
 int	fcntl(int, int, ...);
 int	flock(int, int);
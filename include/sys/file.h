@@ -43,6 +43,7 @@ struct file {
 	int		f_count;	/* reference count */
 	off_t		f_offset;	/* current position in file */
 	struct vnode	*f_vnode;	/* vnode */
+	void		*f_data;	/* file system private data */
 };
 typedef struct file *file_t;
 
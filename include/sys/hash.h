@@ -0,0 +1,75 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_HASH_H
+#define _SYS_HASH_H
+
+#include <sys/types.h>
+#include <sys/cdefs.h>
+#include <sys/list.h>
+
+/*
+ * Hash table which grows as entries are added.
+ *
+ * When the table is full, a table with twice the buckets is
+ * allocated and the entries of the old table are moved a few
+ * buckets at a time by the following inserts.  So no insert
+ * has to rehash the whole table.  Lookups search both tables
+ * while the move is in progress.
+ */
+struct hnode {
+	struct list	h_link;		/* link to hash chain */
+	u_int		h_val;		/* hash value of the entry */
+};
+
+struct htable {
+	struct list	*ht_table;	/* buckets */
+	u_int		ht_size;	/* number of buckets (power of 2) */
+	u_int		ht_count;	/* number of entries */
+	struct list	*ht_old;	/* buckets being moved, or NULL */
+	u_int		ht_oldsize;	/* number of old buckets */
+	u_int		ht_move;	/* next old bucket to move */
+};
+
+/*
+ * Get the struct for this entry
+ */
+#define hash_entry(p, type, member) \
+    ((type *)((char *)(p) - (unsigned long)(&((type *)0)->member)))
+
+__BEGIN_DECLS
+int	 hash_init(struct htable *, u_int);
+void	 hash_insert(struct htable *, struct hnode *, u_int);
+void	 hash_remove(struct htable *, struct hnode *);
+struct hnode *hash_lookup(struct htable *, u_int, struct hnode *);
+struct hnode *hash_walk(struct htable *, struct hnode *);
+u_int	 hash_string(const char *);
+__END_DECLS
+
+#endif /* !_SYS_HASH_H */
@@ -61,6 +61,8 @@ struct statfs {
  */
 struct mount {
 	struct list	m_link;		/* link to next mount point */
+	struct list	m_hash;		/* link in mount hash table */
+	struct list	m_dcache;	/* name cache entries */
 	struct vfsops	*m_op;		/* pointer to vfs operation */
 	int		m_flags;	/* mount flag */
 	int		m_count;	/* reference count */
@@ -113,7 +113,9 @@ struct stat {
 __BEGIN_DECLS
 int	chmod(const char *, mode_t);
 int	fstat(int, struct stat *);
+int	fstatat(int, const char *, struct stat *, int);
 int	mkdir(const char *, mode_t);
+int	mkdirat(int, const char *, mode_t);
 int	mkfifo(const char *, mode_t);
 int	stat(const char *, struct stat *);
 mode_t	umask(mode_t);
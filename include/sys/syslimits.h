@@ -35,6 +35,7 @@
 
 #define	ARG_MAX			  255	/* max bytes for an exec function */
 #define	CHILD_MAX		    6	/* max simultaneous processes */
+#define	IOV_MAX			   64	/* max elements in an i/o vector */
 #define	LINK_MAX		    8	/* max file link count */
 #define	MAX_CANON		  255	/* max bytes in term canon input line */
 #define	MAX_INPUT		  255	/* max bytes in terminal input */
@@ -93,6 +93,7 @@ int ttyq_unputc(struct tty_queue *tq);
 
 void tty_input(int c, struct tty *tp);
 void tty_done(struct tty *tp);
+int tty_poll(struct tty *tp, int events);
 __END_DECLS
 
 #endif /* __KERNEL__ */
@@ -34,8 +34,10 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <sys/list.h>
+#include <sys/hash.h>
 #include <sys/dirent.h>
 #include <sys/syslimits.h>
+#include <sys/buf.h>
 
 struct vfsops;
 struct vnops;
@@ -61,7 +63,7 @@ enum {
  * appropriate lock.
  */
 struct vnode {
-	struct list	v_link;		/* link for hash list */
+	struct hnode	v_link;		/* link for hash list */
 	struct mount	*v_mount;	/* mounted vfs pointer */
 	struct vnops	*v_op;		/* vnode operations */
 	int		v_refcnt;	/* reference count */
@@ -73,6 +75,9 @@ struct vnode {
 	cond_t		v_cond;		/* condition variable for this vnode */
 	int		v_nrlocks;	/* lock count (for debug) */
 	int		v_blkno;	/* block number */
+	struct readahead v_ra;		/* read-ahead state */
+	struct list	v_poll;		/* tasks polling this vnode */
+	struct mount	*v_mountedhere;	/* file system mounted here */
 	char		*v_path;	/* pointer to path in fs */
 	void		*v_data;	/* private data for fs */
 };
@@ -119,6 +124,7 @@ struct vnops {
 	int (*vop_setattr)	(vnode_t vp, struct vattr *vap);
 	int (*vop_inactive)	(vnode_t vp);
 	int (*vop_truncate)	(vnode_t vp);
+	int (*vop_poll)		(vnode_t vp, file_t fp, int events, int *revents);
 };
 
 typedef	int (*vnop_open_t)	(vnode_t, int, mode_t);
@@ -140,6 +146,7 @@ typedef	int (*vnop_getattr_t)	(vnode_t, struct vattr *);
 typedef	int (*vnop_setattr_t)	(vnode_t, struct vattr *);
 typedef	int (*vnop_inactive_t)	(vnode_t);
 typedef	int (*vnop_truncate_t)	(vnode_t);
+typedef	int (*vnop_poll_t)	(vnode_t, file_t, int, int *);
 
 /*
  * vnode interface
@@ -164,14 +171,20 @@ typedef	int (*vnop_truncate_t)	(vnode_t);
 #define VOP_SETATTR(VP, VAP)	   ((VP)->v_op->vop_setattr)(VP, VAP)
 #define VOP_INACTIVE(VP)	   ((VP)->v_op->vop_inactive)(VP)
 #define VOP_TRUNCATE(VP)	   ((VP)->v_op->vop_truncate)(VP)
+#define VOP_POLL(VP, FP, E, R)	   ((VP)->v_op->vop_poll)(VP, FP, E, R)
+
+/* Semaphore to leave on devices that are polled (DEVIOC_POLL). */
+extern sem_t devpoll_sem;
 
 __BEGIN_DECLS
 int	 vop_nullop(void);
 int	 vop_einval(void);
+int	 vop_pollready(vnode_t vp, file_t fp, int events, int *revents);
 
 vnode_t	 vn_lookup(struct mount *mp, char *path);
 void	 vn_lock(vnode_t vp);
 void	 vn_unlock(vnode_t vp);
+void	 vn_pollwakeup(vnode_t vp);
 int	 vn_stat(vnode_t vp, struct stat *st);
 vnode_t	 vget(struct mount *mp, char *path);
 void	 vput(vnode_t vp);
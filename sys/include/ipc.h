@@ -31,6 +31,8 @@
 #define _IPC_H
 
 #include <sys/cdefs.h>
+#include <sys/hash.h>
+#include <prex/object.h>
 #include <queue.h>
 
 struct thread;
@@ -38,15 +40,39 @@ struct thread;
 struct object {
 	int		magic;		/* magic number */
 	char		name[MAXOBJNAME]; /* object name */
-	struct list	hash_link;	/* link for object hash table */
+	struct hnode	hash_link;	/* link for object hash table */
 	struct list	task_link;	/* link in same task */
 	task_t		owner;		/* creator of this object */
+	int		refcnt;		/* handles + 1 while not destroyed */
 	struct queue	sendq;		/* queue for sender threads */
 	struct queue	recvq;		/* queue for receiver threads */
 };
 
 #define object_valid(obj)  (kern_area(obj) && ((obj)->magic == OBJECT_MAGIC))
 
+/*
+ * Object handle
+ *
+ * User tasks refer to objects by handles. A handle is an index
+ * into the handle table of the task, with the generation of the
+ * slot in the upper bits. The generation is bumped when the
+ * slot is released, so that a stale handle is not accepted.
+ */
+typedef u_long	handle_t;
+
+struct handle {
+	struct object	*obj;		/* object, or NULL if free */
+	u_short		gen;		/* generation of this slot */
+	u_short		rights;		/* OBJ_* rights */
+};
+
+#define NHANDLE		8		/* initial size of handle table */
+#define HANDLE_MAX	256		/* max handles per task */
+
+#define HANDLE(idx, gen)	((handle_t)(gen) << 16 | (idx))
+#define HANDLE_IDX(h)		((h) & 0xffff)
+#define HANDLE_GEN(h)		((h) >> 16)
+
 /*
  * Message header
  */
@@ -57,13 +83,18 @@ struct msg_header {
 };
 
 __BEGIN_DECLS
-int	 object_create(const char *, object_t *);
-int	 object_lookup(const char *, object_t *);
-int	 object_destroy(object_t);
+int	 object_create(const char *, handle_t *);
+int	 object_lookup(const char *, handle_t *);
+int	 object_destroy(handle_t);
+int	 object_grant(handle_t, task_t, int, handle_t *);
+void	 object_delete(object_t);
+struct handle *handle_get(handle_t);
+int	 handle_copy(task_t, task_t);
+void	 handle_cleanup(task_t);
 void	 object_init(void);
-int	 msg_send(object_t, void *, size_t, u_long);
-int	 msg_receive(object_t, void *, size_t, u_long);
-int	 msg_reply(object_t, void *, size_t);
+int	 msg_send(handle_t, void *, size_t, u_long);
+int	 msg_receive(handle_t, void *, size_t, u_long);
+int	 msg_reply(handle_t, void *, size_t);
 void	 msg_cleanup(struct thread *);
 void	 msg_cancel(struct object *);
 void	 msg_init(void);
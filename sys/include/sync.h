@@ -39,6 +39,7 @@ struct sem {
 	task_t		task;		/* owner task */
 	struct event	event;		/* event */
 	u_int		value;		/* current value */
+	int		refcnt;		/* holds by the kernel */
 };
 
 struct mutex {
@@ -82,6 +83,10 @@ int	 sem_wait(sem_t *, u_long);
 int	 sem_trywait(sem_t *);
 int	 sem_post(sem_t *);
 int	 sem_getvalue(sem_t *, u_int *);
+int	 sem_owner(sem_t *, task_t *);
+int	 sem_hold(sem_t);
+void	 sem_release(sem_t);
+void	 sem_kpost(sem_t);
 int	 mutex_init(mutex_t *);
 int	 mutex_destroy(mutex_t *);
 int	 mutex_lock(mutex_t *);
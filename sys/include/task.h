@@ -50,7 +50,12 @@ struct task {
 	struct timer	alarm;		/* alarm timer */
 	void (*handler)(int);		/* pointer to exception handler */
 	task_t		parent;		/* parent task */
-	struct file	file[CONFIG_DEV_OPEN_MAX];
+	struct file	**files;	/* device file table */
+	u_char		*fdmap;		/* bitmap of used files */
+	u_int		nfiles;		/* size of file table */
+	u_int		fdfree;		/* no free entry below this */
+	struct handle	*handles;	/* object handle table */
+	u_int		nhandles;	/* size of handle table */
 };
 
 #define cur_task()	  (cur_thread->task)
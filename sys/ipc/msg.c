@@ -83,12 +83,15 @@ static struct event ipc_event;
  * object. When new message has been reached to the object, it
  * will be received by highest priority thread waiting for
  * that message. A thread can send a message to any object if
- * it knows the object id.
+ * it has a handle of the object with OBJ_SEND right, or it has
+ * CAP_IPC capability.
  */
 int
-msg_send(object_t obj, void *msg, size_t size, u_long timeout)
+msg_send(handle_t handle, void *msg, size_t size, u_long timeout)
 {
 	struct msg_header *hdr;
+	struct handle *h;
+	object_t obj;
 	thread_t th;
 	void *kmsg;
 	int rc;
@@ -101,11 +104,12 @@ msg_send(object_t obj, void *msg, size_t size, u_long timeout)
 
 	sched_lock();
 
-	if (!object_valid(obj)) {
+	if ((h = handle_get(handle)) == NULL || !object_valid(h->obj)) {
 		sched_unlock();
 		return EINVAL;
 	}
-	if (obj->owner != cur_task() && !task_capable(CAP_IPC)) {
+	obj = h->obj;
+	if (!(h->rights & OBJ_SEND) && !task_capable(CAP_IPC)) {
 		sched_unlock();
 		return EPERM;
 	}
@@ -187,7 +191,8 @@ msg_send(object_t obj, void *msg, size_t size, u_long timeout)
  * Receive a message.
  *
  * A thread can receive a message from the object which was
- * created by any thread belongs to same task. If the message
+ * created by any thread belongs to same task, or whose handle
+ * was granted with OBJ_RECEIVE right. If the message
  * has not arrived yet, it blocks until any message comes in.
  *
  * The size argument specifies the "maximum" size of the message
@@ -202,8 +207,10 @@ msg_send(object_t obj, void *msg, size_t size, u_long timeout)
  * simultaneously.
  */
 int
-msg_receive(object_t obj, void *msg, size_t size, u_long timeout)
+msg_receive(handle_t handle, void *msg, size_t size, u_long timeout)
 {
+	struct handle *h;
+	object_t obj;
 	thread_t th;
 	size_t len;
 	int rc, err = 0;
@@ -213,11 +220,12 @@ msg_receive(object_t obj, void *msg, size_t size, u_long timeout)
 
 	sched_lock();
 
-	if (!object_valid(obj)) {
+	if ((h = handle_get(handle)) == NULL || !object_valid(h->obj)) {
 		err = EINVAL;
 		goto out;
 	}
-	if (obj->owner != cur_task()) {
+	obj = h->obj;
+	if (!(h->rights & OBJ_RECEIVE)) {
 		err = EACCES;
 		goto out;
 	}
@@ -311,8 +319,9 @@ msg_receive(object_t obj, void *msg, size_t size, u_long timeout)
  * access the data of the object within this routine.
  */
 int
-msg_reply(object_t obj, void *msg, size_t size)
+msg_reply(handle_t handle, void *msg, size_t size)
 {
+	struct handle *h;
 	thread_t th;
 	size_t len;
 	int err = 0;
@@ -322,7 +331,9 @@ msg_reply(object_t obj, void *msg, size_t size)
 
 	sched_lock();
 
-	if (!object_valid(obj) || obj != cur_thread->recvobj) {
+	h = handle_get(handle);
+	if (h == NULL || !object_valid(h->obj) ||
+	    h->obj != cur_thread->recvobj) {
 		sched_unlock();
 		return EINVAL;
 	}
@@ -50,6 +50,12 @@
  *
  * An object can be created without its name. These object can be
  * used as private objects that are used by threads in same task.
+ *
+ * Tasks refer to objects by handles, which index the handle table
+ * of the task. Each handle carries the rights of the task on the
+ * object, so a message operation only needs a bounds check and a
+ * generation compare to validate its object. A server can grant
+ * a handle of a private object to its client by object_grant().
  */
 
 #include <kernel.h>
@@ -59,67 +65,212 @@
 #include <task.h>
 #include <ipc.h>
 
-#define OBJ_MAXBUCKETS	32	/* Size of object hash buckets */
+#define OBJ_MINBUCKETS	32	/* Initial size of object hash buckets */
 
 /*
  * Object hash table
  *
  * All objects are hashed by its name string. If an object
- * has no name, it is linked to index zero. The scheduler
- * must be locked when this table is touched.
+ * has no name, its hash value is zero. The table grows with
+ * the number of objects. The scheduler must be locked when
+ * this table is touched.
  */
-static struct list obj_table[OBJ_MAXBUCKETS];
+static struct htable obj_table;
 
 /*
- * Calculate the hash index for specified name string.
- * The name can be NULL if the object does not have its
- * name.
+ * Helper function to find the object from the specified name.
+ * Returns NULL if not found.
  */
-static u_int
-object_hash(const char *name)
+static object_t
+object_find(const char *name)
 {
-	u_int h = 0;
+	struct hnode *hn = NULL;
+	object_t obj;
+	u_int val;
 
-	if (name == NULL)
-		return 0;
-	while (*name)
-		h = ((h << 5) + h) + *name++;
-	return h & (OBJ_MAXBUCKETS - 1);
+	val = hash_string(name);
+	while ((hn = hash_lookup(&obj_table, val, hn)) != NULL) {
+		obj = hash_entry(hn, struct object, hash_link);
+		if (!strncmp(obj->name, name, MAXOBJNAME))
+			return obj;
+	}
+	return NULL;
 }
 
 /*
- * Helper function to find the object from the specified name.
- * Returns NULL if not found.
+ * Get the handle entry for the handle of the current task.
+ * Returns NULL if the handle is not valid. The object of
+ * the entry may have been destroyed.
  */
-static object_t
-object_find(const char *name)
+struct handle *
+handle_get(handle_t handle)
 {
-	list_t head, n;
-	object_t obj = NULL;
+	task_t self = cur_task();
+	struct handle *h;
+	u_int idx;
 
-	head = &obj_table[object_hash(name)];
+	idx = HANDLE_IDX(handle);
+	if (idx >= self->nhandles)
+		return NULL;
+	h = &self->handles[idx];
+	if (h->obj == NULL || h->gen != HANDLE_GEN(handle))
+		return NULL;
+	return h;
+}
 
-	for (n = list_first(head); n != head; n = list_next(n)) {
-		obj = list_entry(n, struct object, hash_link);
-		if (!strncmp(obj->name, name, MAXOBJNAME))
-			break;
+/*
+ * Double the handle table of the task.
+ */
+static int
+handle_grow(task_t task)
+{
+	struct handle *table;
+	u_int i, n;
+
+	n = task->nhandles ? task->nhandles * 2 : NHANDLE;
+	if (n > HANDLE_MAX)
+		return EMFILE;
+	if ((table = kmem_alloc(n * sizeof(struct handle))) == NULL)
+		return ENOMEM;
+	for (i = 0; i < n; i++) {
+		if (i < task->nhandles)
+			table[i] = task->handles[i];
+		else {
+			table[i].obj = NULL;
+			table[i].gen = 1;
+			table[i].rights = 0;
+		}
 	}
-	if (n == head)
-		return NULL;
-	return obj;
+	if (task->handles != NULL)
+		kmem_free(task->handles);
+	task->handles = table;
+	task->nhandles = n;
+	return 0;
+}
+
+/*
+ * Give the task a handle of the object with the rights.
+ * If the task already has a handle of the object, the rights
+ * are added to that handle.  Otherwise the lowest free slot
+ * is used.
+ */
+static int
+handle_install(task_t task, object_t obj, int rights, handle_t *handle)
+{
+	struct handle *h;
+	u_int i, idx;
+	int err;
+
+	idx = task->nhandles;
+	for (i = 0; i < task->nhandles; i++) {
+		h = &task->handles[i];
+		if (h->obj == obj) {
+			h->rights |= rights;
+			*handle = HANDLE(i, h->gen);
+			return 0;
+		}
+		if (h->obj == NULL && idx == task->nhandles)
+			idx = i;
+	}
+	if (idx == task->nhandles && (err = handle_grow(task)) != 0)
+		return err;
+
+	h = &task->handles[idx];
+	h->obj = obj;
+	h->rights = (u_short)rights;
+	obj->refcnt++;
+	*handle = HANDLE(idx, h->gen);
+	return 0;
+}
+
+/*
+ * Drop a reference of the object.
+ * The object is freed with its last reference.
+ */
+static void
+object_release(object_t obj)
+{
+
+	if (--obj->refcnt == 0)
+		kmem_free(obj);
+}
+
+/*
+ * Release the handle entry of the task.
+ */
+static void
+handle_release(struct handle *h)
+{
+
+	object_release(h->obj);
+	h->obj = NULL;
+	h->rights = 0;
+	if (++h->gen == 0)
+		h->gen = 1;
+}
+
+/*
+ * Copy the handle table of the parent task to the child.
+ * This is called by task_create() when the child inherits
+ * the memory, and so the handles, of its parent.  The child
+ * keeps only the send right on the objects it does not own.
+ */
+int
+handle_copy(task_t parent, task_t child)
+{
+	struct handle *h;
+	u_int i;
+
+	if (parent->nhandles == 0)
+		return 0;
+	child->handles = kmem_alloc(parent->nhandles * sizeof(struct handle));
+	if (child->handles == NULL)
+		return ENOMEM;
+	memcpy(child->handles, parent->handles,
+	       parent->nhandles * sizeof(struct handle));
+	child->nhandles = parent->nhandles;
+	for (i = 0; i < child->nhandles; i++) {
+		h = &child->handles[i];
+		if (h->obj == NULL)
+			continue;
+		h->obj->refcnt++;
+		if (h->obj->owner != child)
+			h->rights &= ~(OBJ_RECEIVE | OBJ_GRANT);
+	}
+	return 0;
+}
+
+/*
+ * Release all handles of the terminated task.
+ */
+void
+handle_cleanup(task_t task)
+{
+	u_int i;
+
+	for (i = 0; i < task->nhandles; i++) {
+		if (task->handles[i].obj != NULL)
+			object_release(task->handles[i].obj);
+	}
+	if (task->handles != NULL)
+		kmem_free(task->handles);
+	task->handles = NULL;
+	task->nhandles = 0;
 }
 
 /*
  * Search an object in the object name space. The object
- * name must be null-terminated string. The object ID is
- * returned in obj on success.
+ * name must be null-terminated string. The handle of the
+ * object is returned in handle on success.
  */
 int
-object_lookup(const char *name, object_t *objp)
+object_lookup(const char *name, handle_t *handle)
 {
 	object_t obj;
 	size_t len;
+	handle_t h;
 	char str[MAXOBJNAME];
+	int err;
 
 	if (umem_strnlen(name, MAXOBJNAME, &len))
 		return EFAULT;
@@ -129,12 +280,16 @@ object_lookup(const char *name, object_t *objp)
 		return EFAULT;
 
 	sched_lock();
-	obj = object_find(str);
-	sched_unlock();
-
-	if (obj == NULL)
+	if ((obj = object_find(str)) == NULL) {
+		sched_unlock();
 		return ENOENT;
-	if (umem_copyout(&obj, objp, sizeof(obj)))
+	}
+	err = handle_install(cur_task(), obj,
+			     obj->owner == cur_task() ? OBJ_ALL : 0, &h);
+	sched_unlock();
+	if (err)
+		return err;
+	if (umem_copyout(&h, handle, sizeof(h)))
 		return EFAULT;
 	return 0;
 }
@@ -142,20 +297,22 @@ object_lookup(const char *name, object_t *objp)
 /*
  * Create a new object.
  *
- * The ID of the new object is stored in pobj on success.
+ * The handle of the new object is stored in handle on success.
  * The name of the object must be unique in the system.
  * Or, the object can be created without name by setting
  * NULL as name argument. This object can be used as a
  * private object which can be accessed only by threads in
- * same task.
+ * same task, or by tasks which are granted its handle.
  */
 int
-object_create(const char *name, object_t *objp)
+object_create(const char *name, handle_t *handle)
 {
 	struct object *obj = 0;
 	char str[MAXOBJNAME];
 	task_t self;
 	size_t len = 0;
+	handle_t h = 0;
+	int err;
 
 	if (name != NULL) {
 		if (umem_strnlen(name, MAXOBJNAME, &len))
@@ -172,11 +329,11 @@ object_create(const char *name, object_t *objp)
 	 * Check user buffer first. This can reduce the error
 	 * recovery for the subsequence resource allocations.
 	 */
-	if (umem_copyout(&obj, objp, sizeof(obj))) {
+	if (umem_copyout(&h, handle, sizeof(h))) {
 		sched_unlock();
 		return EFAULT;
 	}
-	if (object_find(str) != NULL) {
+	if (name != NULL && object_find(str) != NULL) {
 		sched_unlock();
 		return EEXIST;
 	}
@@ -184,47 +341,113 @@ object_create(const char *name, object_t *objp)
 		sched_unlock();
 		return ENOMEM;
 	}
-	if (name != NULL)
-		strlcpy(obj->name, str, len + 1);
+	strlcpy(obj->name, str, len + 1);
 
 	self = cur_task();
 	obj->owner = self;
 	obj->magic = OBJECT_MAGIC;
+	obj->refcnt = 1;
 	queue_init(&obj->sendq);
 	queue_init(&obj->recvq);
-	list_insert(&obj_table[object_hash(name)], &obj->hash_link);
+	if ((err = handle_install(self, obj, OBJ_ALL, &h)) != 0) {
+		kmem_free(obj);
+		sched_unlock();
+		return err;
+	}
+	if (name != NULL)
+		hash_insert(&obj_table, &obj->hash_link, hash_string(str));
 	list_insert(&self->objects, &obj->task_link);
 
-	umem_copyout(&obj, objp, sizeof(obj));
+	umem_copyout(&h, handle, sizeof(h));
 	sched_unlock();
 	return 0;
 }
 
+/*
+ * Delete an object.
+ *
+ * All pending messages related to the deleted object are
+ * canceled. The memory of the object is kept until all
+ * handles of it are released.
+ */
+void
+object_delete(object_t obj)
+{
+
+	obj->magic = 0;
+	msg_cancel(obj);
+	list_remove(&obj->task_link);
+	if (obj->name[0] != '\0')
+		hash_remove(&obj_table, &obj->hash_link);
+	object_release(obj);
+}
+
 /*
  * Destroy an object.
  *
  * A thread can delete the object only when the target
  * object is created by the thread of the same task.  All
  * pending messages related to the deleted object are
- * automatically canceled.
+ * automatically canceled.  For other tasks, this just
+ * releases the handle.
  */
 int
-object_destroy(object_t obj)
+object_destroy(handle_t handle)
 {
+	struct handle *h;
+	object_t obj;
 	int err = 0;
 
 	sched_lock();
-	if (!object_valid(obj)) {
+	if ((h = handle_get(handle)) == NULL) {
 		err = EINVAL;
-	} else if (obj->owner != cur_task()) {
-		err = EACCES;
 	} else {
-		obj->magic = 0;
-		msg_cancel(obj);
-		list_remove(&obj->task_link);
-		list_remove(&obj->hash_link);
-		kmem_free(obj);
+		obj = h->obj;
+		if (object_valid(obj) && obj->owner == cur_task())
+			object_delete(obj);
+		handle_release(h);
+	}
+	sched_unlock();
+	return err;
+}
+
+/*
+ * Grant a handle of the object to another task.
+ *
+ * The caller must have OBJ_GRANT right on the object, and
+ * can only grant the rights it has. A server usually grants
+ * a handle to the sender of a request, and returns it in the
+ * reply. The handle for the target task is stored in newh.
+ */
+int
+object_grant(handle_t handle, task_t task, int rights, handle_t *newh)
+{
+	struct handle *h;
+	handle_t nh = 0;
+	int err;
+
+	if (rights & ~OBJ_ALL)
+		return EINVAL;
+
+	sched_lock();
+	if (umem_copyout(&nh, newh, sizeof(nh))) {
+		sched_unlock();
+		return EFAULT;
+	}
+	if ((h = handle_get(handle)) == NULL || !object_valid(h->obj)) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (!(h->rights & OBJ_GRANT) || (rights & ~h->rights)) {
+		sched_unlock();
+		return EACCES;
+	}
+	if (!task_valid(task)) {
+		sched_unlock();
+		return ESRCH;
 	}
+	if ((err = handle_install(task, h->obj, rights, &nh)) == 0)
+		umem_copyout(&nh, newh, sizeof(nh));
 	sched_unlock();
 	return err;
 }
@@ -232,8 +455,7 @@ object_destroy(object_t obj)
 void
 object_init(void)
 {
-	int i;
 
-	for (i = 0; i < OBJ_MAXBUCKETS; i++)
-		list_init(&obj_table[i]);
+	if (hash_init(&obj_table, OBJ_MINBUCKETS))
+		panic("object_init");
 }
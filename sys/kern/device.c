@@ -52,10 +52,20 @@
 #include <task.h>
 #include <sched.h>
 #include <device.h>
+#include <sync.h>
 #include <verbose.h>
+#include <sys/ioctl.h>
+#include <sys/poll.h>
 
 static struct list device_list;		/* list of the device objects */
 
+/*
+ * Semaphore posted when a device may have become ready.
+ * It is left by the file system server, and it is posted once.
+ */
+static sem_t poll_sem;
+static struct dpc poll_dpc;
+
 /*
  * Increment reference count on an active device.
  * It returns 0 on success, or -1 if the device is invalid.
@@ -180,33 +190,115 @@ device_destroy(device_t dev)
 }
 
 #define FD_MAGIC 0x44455600	/* 'DEV\0' */
+#define NDEVFILE	8	/* initial size of file table */
+
+/*
+ * An open device file. The file table holds one reference,
+ * and each device call holds another while it is in the
+ * driver, so that a close by another thread of the task can
+ * not free the file under it.
+ */
+struct devfile {
+	struct file	file;		/* passed to the driver */
+	int		refcnt;		/* reference count */
+};
+
+/*
+ * Grow the device file table of a task.
+ * The table starts with NDEVFILE entries, and it is doubled
+ * up to CONFIG_DEV_OPEN_MAX entries. The bitmap of used
+ * entries follows the file pointers in the same block.
+ */
+static int
+fd_grow(task_t task)
+{
+	file_t *files;
+	u_char *map;
+	u_int n, omapsize;
+
+	n = task->nfiles ? task->nfiles * 2 : NDEVFILE;
+	if (n > CONFIG_DEV_OPEN_MAX)
+		n = CONFIG_DEV_OPEN_MAX;
+	if (n <= task->nfiles)
+		return EMFILE;
+
+	files = kmem_alloc(n * sizeof(file_t) + howmany(n, NBBY));
+	if (files == NULL)
+		return ENOMEM;
+	map = (u_char *)(files + n);
+	memset(files, 0, n * sizeof(file_t));
+	memset(map, 0, howmany(n, NBBY));
+	if (task->files != NULL) {
+		omapsize = howmany(task->nfiles, NBBY);
+		memcpy(files, task->files, task->nfiles * sizeof(file_t));
+		memcpy(map, task->fdmap, omapsize);
+		kmem_free(task->files);
+	}
+	task->files = files;
+	task->fdmap = map;
+	task->nfiles = n;
+	return 0;
+}
+
+/*
+ * Find the lowest free entry in the file table, and mark it
+ * in use. Returns -errno on failure.
+ */
+static int
+fd_find(task_t task)
+{
+	u_int i, n;
+	int err;
+
+	n = howmany(task->nfiles, NBBY);
+	for (i = task->fdfree / NBBY; i < n; i++) {
+		if (task->fdmap[i] != 0xff)
+			break;
+	}
+	i *= NBBY;
+	while (i < task->nfiles && isset(task->fdmap, i))
+		i++;
+	if (i >= task->nfiles) {
+		i = task->nfiles;
+		if ((err = fd_grow(task)) != 0)
+			return -err;
+	}
+	setbit(task->fdmap, i);
+	task->fdfree = i + 1;
+	return (int)i;
+}
+
 static fd_t
 fd_alloc(const char *name)
 {
-	u_int i = 0;
-	fd_t fd;
-	file_t file = &cur_task()->file[0];
+	task_t task = cur_task();
+	struct devfile *df;
 	device_t dev;
+	fd_t fd;
+	int i;
 
 	sched_lock();
-	while (file->dev) {
-		file++;
-		i++;
-		if (i >= CONFIG_DEV_OPEN_MAX) {
-			fd = DERR(-EMFILE);
-			goto out;
-		}
-	}
-	fd = i ^ FD_MAGIC;
-
 	if ((dev = device_lookup(name)) == NULL) {
 		fd = DERR(-ENXIO);
 		goto out;
 	}
+	if ((df = kmem_alloc(sizeof(*df))) == NULL) {
+		fd = DERR(-ENOMEM);
+		goto out;
+	}
+	if ((i = fd_find(task)) < 0) {
+		kmem_free(df);
+		fd = DERR(i);
+		goto out;
+	}
+	fd = (u_int)i ^ FD_MAGIC;
+
 	device_hold(dev);
-	file->dev = dev;
-	file->priv = dev->info;
-	file->f_flags = 0;
+	df->file.dev = dev;
+	df->file.priv = dev->info;
+	df->file.f_flags = 0;
+	df->refcnt = 1;
+	task->files[i] = &df->file;
 
 out:
 	sched_unlock();
@@ -214,43 +306,72 @@ out:
 }
 
 static file_t
-file_lookup(fd_t fd)
+task_file(task_t task, fd_t fd)
 {
 	file_t file;
 	u_int i = fd ^ FD_MAGIC;
 
-	if (i >= CONFIG_DEV_OPEN_MAX)
-		return NULL;
-
 	sched_lock();
-	file = &cur_task()->file[i];
-
-	if (file->dev == NULL)
+	if (i >= task->nfiles)
 		file = NULL;
+	else
+		file = task->files[i];
 	sched_unlock();
 	return file;
 }
 
-static int
-fd_free(fd_t fd)
+/*
+ * Look up a file of the current task and take a reference
+ * on it. The caller must drop it with file_release().
+ */
+static file_t
+file_lookup(fd_t fd)
 {
 	file_t file;
-	int err = 0;
 
 	sched_lock();
-	file = file_lookup(fd);
+	if ((file = task_file(cur_task(), fd)) != NULL)
+		((struct devfile *)file)->refcnt++;
+	sched_unlock();
+	return file;
+}
 
-	if (file == NULL) {
-		err = DERR(-EBADF);
-		goto out;
+/*
+ * Drop a reference to a file. The last one closes the
+ * device reference and frees the file.
+ */
+static void
+file_release(file_t file)
+{
+	struct devfile *df = (struct devfile *)file;
+
+	sched_lock();
+	if (--df->refcnt == 0) {
+		device_release(file->dev);
+		kmem_free(df);
 	}
+	sched_unlock();
+}
 
-	device_release(file->dev);
-	file->dev = NULL;
+/*
+ * Remove a file from the file table, and return it with the
+ * reference the table held.
+ */
+static file_t
+fd_detach(task_t task, fd_t fd)
+{
+	file_t file;
+	u_int i = fd ^ FD_MAGIC;
 
-out:
+	sched_lock();
+	if ((file = task_file(task, fd)) != NULL) {
+		task->files[i] = NULL;
+		clrbit(task->fdmap, i);
+		if (i < task->fdfree)
+			task->fdfree = i;
+	}
 	sched_unlock();
-	return err;
+	return file;
 }
 
 /*
@@ -259,13 +380,24 @@ out:
 void
 device_terminate(task_t task)
 {
+	file_t file;
 	u_int i;
 
 	sched_lock();
-	for (i = 0; i < CONFIG_DEV_OPEN_MAX; i++) {
-		if (task->file[i].dev != NULL)
-			device_close(i ^ FD_MAGIC);
+	for (i = 0; i < task->nfiles; i++) {
+		if ((file = task->files[i]) == NULL)
+			continue;
+		if (file->dev->devio->close != NULL)
+			(*file->dev->devio->close)(file);
+		fd_detach(task, i ^ FD_MAGIC);
+		file_release(file);
 	}
+	if (task->files != NULL)
+		kmem_free(task->files);
+	task->files = NULL;
+	task->fdmap = NULL;
+	task->nfiles = 0;
+	task->fdfree = 0;
 	sched_unlock();
 }
 
@@ -305,15 +437,17 @@ device_open(const char *name, int flags, fd_t *fdp)
 	if (fd < 0)
 		return -fd;
 
-	file = file_lookup(fd);
+	if ((file = file_lookup(fd)) == NULL)
+		return DERR(EBADF);
 	file->f_flags = flags;
 
 	if (file->dev->devio->open != NULL)
 		err = (*file->dev->devio->open)(file);
 	if (!err)
 		err = umem_copyout(&fd, fdp, sizeof(fd));
-	else
-		fd_free(fd);
+	else if (fd_detach(cur_task(), fd) == file)
+		file_release(file);
+	file_release(file);
 	return err;
 }
 
@@ -329,13 +463,18 @@ device_close(fd_t fd)
 	file_t file;
 	int err = 0;
 
-	if ((file = file_lookup(fd)) == NULL)
+	/*
+	 * Remove the file from the table first, so that only one
+	 * thread closes it. A device call which is still running
+	 * keeps its own reference.
+	 */
+	if ((file = fd_detach(cur_task(), fd)) == NULL)
 		return DERR(EBADF);
 
 	if (file->dev->devio->close != NULL)
 		err = (*file->dev->devio->close)(file);
 
-	fd_free(fd);
+	file_release(file);
 	return err;
 }
 
@@ -356,15 +495,15 @@ device_read(fd_t fd, void *buf, size_t *nbyte, int blkno)
 		return DERR(EBADF);
 
 	if (file->dev->devio->read == NULL)
-		return DERR(EIO);
-
-	if (umem_copyin(nbyte, &count, sizeof(count)))
-		return EFAULT;
-
-	err = (*file->dev->devio->read)(file, buf, &count, blkno);
-	if (err == 0)
-		err = umem_copyout(&count, nbyte, sizeof(count));
-
+		err = DERR(EIO);
+	else if (umem_copyin(nbyte, &count, sizeof(count)))
+		err = EFAULT;
+	else {
+		err = (*file->dev->devio->read)(file, buf, &count, blkno);
+		if (err == 0)
+			err = umem_copyout(&count, nbyte, sizeof(count));
+	}
+	file_release(file);
 	return err;
 }
 
@@ -384,16 +523,82 @@ device_write(fd_t fd, void *buf, size_t *nbyte, int blkno)
 		return DERR(EBADF);
 
 	if (file->dev->devio->write == NULL)
-		return DERR(EIO);
+		err = DERR(EIO);
+	else if (umem_copyin(nbyte, &count, sizeof(count)))
+		err = EFAULT;
+	else {
+		err = (*file->dev->devio->write)(file, buf, &count, blkno);
+		if (err == 0)
+			err = umem_copyout(&count, nbyte, sizeof(count));
+	}
+	file_release(file);
+	return err;
+}
+
+/*
+ * Check the readiness of a device.
+ *
+ * The poll events in "arg" are checked, and the events that
+ * are ready are returned. A device without a poll routine never
+ * blocks, and it is always ready. The semaphore is left before
+ * the driver is asked, so that no change can be lost.
+ */
+static int
+device_poll(file_t file, struct devpoll *arg)
+{
+	struct devpoll dp;
 
-	if (umem_copyin(nbyte, &count, sizeof(count)))
+	if (umem_copyin(arg, &dp, sizeof(dp)))
 		return EFAULT;
 
-	err = (*file->dev->devio->write)(file, buf, &count, blkno);
-	if (err == 0)
-		err = umem_copyout(&count, nbyte, sizeof(count));
+	if (dp.sem != SEM_NULL && dp.sem != poll_sem) {
+		sched_lock();
+		if (sem_hold(dp.sem) != 0) {
+			sched_unlock();
+			return EINVAL;
+		}
+		if (poll_sem != SEM_NULL)
+			sem_release(poll_sem);
+		poll_sem = dp.sem;
+		sched_unlock();
+	}
+
+	if (file->dev->devio->poll == NULL)
+		dp.revents = dp.events & (POLLIN | POLLRDNORM | POLLOUT);
+	else
+		dp.revents = (*file->dev->devio->poll)(file, dp.events);
 
-	return err;
+	return umem_copyout(&dp.revents, &arg->revents, sizeof(dp.revents));
+}
+
+/*
+ * Post the poll semaphore.  This is called by DPC.
+ */
+static void
+device_polldpc(void *arg)
+{
+
+	sched_lock();
+	if (poll_sem != SEM_NULL) {
+		sem_kpost(poll_sem);
+		sem_release(poll_sem);
+		poll_sem = SEM_NULL;
+	}
+	sched_unlock();
+}
+
+/*
+ * device_pollwakeup - tell the pollers that a device may be ready.
+ *
+ * A driver with a poll routine calls this when its state
+ * changes. This may be called at interrupt level.
+ */
+void
+device_pollwakeup(void)
+{
+
+	if (poll_sem != SEM_NULL)
+		sched_dpc(&poll_dpc, device_polldpc, NULL);
 }
 
 /*
@@ -401,20 +606,26 @@ device_write(fd_t fd, void *buf, size_t *nbyte, int blkno)
  *
  * A command and an argument are completely device dependent.
  * The ioctl routine of each driver must validate the user buffer
- * pointed by the arg value.
+ * pointed by the arg value. DEVIOC_POLL is the exception, and
+ * it is handled here for all devices.
  */
 int
 device_ioctl(fd_t fd, u_long cmd, void *arg)
 {
 	file_t file;
+	int err;
 
 	if ((file = file_lookup(fd)) == NULL)
 		return DERR(EBADF);
 
-	if (file->dev->devio->ioctl == NULL)
-		return DERR(EIO);
-
-	return (*file->dev->devio->ioctl)(file, cmd, arg);
+	if (cmd == DEVIOC_POLL)
+		err = device_poll(file, arg);
+	else if (file->dev->devio->ioctl == NULL)
+		err = DERR(EIO);
+	else
+		err = (*file->dev->devio->ioctl)(file, cmd, arg);
+	file_release(file);
+	return err;
 }
 
 /*
@@ -82,6 +82,7 @@ extern void assert(const char *file, int line, const char *exp)
 EXPORT_SYMBOL(device_create);
 EXPORT_SYMBOL(device_destroy);
 EXPORT_SYMBOL(device_broadcast);
+EXPORT_SYMBOL(device_pollwakeup);
 EXPORT_SYMBOL(umem_copyin);
 EXPORT_SYMBOL(umem_copyout);
 EXPORT_SYMBOL(umem_strnlen);
@@ -106,5 +106,7 @@ const sysfn_t syscall_table[] = {
 	/* 58 */ SYSENT(sys_time),
 	/* 59 */ SYSENT(sys_debug),
 	/* 60 */ SYSENT(thread_name),
+	/* 61 */ SYSENT(object_grant),
+	/* 62 */ SYSENT(sem_owner),
 };
 const u_int nr_syscalls = sizeof(syscall_table) / sizeof(sysfn_t);
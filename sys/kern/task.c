@@ -151,6 +151,17 @@ task_create(task_t parent, int vm_option, task_t *child)
 	task->magic = TASK_MAGIC;
 	list_init(&task->objects);
 	list_init(&task->threads);
+
+	/*
+	 * A child which shares or copies the memory of its parent
+	 * also inherits the object handles stored in it.
+	 */
+	if (vm_option != VM_NEW && handle_copy(parent, task) != 0) {
+		vm_terminate(map);
+		kmem_free(task);
+		err = ENOMEM;
+		goto out;
+	}
 	list_insert(&kern_task.link, &task->link);
 
 	if (cur_task() == &kern_task)
@@ -194,20 +205,15 @@ task_terminate(task_t task)
 			thread_terminate(th);
 	}
 	/*
-	 * Delete all objects owned by the target task.
+	 * Delete all objects owned by the target task, and
+	 * release its handles.
 	 */
 	head = &task->objects;
-	for (n = list_first(head); n != head; n = list_next(n)) {
-		/*
-		 * A current task may not have permission to
-		 * delete target objects. So, we set the owner
-		 * of the object to the current task before
-		 * deleting it.
-		 */
-		obj = list_entry(n, struct object, task_link);
-		obj->owner = cur_task();
-		object_destroy(obj);
+	while (!list_empty(head)) {
+		obj = list_entry(list_first(head), struct object, task_link);
+		object_delete(obj);
 	}
+	handle_cleanup(task);
 	/*
 	 * Invalidate task and release all other task related resources.
 	 */
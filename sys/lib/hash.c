@@ -0,0 +1,286 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * hash.c - resizable hash table library
+ */
+
+#include <kernel.h>
+#include <kmem.h>
+#include <kpage.h>
+#include <sys/hash.h>
+
+/*
+ * Small tables come from kmem, larger ones from whole pages
+ * because kmem can not allocate a page or more.
+ */
+static void *
+hash_getmem(size_t size)
+{
+	void *pa;
+
+	if (size <= PAGE_SIZE / 2)
+		return kmem_alloc(size);
+	if ((pa = kpage_alloc(PAGE_ALIGN(size))) == NULL)
+		return NULL;
+	return phys_to_virt(pa);
+}
+
+static void
+hash_putmem(void *addr, size_t size)
+{
+
+	if (size <= PAGE_SIZE / 2)
+		kmem_free(addr);
+	else
+		kpage_free(virt_to_phys(addr), PAGE_ALIGN(size));
+}
+
+#define HASH_MOVE	2	/* old buckets moved per insert */
+
+/*
+ * Allocate and initialize the buckets.
+ */
+static struct list *
+hash_alloc(u_int size)
+{
+	struct list *table;
+	u_int i;
+
+	if ((table = hash_getmem(size * sizeof(struct list))) == NULL)
+		return NULL;
+	for (i = 0; i < size; i++)
+		list_init(&table[i]);
+	return table;
+}
+
+/*
+ * Move the entries of some old buckets to the new table.
+ * The old table is freed when all buckets are moved.
+ */
+static void
+hash_move(struct htable *ht, u_int nbuckets)
+{
+	struct list *head, *n;
+	struct hnode *hn;
+
+	while (nbuckets-- > 0 && ht->ht_move < ht->ht_oldsize) {
+		head = &ht->ht_old[ht->ht_move++];
+		while (!list_empty(head)) {
+			n = list_first(head);
+			list_remove(n);
+			hn = list_entry(n, struct hnode, h_link);
+			list_insert(&ht->ht_table[hn->h_val &
+						  (ht->ht_size - 1)], n);
+		}
+	}
+	if (ht->ht_move == ht->ht_oldsize) {
+		hash_putmem(ht->ht_old, ht->ht_oldsize * sizeof(struct list));
+		ht->ht_old = NULL;
+		ht->ht_oldsize = 0;
+	}
+}
+
+/*
+ * Start to grow the table to twice its size.
+ * The table keeps its size if no memory is available.
+ */
+static void
+hash_grow(struct htable *ht)
+{
+	struct list *table;
+
+	if ((table = hash_alloc(ht->ht_size * 2)) == NULL)
+		return;
+	ht->ht_old = ht->ht_table;
+	ht->ht_oldsize = ht->ht_size;
+	ht->ht_move = 0;
+	ht->ht_table = table;
+	ht->ht_size *= 2;
+}
+
+/*
+ * Initialize the hash table with size buckets.
+ * The size must be a power of 2.
+ */
+int
+hash_init(struct htable *ht, u_int size)
+{
+
+	if ((ht->ht_table = hash_alloc(size)) == NULL)
+		return ENOMEM;
+	ht->ht_size = size;
+	ht->ht_count = 0;
+	ht->ht_old = NULL;
+	ht->ht_oldsize = 0;
+	ht->ht_move = 0;
+	return 0;
+}
+
+/*
+ * Insert the entry with hash value val.
+ */
+void
+hash_insert(struct htable *ht, struct hnode *hn, u_int val)
+{
+
+	if (ht->ht_old != NULL)
+		hash_move(ht, HASH_MOVE);
+	else if (ht->ht_count >= ht->ht_size)
+		hash_grow(ht);
+
+	hn->h_val = val;
+	list_insert(&ht->ht_table[val & (ht->ht_size - 1)], &hn->h_link);
+	ht->ht_count++;
+}
+
+/*
+ * Remove the entry from the table.
+ * Entries are never moved by a removal, so the table can
+ * be walked while entries are removed.
+ */
+void
+hash_remove(struct htable *ht, struct hnode *hn)
+{
+
+	list_remove(&hn->h_link);
+	ht->ht_count--;
+}
+
+/*
+ * Find the next entry which has hash value val.
+ * The search starts from the first entry if hn is NULL,
+ * or from the entry following hn.  Returns NULL if there
+ * is no more entry.
+ */
+struct hnode *
+hash_lookup(struct htable *ht, u_int val, struct hnode *hn)
+{
+	struct list *head, *old, *n;
+	u_int i;
+
+	old = NULL;
+	if (ht->ht_old != NULL) {
+		i = val & (ht->ht_oldsize - 1);
+		if (i >= ht->ht_move)
+			old = &ht->ht_old[i];
+	}
+	head = &ht->ht_table[val & (ht->ht_size - 1)];
+
+	if (hn != NULL)
+		n = list_next(&hn->h_link);
+	else
+		n = list_first(old != NULL ? old : head);
+	for (;;) {
+		if (n == old) {
+			n = list_first(head);
+			continue;
+		}
+		if (n == head)
+			return NULL;
+		hn = list_entry(n, struct hnode, h_link);
+		if (hn->h_val == val)
+			return hn;
+		n = list_next(n);
+	}
+}
+
+/*
+ * Get the next entry of the table.
+ * The walk starts from the first entry if hn is NULL.
+ * Returns NULL at the end of the table.
+ */
+struct hnode *
+hash_walk(struct htable *ht, struct hnode *hn)
+{
+	struct list *n, *end;
+	struct list *table;
+	u_int i;
+
+	if (hn == NULL) {
+		/* Start from the buckets not moved yet. */
+		if (ht->ht_old != NULL) {
+			table = ht->ht_old;
+			i = ht->ht_move;
+			end = &table[ht->ht_oldsize];
+		} else {
+			table = ht->ht_table;
+			i = 0;
+			end = &table[ht->ht_size];
+		}
+		n = &table[i];
+	} else {
+		/* Find the bucket which hn belongs to. */
+		for (n = list_next(&hn->h_link); ; n = list_next(n)) {
+			if (ht->ht_old != NULL && n >= ht->ht_old &&
+			    n < &ht->ht_old[ht->ht_oldsize]) {
+				table = ht->ht_old;
+				end = &table[ht->ht_oldsize];
+				break;
+			}
+			if (n >= ht->ht_table && n < &ht->ht_table[ht->ht_size]) {
+				table = ht->ht_table;
+				end = &table[ht->ht_size];
+				break;
+			}
+			return list_entry(n, struct hnode, h_link);
+		}
+		n++;
+	}
+
+	/* Find the next non-empty bucket from n. */
+	for (;;) {
+		if (n < end && !list_empty(n))
+			return list_entry(list_first(n), struct hnode, h_link);
+		if (n < end) {
+			n++;
+			continue;
+		}
+		if (table == ht->ht_table)
+			return NULL;
+		table = ht->ht_table;
+		n = &table[0];
+		end = &table[ht->ht_size];
+	}
+}
+
+/*
+ * Get the hash value of the string.
+ */
+u_int
+hash_string(const char *str)
+{
+	u_int val = 0;
+
+	if (str != NULL) {
+		while (*str)
+			val = ((val << 5) + val) + *str++;
+	}
+	return val;
+}
@@ -92,6 +92,7 @@ sem_init(sem_t *sem, u_int value)
 			event_init(&s->event, "semaphore");
 			s->task = cur_task();
 			s->value = value;
+			s->refcnt = 0;
 			s->magic = SEM_MAGIC;
 			if (umem_copyout(&s, sem, sizeof(s))) {
 				kmem_free(s);
@@ -130,7 +131,8 @@ sem_copyin(sem_t *usem, sem_t *ksem)
 /*
  * Destroy a semaphore.
  * If some thread is waiting for the specified semaphore,
- * this routine fails with EBUSY.
+ * this routine fails with EBUSY.  A semaphore held by the
+ * kernel is freed when it is released.
  */
 int
 sem_destroy(sem_t *sem)
@@ -148,7 +150,8 @@ sem_destroy(sem_t *sem)
 		return EBUSY;
 	}
 	s->magic = 0;
-	kmem_free(s);
+	if (s->refcnt == 0)
+		kmem_free(s);
 	sched_unlock();
 	return 0;
 }
@@ -270,3 +273,72 @@ sem_getvalue(sem_t *sem, u_int *value)
 	sched_unlock();
 	return err;
 }
+
+/*
+ * Get the task which owns a semaphore.
+ *
+ * A server uses this to check that a semaphore passed by a
+ * client belongs to the client, before it posts it on the
+ * client's behalf.  No capability is needed.
+ */
+int
+sem_owner(sem_t *sem, task_t *task)
+{
+	sem_t s;
+	int err = 0;
+
+	sched_lock();
+	if (umem_copyin(sem, &s, sizeof(s)))
+		err = EFAULT;
+	else if (!sem_valid(s))
+		err = EINVAL;
+	else if (umem_copyout(&s->task, task, sizeof(s->task)))
+		err = EFAULT;
+	sched_unlock();
+	return err;
+}
+
+/*
+ * Hold a semaphore of the current task, so that the kernel
+ * can post it later with sem_kpost().  It stays allocated
+ * until sem_release() even if the task destroys it.
+ * The scheduler must be locked.
+ */
+int
+sem_hold(sem_t s)
+{
+
+	if (!sem_valid(s))
+		return EINVAL;
+	if (s->task != cur_task())
+		return EPERM;
+	s->refcnt++;
+	return 0;
+}
+
+/*
+ * Release a semaphore held by sem_hold().
+ * The scheduler must be locked.
+ */
+void
+sem_release(sem_t s)
+{
+
+	if (--s->refcnt == 0 && s->magic != SEM_MAGIC)
+		kmem_free(s);
+}
+
+/*
+ * Post a semaphore held by the kernel.
+ * Nothing is done if the owner has destroyed it.
+ * The scheduler must be locked.
+ */
+void
+sem_kpost(sem_t s)
+{
+
+	if (!sem_valid(s) || s->value >= MAXSEMVAL)
+		return;
+	s->value++;
+	sched_wakeone(&s->event);
+}
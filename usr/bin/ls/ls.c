@@ -232,7 +232,18 @@ do_ls(char *path)
 				strlcat(buf, "/", sizeof(buf));
 				strlcat(buf, entry->d_name, sizeof(buf));
 			}
-			if (stat(buf, &st) == -1)
+			/*
+			 * The entry type is enough unless the size or
+			 * the mode bits are printed.  The file system
+			 * may give them as hints in the entry too.
+			 */
+			if (entry->d_type != DT_UNKNOWN &&
+			    (!(ls_flags & (LSF_LONG | LSF_TYPE)) ||
+			     entry->d_mode != 0)) {
+				st.st_mode = DTTOIF(entry->d_type) |
+				    entry->d_mode;
+				st.st_size = entry->d_size;
+			} else if (stat(buf, &st) == -1)
 				continue;
 			print_entry(entry->d_name, &st);
 			nr_file++;
@@ -28,7 +28,9 @@
  */
 
 #include <sys/stat.h>
+#include <sys/fcntl.h>
 
+#include <unistd.h>
 #include <errno.h>
 #include <err.h>
 #include <string.h>
@@ -40,6 +42,8 @@
 #define main(argc, argv)	mv_main(argc, argv)
 #endif
 
+static int copy(char *src, char *dest, mode_t mode);
+
 int
 main(int argc, char *argv[])
 {
@@ -74,7 +78,40 @@ main(int argc, char *argv[])
 		strcat(path, p);
 		dest = path;
 	}
-	if (rename(src, dest) < 0)
+	if (rename(src, dest) == 0)
+		return 0;
+	if (errno != EXDEV)
 		err(1,"rename");
+
+	/* Different file systems. Copy the file, then remove it. */
+	if (copy(src, dest, st1.st_mode) != 0)
+		err(1, "%s", dest);
+	if (unlink(src) < 0)
+		err(1, "%s", src);
+	return 0;
+}
+
+static int
+copy(char *src, char *dest, mode_t mode)
+{
+	int fold, fnew, error;
+	ssize_t n;
+
+	if ((fold = open(src, O_RDONLY)) == -1)
+		return -1;
+	if ((fnew = open(dest, O_WRONLY|O_CREAT|O_TRUNC, mode)) == -1) {
+		close(fold);
+		return -1;
+	}
+	while ((n = copy_file_range(fold, NULL, fnew, NULL, SSIZE_MAX, 0)) > 0)
+		;
+	error = errno;
+	close(fold);
+	close(fnew);
+	if (n == -1) {
+		unlink(dest);
+		errno = error;
+		return -1;
+	}
 	return 0;
 }
@@ -49,8 +49,10 @@ typedef void *	DIR;
 
 struct _dirdesc {
 	int	fd;		/* file descriptor associated with directory */
-
-	struct dirent ent;
+	long	loc;		/* position of the next entry */
+	int	pos;		/* offset of the next entry in buf */
+	int	size;		/* amount of data in buf */
+	char	buf[DIRBLKSIZ];	/* entries from getdirentries() */
 };
 typedef struct _dirdesc DIR;
 
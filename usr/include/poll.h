@@ -0,0 +1,2 @@
+
+#include <sys/poll.h>
@@ -214,6 +214,7 @@ int	 putchar(int);
 int	 puts(const char *);
 int	 remove(const char *);
 int	 rename (const char *, const char *);
+int	 renameat (int, const char *, int, const char *);
 void	 rewind(FILE *);
 int	 scanf(const char *, ...);
 void	 setbuf(FILE *, char *);
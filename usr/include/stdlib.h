@@ -88,6 +88,7 @@ long	 labs(long);
 ldiv_t	 ldiv(long, long);
 void	 mstat(void);
 void	 mchk(void);
+void	 malloc_stats(void);
 void	*malloc(size_t);
 void	 qsort(void *, size_t, size_t,
 	    int (*)(const void *, const void *));
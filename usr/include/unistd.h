@@ -54,6 +54,7 @@ int	 chdir(const char *);
 int	 chown(const char *, uid_t, gid_t);
 int	 close(int);
 size_t	 confstr(int, char *, size_t);
+ssize_t	 copy_file_range(int, off_t *, int, off_t *, size_t, unsigned int);
 int	 dup(int);
 int	 dup2(int, int);
 int	 execl(const char *, const char *, ...);
@@ -82,8 +83,11 @@ off_t	 lseek(int, off_t, int);
 long	 pathconf(const char *, int);
 int	 pause(void);
 int	 pipe(int *);
+ssize_t	 pread(int, void *, size_t, off_t);
+ssize_t	 pwrite(int, const void *, size_t, off_t);
 ssize_t	 read(int, void *, size_t);
 int	 rmdir(const char *);
+ssize_t	 sendfile(int, int, off_t *, size_t);
 int	 setgid(gid_t);
 int	 setpgid(pid_t, pid_t);
 pid_t	 setsid(void);
@@ -94,6 +98,7 @@ pid_t	 tcgetpgrp(int);
 int	 tcsetpgrp(int, pid_t);
 char	*ttyname(int);
 int	 unlink(const char *);
+int	 unlinkat(int, const char *, int);
 ssize_t	 write(int, const void *, size_t);
 
 int	 getopt(int, char * const [], const char *);
@@ -37,15 +37,6 @@ bcmp(b1, b2, length)
 	const void *b1, *b2;
 	size_t length;
 {
-	char *p1, *p2;
 
-	if (length == 0)
-		return(0);
-	p1 = (char *)b1;
-	p2 = (char *)b2;
-	do
-		if (*p1++ != *p2++)
-			break;
-	while (--length);
-	return((int)length);
+	return(memcmp(b1, b2, length));
 }
@@ -32,11 +32,15 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 /*
  * Copy a block of memory, handling overlap.
  * This is the routine that actually implements
  * (the portable versions of) bcopy, memcpy, and memmove.
+ *
+ * When source and destination share the same word alignment,
+ * the bulk of the block is moved one word at a time.
  */
 #ifdef MEMCOPY
 void *
@@ -56,21 +60,47 @@ bcopy(src0, dst0, length)
 {
 	char *dst = dst0;
 	const char *src = src0;
+	size_t t;
 
 	if (length == 0 || dst == src)		/* nothing to do */
 		goto done;
 
-	if (((unsigned long)dst < (unsigned long)src) &&
-	    ((unsigned long)dst < (unsigned long)src + length)) {
+	if ((unsigned long)dst < (unsigned long)src ||
+	    (unsigned long)dst >= (unsigned long)src + length) {
+		/* Copy forwards. */
+		if (length >= WSIZE && COALIGNED(dst, src)) {
+			while (!ALIGNED(src)) {
+				*dst++ = *src++;
+				length--;
+			}
+			for (t = length / WSIZE; t != 0; t--) {
+				*(word_t *)dst = *(const word_t *)src;
+				dst += WSIZE;
+				src += WSIZE;
+			}
+			length &= WMASK;
+		}
+		while (length--) {
+			*dst++ = *src++;
+		}
+	} else {
 		/* Copy backwards. */
 		src += length;
 		dst += length;
-		while (length--) {
-			*--dst = *--src;
+		if (length >= WSIZE && COALIGNED(dst, src)) {
+			while (!ALIGNED(src)) {
+				*--dst = *--src;
+				length--;
+			}
+			for (t = length / WSIZE; t != 0; t--) {
+				dst -= WSIZE;
+				src -= WSIZE;
+				*(word_t *)dst = *(const word_t *)src;
+			}
+			length &= WMASK;
 		}
-	} else {
 		while (length--) {
-			*dst++ = *src++;
+			*--dst = *--src;
 		}
 	}
 done:
@@ -30,6 +30,7 @@
 #include <sys/cdefs.h>
 #include <string.h>
 #include <stddef.h>
+#include "local.h"
 
 char *
 #ifdef STRCHR
@@ -39,7 +40,25 @@ index(p, ch)
 #endif
 	const char *p, ch;
 {
-	for (;; ++p) {
+	const word_t *w;
+	word_t mask, x;
+
+	for (; !ALIGNED(p); ++p) {
+		if (*p == ch)
+			return((char *)p);
+		if (!*p)
+			return((char *)NULL);
+	}
+
+	/* Skip words which contain neither ch nor the terminator */
+	mask = REPEAT(ch);
+	for (w = (const word_t *)p;; w++) {
+		x = *w;
+		if (HASZERO(x) || HASZERO(x ^ mask))
+			break;
+	}
+
+	for (p = (const char *)w;; ++p) {
 		if (*p == ch)
 			return((char *)p);
 		if (!*p)
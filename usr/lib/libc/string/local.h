@@ -0,0 +1,63 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Information local to the string routines.
+ *
+ * The hot routines scan memory one machine word at a time.  All
+ * word accesses are aligned, so they never cross a page boundary
+ * and are safe on processors without unaligned load support (ARM).
+ * A word which may contain a byte of interest is re-examined one
+ * byte at a time, so the result does not depend on byte order.
+ */
+
+#ifndef _STRING_LOCAL_H_
+#define _STRING_LOCAL_H_
+
+#include <sys/types.h>
+
+typedef	unsigned long	word_t;
+
+#define	WSIZE		sizeof(word_t)
+#define	WMASK		(WSIZE - 1)
+
+/* 0x01010101 and 0x80808080 for a 32-bit word */
+#define	LOBITS		((word_t)~0UL / 0xff)
+#define	HIBITS		(LOBITS << 7)
+
+/* Non-zero if any byte of x is zero */
+#define	HASZERO(x)	(((x) - LOBITS) & ~(x) & HIBITS)
+
+/* Word with every byte set to c */
+#define	REPEAT(c)	(LOBITS * (unsigned char)(c))
+
+#define	ALIGNED(p)	(((unsigned long)(p) & WMASK) == 0)
+#define	COALIGNED(p, q)	((((unsigned long)(p) ^ (unsigned long)(q)) & WMASK) == 0)
+
+#endif /* !_STRING_LOCAL_H_ */
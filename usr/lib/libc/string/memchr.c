@@ -32,6 +32,7 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 void *
 memchr(s, c, n)
@@ -39,13 +40,26 @@ memchr(s, c, n)
 	unsigned char c;
 	size_t n;
 {
-	if (n != 0) {
-		const unsigned char *p = s;
+	const unsigned char *p = s;
+	const word_t *w;
+	word_t mask;
 
-		do {
-			if (*p++ == c)
-				return ((void *)(p - 1));
-		} while (--n != 0);
+	for (; n != 0 && !ALIGNED(p); n--, p++)
+		if (*p == c)
+			return ((void *)p);
+
+	if (n >= WSIZE) {
+		mask = REPEAT(c);
+		w = (const word_t *)p;
+		while (n >= WSIZE && !HASZERO(*w ^ mask)) {
+			w++;
+			n -= WSIZE;
+		}
+		p = (const unsigned char *)w;
 	}
+
+	for (; n != 0; n--, p++)
+		if (*p == c)
+			return ((void *)p);
 	return (NULL);
 }
@@ -32,6 +32,7 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 /*
  * Compare memory regions.
@@ -41,13 +42,31 @@ memcmp(s1, s2, n)
 	const void *s1, *s2;
 	size_t n;
 {
-	if (n != 0) {
-		const unsigned char *p1 = s1, *p2 = s2;
+	const unsigned char *p1 = s1, *p2 = s2;
+	const word_t *w1, *w2;
 
-		do {
-			if (*p1++ != *p2++)
-				return (*--p1 - *--p2);
-		} while (--n != 0);
+	if (n >= WSIZE && COALIGNED(p1, p2)) {
+		for (; !ALIGNED(p1); n--) {
+			if (*p1 != *p2)
+				return (*p1 - *p2);
+			p1++;
+			p2++;
+		}
+		w1 = (const word_t *)p1;
+		w2 = (const word_t *)p2;
+		while (n >= WSIZE && *w1 == *w2) {
+			w1++;
+			w2++;
+			n -= WSIZE;
+		}
+		p1 = (const unsigned char *)w1;
+		p2 = (const unsigned char *)w2;
+	}
+	for (; n != 0; n--) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
+		p1++;
+		p2++;
 	}
 	return (0);
 }
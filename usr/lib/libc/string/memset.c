@@ -34,6 +34,7 @@
 
 #include <limits.h>
 #include <string.h>
+#include "local.h"
 
 #ifdef BZERO
 #define	RETURN	return
@@ -55,7 +56,21 @@ memset(dst0, c0, length)
 #endif
 {
 	char *dst = dst0;
+	word_t fill;
+	size_t t;
 
+	if (length >= WSIZE) {
+		while (!ALIGNED(dst)) {
+			*dst++ = (char)VAL;
+			length--;
+		}
+		fill = REPEAT(VAL);
+		for (t = length / WSIZE; t != 0; t--) {
+			*(word_t *)dst = fill;
+			dst += WSIZE;
+		}
+		length &= WMASK;
+	}
 	while (length--) {
 		*dst++ = (char)VAL;
 	}
@@ -32,6 +32,7 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 /*
  * Compare strings.
@@ -40,8 +41,30 @@ int
 strcmp(s1, s2)
 	const char *s1, *s2;
 {
-	while (*s1 == *s2++)
-		if (*s1++ == 0)
+	const word_t *w1, *w2;
+
+	if (COALIGNED(s1, s2)) {
+		for (; !ALIGNED(s1); s1++, s2++) {
+			if (*s1 != *s2)
+				goto out;
+			if (*s1 == '\0')
+				return (0);
+		}
+		w1 = (const word_t *)s1;
+		w2 = (const word_t *)s2;
+		while (*w1 == *w2 && !HASZERO(*w1)) {
+			w1++;
+			w2++;
+		}
+		s1 = (const char *)w1;
+		s2 = (const char *)w2;
+	}
+	while (*s1 == *s2) {
+		if (*s1 == '\0')
 			return (0);
-	return (*(const unsigned char *)s1 - *(const unsigned char *)--s2);
+		s1++;
+		s2++;
+	}
+ out:
+	return (*(const unsigned char *)s1 - *(const unsigned char *)s2);
 }
@@ -35,8 +35,6 @@ strcpy(to, from)
 	char *to;
 	const char *from;
 {
-	char *save = to;
 
-	for (; (*to = *from) != '\0'; ++from, ++to);
-	return(save);
+	return(memcpy(to, from, strlen(from) + 1));
 }
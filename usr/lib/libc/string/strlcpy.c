@@ -27,25 +27,14 @@
 size_t
 strlcpy(char *dst, const char *src, size_t siz)
 {
-	char *d = dst;
-	const char *s = src;
-	size_t n = siz;
+	size_t len, n;
 
-	/* Copy as many bytes as will fit */
-	if (n != 0 && --n != 0) {
-		do {
-			if ((*d++ = *s++) == 0)
-				break;
-		} while (--n != 0);
+	len = strlen(src);
+	if (siz != 0) {
+		/* Copy as many bytes as will fit, then NUL-terminate */
+		n = (len < siz) ? len : siz - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
 	}
-
-	/* Not enough room in dst, add NUL and traverse rest of src */
-	if (n == 0) {
-		if (siz != 0)
-			*d = '\0';		/* NUL-terminate dst */
-		while (*s++)
-			;
-	}
-
-	return(s - src - 1);	/* count does not include NUL */
+	return(len);	/* count does not include NUL */
 }
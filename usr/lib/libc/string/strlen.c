@@ -29,14 +29,21 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 size_t
 strlen(str)
 	const char *str;
 {
 	const char *s;
+	const word_t *w;
 
-	for (s = str; *s; ++s);
+	for (s = str; !ALIGNED(s); ++s)
+		if (*s == '\0')
+			return(s - str);
+
+	for (w = (const word_t *)s; !HASZERO(*w); w++);
+
+	for (s = (const char *)w; *s; ++s);
 	return(s - str);
 }
-
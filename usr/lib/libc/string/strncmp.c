@@ -29,20 +29,47 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 int
 strncmp(s1, s2, n)
 	const char *s1, *s2;
 	size_t n;
 {
+	const word_t *w1, *w2;
 
 	if (n == 0)
 		return (0);
+	if (COALIGNED(s1, s2)) {
+		for (; !ALIGNED(s1); s1++, s2++) {
+			if (*s1 != *s2)
+				goto out;
+			if (*s1 == '\0' || --n == 0)
+				return (0);
+		}
+		w1 = (const word_t *)s1;
+		w2 = (const word_t *)s2;
+		while (n >= WSIZE && *w1 == *w2) {
+			if (HASZERO(*w1))
+				return (0);
+			w1++;
+			w2++;
+			n -= WSIZE;
+		}
+		if (n == 0)
+			return (0);
+		s1 = (const char *)w1;
+		s2 = (const char *)w2;
+	}
 	do {
-		if (*s1 != *s2++)
-			return (*(unsigned char *)s1 - *(unsigned char *)--s2);
-		if (*s1++ == 0)
+		if (*s1 != *s2)
+			goto out;
+		if (*s1 == '\0')
 			break;
+		s1++;
+		s2++;
 	} while (--n != 0);
 	return (0);
+ out:
+	return (*(const unsigned char *)s1 - *(const unsigned char *)s2);
 }
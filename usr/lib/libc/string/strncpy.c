@@ -32,6 +32,7 @@
 
 #include <sys/cdefs.h>
 #include <string.h>
+#include "local.h"
 
 /*
  * Copy src to dst, truncating or null-padding to always copy n bytes.
@@ -43,18 +44,33 @@ strncpy(dst, src, n)
 	const char *src;
 	size_t n;
 {
-	if (n != 0) {
-		char *d = dst;
-		const char *s = src;
+	char *d = dst;
+	const char *s = src;
+	word_t *wd;
+	const word_t *ws;
 
-		do {
-			if ((*d++ = *s++) == 0) {
-				/* NUL pad the remaining n-1 bytes */
-				while (--n != 0)
-					*d++ = 0;
-				break;
-			}
-		} while (--n != 0);
+	if (n >= WSIZE && COALIGNED(d, s)) {
+		for (; !ALIGNED(s); n--) {
+			if ((*d++ = *s++) == 0)
+				goto pad;
+		}
+		wd = (word_t *)d;
+		ws = (const word_t *)s;
+		while (n >= WSIZE && !HASZERO(*ws)) {
+			*wd++ = *ws++;
+			n -= WSIZE;
+		}
+		d = (char *)wd;
+		s = (const char *)ws;
 	}
+	for (; n != 0; n--) {
+		if ((*d++ = *s++) == 0)
+			goto pad;
+	}
+	return (dst);
+ pad:
+	/* NUL pad the remaining n-1 bytes */
+	if (--n != 0)
+		memset(d, 0, n);
 	return (dst);
 }
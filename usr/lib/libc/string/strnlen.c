@@ -32,11 +32,10 @@
 
 size_t strnlen(const char* str, const size_t str_sz)
 {
-	size_t i;
+	const char *p;
 
-	for (i = 0; i < str_sz; ++i)
-		if (!str[i])
-			return i;
-
-	return str_sz;
+	p = memchr(str, '\0', str_sz);
+	if (p == NULL)
+		return str_sz;
+	return p - str;
 }
@@ -0,0 +1,219 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Direct device I/O for character devices.
+ *
+ * When a task with CAP_DEVIO opens a character device, the file
+ * system server returns the device name in the open reply.  We open
+ * the device here as well, and read(), write() and ioctl() on that
+ * descriptor go straight to the driver instead of through the file
+ * system server.  The VFS descriptor stays open, so every other
+ * call still works.
+ */
+
+#include <prex/prex.h>
+#include <prex/posix.h>
+#include <sys/fcntl.h>
+
+#include <limits.h>
+#include <stdlib.h>
+
+struct devfd {
+	device_t	dev;		/* device handle */
+	int		flags;		/* FREAD/FWRITE */
+	int		refcnt;		/* descriptors sharing this */
+};
+
+/*
+ * The table and the records are changed under devfd_lock.
+ * __devfd_get() copies the device handle out under the lock,
+ * so a record is never used after another thread frees it.
+ */
+static struct devfd **devfd_table;
+
+#ifdef _REENTRANT
+static mutex_t devfd_lock = MUTEX_INITIALIZER;
+#define DEVFD_LOCK()	mutex_lock(&devfd_lock)
+#define DEVFD_UNLOCK()	mutex_unlock(&devfd_lock)
+#else
+#define DEVFD_LOCK()	do {} while (0)
+#define DEVFD_UNLOCK()	do {} while (0)
+#endif
+
+/*
+ * Set in the child of vfork().  The child shares our memory but
+ * not our device handles, so it must use the file system server.
+ */
+int __devfd_off;
+
+/*
+ * Return the device for fd, or NULL if fd does not refer to
+ * a device opened for direct I/O.
+ */
+device_t
+__devfd_get(int fd, int flags)
+{
+	struct devfd *df;
+	device_t dev = DEVICE_NULL;
+
+	if (devfd_table == NULL || __devfd_off)
+		return DEVICE_NULL;
+	if (fd < 0 || fd >= OPEN_MAX)
+		return DEVICE_NULL;
+	DEVFD_LOCK();
+	df = devfd_table[fd];
+	if (df != NULL && (df->flags & flags) == flags)
+		dev = df->dev;
+	DEVFD_UNLOCK();
+	return dev;
+}
+
+/*
+ * Remove the record of fd from the table.  Returns the device
+ * to close if this was the last descriptor using it.
+ * Must be called with devfd_lock held.
+ */
+static device_t
+devfd_remove(int fd)
+{
+	struct devfd *df;
+	device_t dev = DEVICE_NULL;
+
+	if ((df = devfd_table[fd]) == NULL)
+		return DEVICE_NULL;
+	devfd_table[fd] = NULL;
+	if (--df->refcnt == 0) {
+		dev = df->dev;
+		free(df);
+	}
+	return dev;
+}
+
+/*
+ * Open the device name for fd.  Failure is not an error; the
+ * descriptor just keeps using the file system server.
+ */
+void
+__devfd_open(int fd, const char *name, int flags)
+{
+	struct devfd *df;
+	device_t dev;
+
+	if (__devfd_off || fd < 0 || fd >= OPEN_MAX)
+		return;
+	if ((df = malloc(sizeof(*df))) == NULL)
+		return;
+	if (device_open(name, flags & (FREAD | FWRITE), &df->dev) != 0) {
+		free(df);
+		return;
+	}
+	df->flags = flags & (FREAD | FWRITE);
+	df->refcnt = 1;
+
+	DEVFD_LOCK();
+	if (devfd_table == NULL)
+		devfd_table = calloc(OPEN_MAX, sizeof(struct devfd *));
+	if (devfd_table == NULL) {
+		DEVFD_UNLOCK();
+		device_close(df->dev);
+		free(df);
+		return;
+	}
+	dev = devfd_remove(fd);
+	devfd_table[fd] = df;
+	DEVFD_UNLOCK();
+	if (dev != DEVICE_NULL)
+		device_close(dev);
+}
+
+void
+__devfd_close(int fd)
+{
+	device_t dev;
+
+	if (devfd_table == NULL || __devfd_off)
+		return;
+	if (fd < 0 || fd >= OPEN_MAX)
+		return;
+	DEVFD_LOCK();
+	dev = devfd_remove(fd);
+	DEVFD_UNLOCK();
+	if (dev != DEVICE_NULL)
+		device_close(dev);
+}
+
+/*
+ * newfd is now a duplicate of oldfd.
+ */
+void
+__devfd_dup(int oldfd, int newfd)
+{
+	struct devfd *df;
+	device_t dev;
+
+	if (devfd_table == NULL || __devfd_off)
+		return;
+	if (oldfd < 0 || oldfd >= OPEN_MAX || newfd < 0 || newfd >= OPEN_MAX)
+		return;
+	DEVFD_LOCK();
+	dev = devfd_remove(newfd);
+	if ((df = devfd_table[oldfd]) != NULL) {
+		df->refcnt++;
+		devfd_table[newfd] = df;
+	}
+	DEVFD_UNLOCK();
+	if (dev != DEVICE_NULL)
+		device_close(dev);
+}
+
+/*
+ * Called in the child of fork().  Device handles are not
+ * inherited, so drop our copy of the table.  Another thread of
+ * the parent may have held the lock, so it is created again.
+ */
+void
+__devfd_fork(void)
+{
+	struct devfd *df;
+	int fd;
+
+#ifdef _REENTRANT
+	devfd_lock = MUTEX_INITIALIZER;
+#endif
+	if (devfd_table == NULL)
+		return;
+	for (fd = 0; fd < OPEN_MAX; fd++) {
+		if ((df = devfd_table[fd]) == NULL)
+			continue;
+		devfd_table[fd] = NULL;
+		if (--df->refcnt == 0)
+			free(df);
+	}
+}
@@ -37,6 +37,8 @@ close(int fd)
 {
 	struct msg m;
 
+	__devfd_close(fd);
+
 	m.hdr.code = FS_CLOSE;
 	m.data[0] = fd;
 	return __posix_call(__fs_obj, &m, sizeof(m), 1);
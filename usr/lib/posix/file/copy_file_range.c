@@ -0,0 +1,66 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <prex/prex.h>
+#include <prex/posix.h>
+#include <server/fs.h>
+
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * Copy data between two files without passing it through the
+ * caller.  If inoff or outoff is NULL, the file offset of that
+ * descriptor is used and advanced.  Otherwise the copy starts
+ * at *off, which is advanced by the number of bytes copied.
+ */
+ssize_t
+copy_file_range(int infd, off_t *inoff, int outfd, off_t *outoff,
+		size_t len, unsigned int flags)
+{
+	struct copy_msg m;
+
+	if (flags != 0 || (inoff && *inoff < 0) || (outoff && *outoff < 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	m.hdr.code = FS_COPY;
+	m.infd = infd;
+	m.inoff = inoff ? *inoff : -1;
+	m.outfd = outfd;
+	m.outoff = outoff ? *outoff : -1;
+	m.size = len;
+	if (__posix_call(__fs_obj, &m, sizeof(m), 0) != 0)
+		return -1;
+	if (inoff)
+		*inoff += m.size;
+	if (outoff)
+		*outoff += m.size;
+	return (ssize_t)m.size;
+}
@@ -44,5 +44,7 @@ dup2(int oldfd, int newfd)
 	m.data[1] = newfd;
 	if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0)
 		return -1;
+	if (oldfd != newfd)
+		__devfd_dup(oldfd, newfd);
 	return m.data[0];
 }
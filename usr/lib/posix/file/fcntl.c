@@ -56,5 +56,7 @@ fcntl(int fd, int cmd, ...)
 
 	if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0)
 		return -1;
+	if (cmd == F_DUPFD)
+		__devfd_dup(fd, m.arg);
 	return m.arg;
 }
@@ -44,6 +44,7 @@ ioctl(int fd, unsigned long request, ...)
 	va_list args;
 	size_t size;
 	struct stat st;
+	device_t dev;
 
 	va_start(args, request);
 	argp = va_arg(args, char *);
@@ -55,6 +56,12 @@ ioctl(int fd, unsigned long request, ...)
 		return -1;
 	}
 
+	if ((dev = __devfd_get(fd, 0)) != DEVICE_NULL) {
+		if ((errno = device_ioctl(dev, request, argp)) != 0)
+			return -1;
+		return 0;
+	}
+
 	if (fstat(fd, &st) == -1)
 		return -1;
 
@@ -53,5 +53,7 @@ open(const char *path, int flags, ...)
 	strlcpy(m.path, (char *)path, PATH_MAX);
 	if (__posix_call(__fs_obj, &m, sizeof(m), 0) != 0)
 		return -1;
+	if (m.path[0] != '\0')
+		__devfd_open(m.fd, m.path, m.flags);
 	return m.fd;
 }
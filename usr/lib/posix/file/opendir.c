@@ -51,5 +51,8 @@ opendir(const char *name)
 	if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0)
 		return NULL;
 	dir->fd = m.fd;
+	dir->loc = 0;
+	dir->pos = 0;
+	dir->size = 0;
 	return dir;
 }
@@ -0,0 +1,102 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <prex/prex.h>
+#include <prex/posix.h>
+#include <server/fs.h>
+
+#include <poll.h>
+#include <errno.h>
+
+/*
+ * Wait for events on a set of file descriptors.
+ *
+ * The file system server checks the descriptors, and leaves
+ * our semaphore on the files that are not ready.  We sleep on
+ * the semaphore rather than in the server, and poll again when
+ * it is posted.
+ */
+int
+poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	struct poll_msg m;
+	sem_t sem = SEM_NULL;
+	u_long start, now, elapsed, wait;
+	int err, rc;
+
+	if (timeout != 0 && sem_init(&sem, 0) != 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	sys_time(&start);
+	for (;;) {
+		m.hdr.code = FS_POLL;
+		m.fds = fds;
+		m.nfds = nfds;
+		m.sem = sem;
+		if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0) {
+			rc = -1;
+			break;
+		}
+		rc = m.count;
+		if (rc > 0 || timeout == 0)
+			break;
+
+		wait = 0;		/* no timeout */
+		if (timeout > 0) {
+			sys_time(&now);
+			elapsed = (now - start) * 1000 / CONFIG_HZ;
+			if (elapsed >= (u_long)timeout)
+				break;
+			wait = (u_long)timeout - elapsed;
+		}
+		err = sem_wait(&sem, wait);
+		if (err != 0 && err != ETIMEDOUT) {
+			errno = err;
+			rc = -1;
+			break;
+		}
+	}
+	if (sem != SEM_NULL) {
+		/*
+		 * Remove the waiters left in the server.  They
+		 * are already gone if something was ready.
+		 */
+		if (rc <= 0) {
+			m.hdr.code = FS_POLL;
+			m.nfds = 0;
+			m.sem = sem;
+			err = errno;
+			__posix_call(__fs_obj, &m, sizeof(m), 1);
+			errno = err;
+		}
+		sem_destroy(&sem);
+	}
+	return rc;
+}
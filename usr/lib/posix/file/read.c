@@ -30,6 +30,7 @@
 #include <prex/prex.h>
 #include <prex/posix.h>
 #include <server/fs.h>
+#include <sys/fcntl.h>
 
 #include <stddef.h>
 #include <errno.h>
@@ -38,6 +39,13 @@ int
 read(int fd, void *buf, size_t len)
 {
 	struct io_msg m;
+	device_t dev;
+
+	if ((dev = __devfd_get(fd, FREAD)) != DEVICE_NULL) {
+		if ((errno = device_read(dev, buf, &len, 0)) != 0)
+			return -1;
+		return (int)len;
+	}
 
 	m.hdr.code = FS_READ;
 	m.fd = fd;
@@ -28,24 +28,30 @@
  */
 
 #include <prex/prex.h>
-#include <prex/posix.h>
-#include <server/fs.h>
 
-#include <stddef.h>
 #include <dirent.h>
-#include <string.h>
-#include <errno.h>
 
+/*
+ * Entries are fetched from the server a buffer at a time and
+ * handed out from the buffer in the DIR.
+ */
 struct dirent *
 readdir(DIR *dir)
 {
-	struct dir_msg m;
-	struct dirent *entry = &dir->ent;
+	struct dirent *entry;
+	long base;
+	int n;
 
-	m.hdr.code = FS_READDIR;
-	m.fd = dir->fd;
-	if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0)
-		return NULL;
-	memcpy(entry, &m.dirent, sizeof(struct dirent));
-	return &dir->ent;
+	if (dir->pos >= dir->size) {
+		n = getdirentries(dir->fd, dir->buf, DIRBLKSIZ, &base);
+		if (n <= 0)
+			return NULL;
+		dir->loc = base;
+		dir->pos = 0;
+		dir->size = n;
+	}
+	entry = (struct dirent *)&dir->buf[dir->pos];
+	dir->pos += entry->d_reclen;
+	dir->loc++;
+	return entry;
 }
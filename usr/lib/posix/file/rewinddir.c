@@ -43,6 +43,9 @@ rewinddir(DIR *dir)
 	m.hdr.code = FS_REWINDDIR;
 	m.data[0] = dir->fd;
 	__posix_call(__fs_obj, &m, sizeof(m), 1);
+	dir->loc = 0;
+	dir->pos = 0;
+	dir->size = 0;
 
 	/*
 	 * XXX: rewinddir() does not return error. But, we may get error...
@@ -0,0 +1,113 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * select() is implemented with poll().
+ */
+int
+select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+       struct timeval *timeout)
+{
+	struct pollfd pfd[FD_SETSIZE];
+	int fd, i, n, rc, msec, events;
+
+	if (nfds < 0 || nfds > FD_SETSIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	n = 0;
+	for (fd = 0; fd < nfds; fd++) {
+		events = 0;
+		if (readfds != NULL && FD_ISSET(fd, readfds))
+			events |= POLLIN;
+		if (writefds != NULL && FD_ISSET(fd, writefds))
+			events |= POLLOUT;
+		if (exceptfds != NULL && FD_ISSET(fd, exceptfds))
+			events |= POLLPRI;
+		if (events != 0) {
+			pfd[n].fd = fd;
+			pfd[n].events = (short)events;
+			n++;
+		}
+	}
+
+	msec = INFTIM;
+	if (timeout != NULL) {
+		if (timeout->tv_sec < 0 || timeout->tv_usec < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		msec = (int)(timeout->tv_sec * 1000 +
+			     (timeout->tv_usec + 999) / 1000);
+	}
+
+	if ((rc = poll(pfd, (nfds_t)n, msec)) < 0)
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (pfd[i].revents & POLLNVAL) {
+			errno = EBADF;
+			return -1;
+		}
+	}
+
+	if (readfds != NULL)
+		FD_ZERO(readfds);
+	if (writefds != NULL)
+		FD_ZERO(writefds);
+	if (exceptfds != NULL)
+		FD_ZERO(exceptfds);
+	rc = 0;
+	for (i = 0; i < n; i++) {
+		fd = pfd[i].fd;
+		events = pfd[i].revents;
+		if ((pfd[i].events & POLLIN) &&
+		    (events & (POLLIN | POLLHUP | POLLERR))) {
+			FD_SET(fd, readfds);
+			rc++;
+		}
+		if ((pfd[i].events & POLLOUT) &&
+		    (events & (POLLOUT | POLLERR))) {
+			FD_SET(fd, writefds);
+			rc++;
+		}
+		if ((pfd[i].events & POLLPRI) && (events & POLLPRI)) {
+			FD_SET(fd, exceptfds);
+			rc++;
+		}
+	}
+	return rc;
+}
@@ -30,17 +30,26 @@
 #include <prex/prex.h>
 #include <prex/posix.h>
 #include <server/fs.h>
+#include <sys/fcntl.h>
 
 #include <stddef.h>
+#include <errno.h>
 
 int
 write(int fd, void *buf, size_t len)
 {
 	struct io_msg m;
+	device_t dev;
 
 	if (len == 0)
 		return 0;
 
+	if ((dev = __devfd_get(fd, FWRITE)) != DEVICE_NULL) {
+		if ((errno = device_write(dev, buf, &len, 0)) != 0)
+			return -1;
+		return (int)len;
+	}
+
 	m.hdr.code = FS_WRITE;
 	m.fd = fd;
 	m.buf = buf;
@@ -153,12 +153,16 @@ vfork(void)
 		thread_getprio(th, &prio);
 		thread_setprio(th, prio - 1);
 
+		/* Our device handles belong to the parent. */
+		__devfd_off = 1;
+
 #ifdef _REENTRANT
 		err = mutex_init(&__sig_lock);
 #endif
 		__sig_pending = 0;
 		return 0;
 	}
+	__devfd_off = 0;
 	return __child_pid;
 }
 
@@ -240,6 +244,7 @@ fork(void)
 		err = mutex_init(&__sig_lock);
 #endif
 		__sig_pending = 0;
+		__devfd_fork();
 		return 0;
 	}
 	return pid;
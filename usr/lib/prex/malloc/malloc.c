@@ -36,73 +36,367 @@
 #include <stdlib.h>
 #include "malloc.h"
 
+/*
+ * Size-class memory allocator.
+ *
+ * Small requests are rounded up to one of NCLASSES block sizes and
+ * served from spans, page runs obtained with vm_allocate() and cut
+ * into blocks of one size.  Each thread hashes to one of NCACHES
+ * caches which keep a short free list per class, so threads of a
+ * multi-threaded server rarely wait for each other.  A cache is
+ * refilled from, and drained back to, the spans in batches under
+ * malloc_lock.  A span whose blocks are all free is returned with
+ * vm_free() unless it is the last span of its class.  Requests
+ * larger than MAX_SMALL get a page run of their own.
+ *
+ * Allocation counts are always kept and reported by malloc_stats().
+ * With CONFIG_MPROF, malloc also profiles call sites, live and peak
+ * bytes, and the distribution of request sizes.
+ */
+
+struct cache {
+#ifdef _REENTRANT
+	mutex_t lock;
+#endif
+	struct header *free[NCLASSES];	/* cached free blocks */
+	int count[NCLASSES];		/* number of cached blocks */
+	u_long nalloc[NCLASSES];	/* allocations through this cache */
+	u_long nfree[NCLASSES];		/* frees through this cache */
+};
+
+struct bucket {
+	struct list spans;		/* spans having free blocks */
+	int nr_spans;			/* number of all spans */
+};
+
 #ifdef _REENTRANT
 static mutex_t malloc_lock = MUTEX_INITIALIZER;
+#define CACHE_LOCK(cp)		mutex_lock(&(cp)->lock)
+#define CACHE_UNLOCK(cp)	mutex_unlock(&(cp)->lock)
+#else
+#define CACHE_LOCK(cp)		do {} while (0)
+#define CACHE_UNLOCK(cp)	do {} while (0)
 #endif
 
-static struct header *more_core(size_t size);
+static const size_t class_size[NCLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512,
+	640, 768, 896, 1024, 1280, 1536, 1792, 2048
+};
 
-static struct header free_list;		/* start of free list */
-static struct header *scan_head;	/* start point to scan */
+static struct cache caches[NCACHES];
+static struct bucket buckets[NCLASSES];
+static int malloc_inited;
+static u_long large_nalloc;		/* number of large allocations */
+static u_long large_nfree;		/* number of large frees */
+static size_t large_bytes;		/* bytes in large blocks */
 #ifdef CONFIG_MCHECK
 static struct header malloc_list;		/* start of malloc list */
 #endif	/* CONFIG_MCHECK */
 
+#ifdef CONFIG_MPROF
 /*
- * Simple memory allocator from K&R
+ * Allocation profile.  Call sites are kept in a small open hash
+ * table.  Once it is full, other sites share the last slot.
  */
-void *
-malloc(size_t size)
-{
-	struct header *p, *prev;
+struct msite {
+	void *caller;		/* return address of the call to malloc */
+	u_long allocs;		/* number of allocations */
+	u_long frees;		/* number of frees */
+	size_t live;		/* bytes allocated now */
+	size_t peak;		/* maximum of live */
+};
 
-	if (size == 0)		/* sanity check */
-		return NULL;
-	size = ROUNDUP(size + sizeof(struct header));
+#define MPROF_SITES	64		/* size of call site table */
+#define MPROF_HIST	16		/* buckets of size histogram */
 
-	MALLOC_LOCK();
+static struct msite msites[MPROF_SITES];
+static u_long mhist[MPROF_HIST];	/* requests by log2 of size */
+static size_t mlive;			/* bytes allocated now */
+static size_t mpeak;			/* maximum of mlive */
+#endif	/* CONFIG_MPROF */
+
+#define CACHE_BATCH(c)	MAX(2, CACHE_BYTES / (int)class_size[c])
+#define CACHE_LIMIT(c)	(CACHE_BATCH(c) * 2)
+#define SPAN_SIZE(c)	PAGE_ALIGN(SPAN_HDRSIZE + SPAN_MINBLKS * class_size[c])
 
-	if (scan_head == NULL) {
-		/* Initialize */
-		free_list.next = &free_list;
-		free_list.size = 0;
-		free_list.vm_size = 0;
-		HDR_MAGIC_SET(&free_list);
-		scan_head = &free_list;
+static void
+malloc_init(void)
+{
+	int i;
+
+	MALLOC_LOCK();
+	if (!malloc_inited) {
+		for (i = 0; i < NCLASSES; i++)
+			list_init(&buckets[i].spans);
+#ifdef _REENTRANT
+		for (i = 0; i < NCACHES; i++)
+			caches[i].lock = MUTEX_INITIALIZER;
+#endif
 #ifdef CONFIG_MCHECK
 		malloc_list.next = &malloc_list;
 		malloc_list.size = 0;
-		malloc_list.vm_size = 0;
+		malloc_list.span = NULL;
 		HDR_MAGIC_SET(&malloc_list);
 		MALLOC_MAGIC_SET(&malloc_list);
 #endif	/* CONFIG_MCHECK */
+		malloc_inited = 1;
 	}
-	prev = scan_head;
-	for (p = prev->next;; prev = p, p = p->next) {
-		HDR_MAGIC_ASSERT(p, "malloc: corrupt free list");
-		if (p->size >= size) {	/* big enough */
-			if (p->size == size)	/* exactly */
-				prev->next = p->next;
-			else {			/* allocate tail end */
-				p->size -= size;
-				p = (struct header *)((u_long)p + p->size);
-				p->size = size;
-				p->vm_size = 0;
-				HDR_MAGIC_SET(p);
-			}
-			MALLOC_MAGIC_SET(p);
-#ifdef CONFIG_MCHECK
-			p->retaddr_p = __builtin_return_address(0);
-#endif	/* CONFIG_MCHECK */
-			scan_head = prev;
-			break;
-		}
-		if (p == scan_head) {
-			if ((p = more_core(size)) == NULL)
+	MALLOC_UNLOCK();
+}
+
+/*
+ * Return the smallest class which holds a block of the
+ * specified size.  The size must be rounded up already.
+ */
+static int
+size_class(size_t size)
+{
+	int c;
+
+	if (size <= 128)
+		return (int)(size / ALIGN_SIZE) - 1;
+	for (c = 8; class_size[c] < size; c++)
+		;
+	return c;
+}
+
+/*
+ * Select the cache for the current thread.
+ */
+static struct cache *
+cache_get(void)
+{
+#ifdef _REENTRANT
+	u_long th = (u_long)thread_self();
+
+	return &caches[((th >> 4) ^ (th >> 10)) & (NCACHES - 1)];
+#else
+	return &caches[0];
+#endif
+}
+
+/*
+ * Allocate a new span for the class and cut it into blocks.
+ * Called with malloc_lock held.
+ */
+static struct span *
+span_create(int c)
+{
+	struct span *sp;
+	struct header *p;
+	size_t bsize, vm_size;
+	int i;
+
+	bsize = class_size[c];
+	vm_size = SPAN_SIZE(c);
+	if (vm_allocate(task_self(), (void *)&sp, vm_size, 1))
+		return NULL;
+
+	sp->class = c;
+	sp->vm_size = vm_size;
+	sp->nblocks = (int)((vm_size - SPAN_HDRSIZE) / bsize);
+	sp->nfree = sp->nblocks;
+	sp->free = NULL;
+	for (i = sp->nblocks - 1; i >= 0; i--) {
+		p = (struct header *)((u_long)sp + SPAN_HDRSIZE + i * bsize);
+		p->span = sp;
+		p->size = bsize;
+		HDR_MAGIC_SET(p);
+		MALLOC_MAGIC_CLR(p);
+		p->next = sp->free;
+		sp->free = p;
+	}
+	list_insert(&buckets[c].spans, &sp->link);
+	buckets[c].nr_spans++;
+	return sp;
+}
+
+/*
+ * Return a block to its span.  The span is released when all of
+ * its blocks are free and the class has another span.
+ * Called with malloc_lock held.
+ */
+static void
+span_put(struct header *p)
+{
+	struct span *sp = p->span;
+	struct bucket *b = &buckets[sp->class];
+
+	p->next = sp->free;
+	sp->free = p;
+	if (sp->nfree++ == 0)
+		list_insert(&b->spans, &sp->link);
+
+	if (sp->nfree == sp->nblocks && b->nr_spans > 1) {
+		list_remove(&sp->link);
+		b->nr_spans--;
+		vm_free(task_self(), sp);
+	}
+}
+
+/*
+ * Move a batch of blocks from the spans to the cache.
+ * Called with the cache locked.
+ */
+static struct header *
+cache_fill(struct cache *cp, int c)
+{
+	struct bucket *b = &buckets[c];
+	struct span *sp;
+	struct header *p;
+	int n;
+
+	MALLOC_LOCK();
+	for (n = CACHE_BATCH(c); n > 0; n--) {
+		if (list_empty(&b->spans)) {
+			if (span_create(c) == NULL)
 				break;
 		}
+		sp = list_entry(list_first(&b->spans), struct span, link);
+		p = sp->free;
+		HDR_MAGIC_ASSERT(p, "malloc: corrupt span");
+		sp->free = p->next;
+		if (--sp->nfree == 0)
+			list_remove(&sp->link);
+
+		p->next = cp->free[c];
+		cp->free[c] = p;
+		cp->count[c]++;
 	}
 	MALLOC_UNLOCK();
+	return cp->free[c];
+}
+
+/*
+ * Move a batch of blocks from the cache back to the spans.
+ * Called with the cache locked.
+ */
+static void
+cache_drain(struct cache *cp, int c)
+{
+	struct header *p;
+	int n;
+
+	MALLOC_LOCK();
+	for (n = CACHE_BATCH(c); n > 0; n--) {
+		p = cp->free[c];
+		cp->free[c] = p->next;
+		cp->count[c]--;
+		span_put(p);
+	}
+	MALLOC_UNLOCK();
+}
+
+#ifdef CONFIG_MPROF
+static struct msite *
+mprof_site(void *caller)
+{
+	struct msite *sp;
+	u_int i, n;
+
+	i = ((u_long)caller >> 2) % (MPROF_SITES - 1);
+	for (n = 0; n < MPROF_SITES - 1; n++) {
+		sp = &msites[i];
+		if (sp->caller == caller)
+			return sp;
+		if (sp->caller == NULL) {
+			sp->caller = caller;
+			return sp;
+		}
+		i = (i + 1) % (MPROF_SITES - 1);
+	}
+	return &msites[MPROF_SITES - 1];
+}
+
+/*
+ * Account an allocation.  Called with malloc_lock held.
+ */
+static void
+mprof_alloc(struct header *p, size_t size, void *caller)
+{
+	struct msite *sp;
+	int i;
+
+	sp = mprof_site(caller);
+	sp->allocs++;
+	sp->live += p->size;
+	if (sp->live > sp->peak)
+		sp->peak = sp->live;
+	p->site = sp;
+
+	mlive += p->size;
+	if (mlive > mpeak)
+		mpeak = mlive;
+
+	for (i = 0; (size >> i) > 1 && i < MPROF_HIST - 1; i++)
+		;
+	mhist[i]++;
+}
+
+/*
+ * Account a free.  Called with malloc_lock held.
+ */
+static void
+mprof_free(struct header *p)
+{
+	struct msite *sp = p->site;
+
+	sp->frees++;
+	sp->live -= p->size;
+	mlive -= p->size;
+}
+#endif	/* CONFIG_MPROF */
+
+/*
+ * Allocate memory on behalf of caller.
+ */
+void *
+malloc_caller(size_t size, void *caller)
+{
+	struct header *p;
+	struct cache *cp;
+	size_t req = size;
+	int c;
+
+	if (size == 0)		/* sanity check */
+		return NULL;
+	if (size >= (size_t)-PAGE_SIZE) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (!malloc_inited)
+		malloc_init();
+
+	size = ROUNDUP(size + sizeof(struct header));
+	if (size > MAX_SMALL) {
+		/* Large block gets its own pages */
+		size = PAGE_ALIGN(size);
+		if (vm_allocate(task_self(), (void *)&p, size, 1))
+			p = NULL;
+		else {
+			p->span = NULL;
+			p->size = size;
+			HDR_MAGIC_SET(p);
+			MALLOC_LOCK();
+			large_nalloc++;
+			large_bytes += size;
+			MALLOC_UNLOCK();
+		}
+	} else {
+		c = size_class(size);
+		cp = cache_get();
+		CACHE_LOCK(cp);
+		if ((p = cp->free[c]) == NULL)
+			p = cache_fill(cp, c);
+		if (p != NULL) {
+			HDR_MAGIC_ASSERT(p, "malloc: corrupt free list");
+			cp->free[c] = p->next;
+			cp->count[c]--;
+			cp->nalloc[c]++;
+		}
+		CACHE_UNLOCK(cp);
+	}
 
 	if (p == NULL) {
 #ifdef CONFIG_MCHECK
@@ -111,57 +405,50 @@ malloc(size_t size)
 		errno = ENOMEM;
 		return NULL;
 	}
+	MALLOC_MAGIC_SET(p);
+#if defined(CONFIG_MCHECK) || defined(CONFIG_MPROF)
+	MALLOC_LOCK();
 #ifdef CONFIG_MCHECK
+	p->retaddr_p = caller;
 	p->next = malloc_list.next;
 	malloc_list.next = p;
 #endif
+#ifdef CONFIG_MPROF
+	mprof_alloc(p, req, caller);
+#endif
+	MALLOC_UNLOCK();
+#endif
+	(void)req;
+	(void)caller;
 	return (void *)(p + 1);
 }
 
-/*
- * Create new block and insert it to the free list.
- */
-static struct header *more_core(size_t size)
+void *
+malloc(size_t size)
 {
-	struct header *p, *prev;
 
-	size = PAGE_ALIGN(size);
-	if (vm_allocate(task_self(), (void *)&p, size, 1))
-		return NULL;
-	p->size = size;
-	p->vm_size = size;
-	HDR_MAGIC_SET(p);
-
-	/* Insert to free list */
-	for (prev = scan_head; !(p > prev && p < prev->next); prev = prev->next) {
-		HDR_MAGIC_ASSERT(prev, "more_core: corrupt free list");
-		if (prev >= prev->next && (p > prev || p < prev->next))
-			break;
-	}
-	p->next = prev->next;
-	prev->next = p;
-	scan_head = prev;
-	return prev;
+	return malloc_caller(size, __builtin_return_address(0));
 }
 
 void
 free(void *addr)
 {
-	struct header *p, *prev;
+	struct header *p;
+	struct cache *cp;
+	int c;
 
 	if (addr == NULL)
 		return;
 
-	MALLOC_LOCK();
 	p = (struct header *)addr - 1;
 	HDR_MAGIC_ASSERT(p, "free: corrupt / invalid pointer");
 	MALLOC_MAGIC_ASSERT(p, "free: double free");
 	MALLOC_MAGIC_CLR(p);
-	for (prev = scan_head; !(p > prev && p < prev->next); prev = prev->next) {
-		HDR_MAGIC_ASSERT(prev, "free: corrupt free list");
-		if (prev >= prev->next && (p > prev || p < prev->next))
-			break;
-	}
+#if defined(CONFIG_MCHECK) || defined(CONFIG_MPROF)
+	MALLOC_LOCK();
+#ifdef CONFIG_MPROF
+	mprof_free(p);
+#endif
 #ifdef CONFIG_MCHECK
 	for (struct header *m = &malloc_list; ; m = m->next) {
 		HDR_MAGIC_ASSERT(m, "free: malloc_list hdr corrupt");
@@ -175,36 +462,85 @@ free(void *addr)
 		}
 	}
 #endif	/* CONFIG_MCHECK */
+	MALLOC_UNLOCK();
+#endif
 
-	if ((prev->next->vm_size == 0) &&	/* join to upper block */
-	    ((u_long)p + p->size == (u_long)prev->next)) {
-		p->size += prev->next->size;
-		p->next = prev->next->next;
-		HDR_MAGIC_CLR(prev->next);
-	} else {
-		p->next = prev->next;
-	}
-	if ((p->vm_size == 0) &&	/* join to lower block */
-	    ((u_long)prev + prev->size == (u_long)p)) {
-		prev->size += p->size;
-		prev->next = p->next;
+	if (p->span == NULL) {
+		/* Large block */
+		MALLOC_LOCK();
+		large_nfree++;
+		large_bytes -= p->size;
+		MALLOC_UNLOCK();
 		HDR_MAGIC_CLR(p);
-		if (prev->size == prev->vm_size) {
-			/* need to reset pointers to dealloc this pool */
-			p = prev;
-			for (prev = scan_head; ; prev = prev->next)
-				if (prev->next == p)
-					break;
+		vm_free(task_self(), p);
+		return;
+	}
+
+	c = p->span->class;
+	cp = cache_get();
+	CACHE_LOCK(cp);
+	p->next = cp->free[c];
+	cp->free[c] = p;
+	cp->nfree[c]++;
+	if (++cp->count[c] > CACHE_LIMIT(c))
+		cache_drain(cp, c);
+	CACHE_UNLOCK(cp);
+}
+
+/*
+ * Report allocation statistics to the system log.
+ */
+void
+malloc_stats(void)
+{
+	u_long nalloc, nfree;
+	size_t inuse = 0, mapped = 0;
+	int c, i;
+
+	syslog(LOG_INFO, "malloc_stats: task=%x\n", task_self());
+
+	if (!malloc_inited)
+		return;
+
+	MALLOC_LOCK();
+	syslog(LOG_INFO, " size   allocs    inuse spans\n");
+	for (c = 0; c < NCLASSES; c++) {
+		nalloc = nfree = 0;
+		for (i = 0; i < NCACHES; i++) {
+			nalloc += caches[i].nalloc[c];
+			nfree += caches[i].nfree[c];
 		}
-	} else {
-		prev->next = p;
+		if (nalloc == 0 && buckets[c].nr_spans == 0)
+			continue;
+		syslog(LOG_INFO, " %4d %8d %8d %5d\n", class_size[c],
+		       nalloc, nalloc - nfree, buckets[c].nr_spans);
+		inuse += (nalloc - nfree) * class_size[c];
+		mapped += buckets[c].nr_spans * SPAN_SIZE(c);
 	}
-	/* Deallocate pool */
-	if (p->size == p->vm_size) {
-		prev->next = p->next;
-		vm_free(task_self(), p);
+	syslog(LOG_INFO, " large %7d %8d\n", large_nalloc,
+	       large_nalloc - large_nfree);
+	inuse += large_bytes;
+	mapped += large_bytes;
+	syslog(LOG_INFO, "malloc_stats: inuse=%d mapped=%d\n", inuse, mapped);
+
+#ifdef CONFIG_MPROF
+	struct msite *sp;
+
+	syslog(LOG_INFO, "malloc_stats: live=%d peak=%d\n", mlive, mpeak);
+	syslog(LOG_INFO, " request size    count\n");
+	for (i = 0; i < MPROF_HIST; i++) {
+		if (mhist[i] != 0)
+			syslog(LOG_INFO, " < %10d %8d\n", 2 << i, mhist[i]);
 	}
-	scan_head = prev;
+	syslog(LOG_INFO, " caller     allocs    frees     live     peak\n");
+	for (i = 0; i < MPROF_SITES; i++) {
+		sp = &msites[i];
+		if (sp->allocs == 0)
+			continue;
+		syslog(LOG_INFO, " %08x %8d %8d %8d %8d\n", sp->caller,
+		       sp->allocs, sp->frees, sp->live, sp->peak);
+	}
+#endif	/* CONFIG_MPROF */
 	MALLOC_UNLOCK();
 }
 
@@ -212,19 +548,29 @@ free(void *addr)
 void
 mstat(void)
 {
+	struct span *sp;
 	struct header *p;
+	size_t free_total = 0;
+	int c, i, cached, spare;
 
 	syslog(LOG_INFO, "mstat: task=%x\n", task_self());
 
-	if (scan_head == NULL)
+	if (!malloc_inited)
 		return;
 
-	size_t free_total = 0;
-	for (p = free_list.next; p != &free_list; p = p->next) {
-		HDR_MAGIC_ASSERT(p, "mstat: free_list corrupt");
-		syslog(LOG_INFO, "mstat: free addr=%x size=%d next=%x\n",
-		       p, p->size, p->next);
-		free_total += p->size;
+	MALLOC_LOCK();
+	for (c = 0; c < NCLASSES; c++) {
+		if (buckets[c].nr_spans == 0)
+			continue;
+		spare = 0;
+		list_for_each_entry(sp, &buckets[c].spans, link)
+			spare += sp->nfree;
+		cached = 0;
+		for (i = 0; i < NCACHES; i++)
+			cached += caches[i].count[c];
+		syslog(LOG_INFO, "mstat: class=%d spans=%d free=%d cached=%d\n",
+		       class_size[c], buckets[c].nr_spans, spare, cached);
+		free_total += (spare + cached) * class_size[c];
 	}
 	syslog(LOG_INFO, "mstat: free total=%d\n", free_total);
 
@@ -237,7 +583,10 @@ mstat(void)
 		malloc_total += p->size;
 	}
 	syslog(LOG_INFO, "mstat: malloc total=%d\n", malloc_total);
+#else
+	(void)p;
 #endif	/* CONFIG_MCHECK */
+	MALLOC_UNLOCK();
 }
 #endif	/* CONFIG_MSTAT */
 
@@ -246,12 +595,27 @@ void
 mchk(void)
 {
 	struct header *p;
+	struct span *sp;
+	int c, i;
+
+	if (!malloc_inited)
+		return;
 
+	MALLOC_LOCK();
 	for (p = malloc_list.next; p != &malloc_list; p = p->next) {
 		HDR_MAGIC_ASSERT(p, "mchk: malloc_hdr corrupt");
 		MALLOC_MAGIC_ASSERT(p, "mchk: malloc_magic corrupt");
 	}
-	for (p = free_list.next; p != &free_list; p = p->next)
-		HDR_MAGIC_ASSERT(p, "mchk: free_hdr corrupt");
+	for (c = 0; c < NCLASSES; c++) {
+		list_for_each_entry(sp, &buckets[c].spans, link) {
+			for (p = sp->free; p != NULL; p = p->next)
+				HDR_MAGIC_ASSERT(p, "mchk: free_hdr corrupt");
+		}
+		for (i = 0; i < NCACHES; i++) {
+			for (p = caches[i].free[c]; p != NULL; p = p->next)
+				HDR_MAGIC_ASSERT(p, "mchk: cache_hdr corrupt");
+		}
+	}
+	MALLOC_UNLOCK();
 }
 #endif	/* CONFIG_MCHECK */
@@ -29,10 +29,12 @@
 
 #include <prex/prex.h>
 #include <sys/param.h>
+#include <sys/list.h>
 #include <verbose.h>
 
 /* #define CONFIG_MSTAT		1 */
 /* #define CONFIG_MCHECK	1 */
+/* #define CONFIG_MPROF		1 */
 
 #define MALLOC_MAGIC	(int)0xBAADF00D	/* "bad food" from LocalAlloc :) */
 #define HDR_MAGIC	(int)0xCAFEBEEF
@@ -77,15 +79,51 @@
 #define ALIGN_MASK      (ALIGN_SIZE - 1)
 #define ROUNDUP(size)   (((u_long)(size) + ALIGN_MASK) & ~ALIGN_MASK)
 
+#define NCLASSES	24		/* number of size classes */
+#define MAX_SMALL	2048		/* largest block served from spans */
+#define SPAN_MINBLKS	8		/* minimum blocks per span */
+#define CACHE_BYTES	1024		/* bytes moved per cache refill */
+#ifdef _REENTRANT
+#define NCACHES		8		/* number of thread caches */
+#else
+#define NCACHES		1
+#endif
+
+struct span;
+struct msite;
+
+/*
+ * Block header.  Free blocks are chained by next in a span or a
+ * thread cache.  Large blocks have no span and own their pages.
+ */
 struct header {
 #ifdef CONFIG_MCHECK
 	int hdr_magic;		/* set for every header */
 #endif
 	struct header *next;
-	size_t size;
-	size_t vm_size;
+	struct span *span;	/* owning span, NULL for large block */
+	size_t size;		/* block size including this header */
 #ifdef CONFIG_MCHECK
 	int malloc_magic;	/* only set when allocated */
 	void* retaddr_p;	/* return address of call to malloc */
 #endif
+#ifdef CONFIG_MPROF
+	struct msite *site;	/* call site which allocated this block */
+#endif
 };
+
+/*
+ * Span - a page run cut into blocks of one size class.
+ */
+struct span {
+	struct list link;	/* link in bucket while it has free blocks */
+	struct header *free;	/* free blocks in this span */
+	int class;		/* size class */
+	int nblocks;		/* number of blocks */
+	int nfree;		/* number of free blocks */
+	size_t vm_size;		/* size of page run */
+};
+
+#define SPAN_HDRSIZE	ROUNDUP(sizeof(struct span))
+
+void	*malloc_caller(size_t, void *);
@@ -29,29 +29,25 @@
 
 /*
  * malloc_r() - this is used with multi-threaded native task.
+ *
+ * malloc() does its own locking with per-thread caches, so these
+ * are kept only for compatibility with existing callers.
  */
 
 #include <prex/prex.h>
 #include <stdlib.h>
 #include "malloc.h"
 
-static mutex_t malloc_r_lock = MUTEX_INITIALIZER;
-
 void *
 malloc_r(size_t size)
 {
-	void *p;
 
-	mutex_lock(&malloc_r_lock);
-	p = malloc(size);
-	mutex_unlock(&malloc_r_lock);
-	return p;
+	return malloc_caller(size, __builtin_return_address(0));
 }
 
 void
 free_r(void *addr)
 {
-	mutex_lock(&malloc_r_lock);
+
 	free(addr);
-	mutex_unlock(&malloc_r_lock);
 }
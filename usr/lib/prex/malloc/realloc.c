@@ -34,10 +34,12 @@
 void *
 realloc(void *addr, size_t size)
 {
-	struct header *p, *old;
+	struct header *old;
+	size_t old_size;
+	void *p;
 
 	if (addr == NULL)
-		return malloc(size);
+		return malloc_caller(size, __builtin_return_address(0));
 
 	if (size == 0) {
 		free(addr);
@@ -48,8 +50,12 @@ realloc(void *addr, size_t size)
 	HDR_MAGIC_ASSERT(old, "realloc: corrupt / invalid pointer");
 	MALLOC_MAGIC_ASSERT(old, "realloc: already free");
 
-	if ((p = malloc(size)) != NULL) {
-		size_t old_size = old->size - sizeof(struct header);
+	/* Keep the block if the new size still fits reasonably */
+	old_size = old->size - sizeof(struct header);
+	if (size <= old_size && size > old_size / 2)
+		return addr;
+
+	if ((p = malloc_caller(size, __builtin_return_address(0))) != NULL) {
 		if (old_size <= size)
 			memcpy(p, addr, old_size);
 		else
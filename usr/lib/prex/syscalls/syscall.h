@@ -94,5 +94,7 @@
 #define SYS_sys_time		58
 #define SYS_sys_debug		59
 #define SYS_thread_name		60
+#define SYS_object_grant	61
+#define SYS_sem_owner		62
 
 #endif /* _SYSCALL_H */
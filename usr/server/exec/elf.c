@@ -85,10 +85,8 @@ load_exec(Elf32_Ehdr *ehdr, task_t task, int fd, void **entry)
 		if (vm_map(task, (void *)phdr->p_vaddr, size, &mapped) != 0)
 			return ENOEXEC;
 		if (phdr->p_filesz > 0) {
-			if (lseek(fd, (off_t)phdr->p_offset, SEEK_SET)
-			    == -(off_t)1)
-				goto err;
-			if (read(fd, mapped, phdr->p_filesz) < 0)
+			if (pread(fd, mapped, phdr->p_filesz,
+				  (off_t)phdr->p_offset) < 0)
 				goto err;
 		}
 
@@ -217,11 +215,7 @@ load_reloc(Elf32_Ehdr *ehdr, task_t task, int fd, void **entry, const char *name
 	if ((buf = malloc(shdr_size)) == NULL)
 		return ENOMEM;
 
-	if (lseek(fd, ehdr->e_shoff, SEEK_SET) < 0) {
-		err = EIO;
-		goto out1;
-	}
-	if (read(fd, buf, shdr_size) < 0) {
+	if (pread(fd, buf, shdr_size, ehdr->e_shoff) < 0) {
 		err = EIO;
 		goto out1;
 	}
@@ -290,11 +284,7 @@ load_reloc(Elf32_Ehdr *ehdr, task_t task, int fd, void **entry, const char *name
 		} else
 			continue;
 
-		if (lseek(fd, shdr->sh_offset, SEEK_SET) < 0) {
-			err = EIO;
-			goto out2;
-		}
-		if (read(fd, addr, shdr->sh_size) < 0) {
+		if (pread(fd, addr, shdr->sh_size, shdr->sh_offset) < 0) {
 			err = EIO;
 			goto out2;
 		}
@@ -280,7 +280,7 @@ exec_debug(void)
 {
 
 #ifdef DEBUG
-	/* mstat(); */
+	malloc_stats();
 #endif
 }
 
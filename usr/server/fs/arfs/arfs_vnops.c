@@ -80,6 +80,7 @@ static int arfs_lookup	(vnode_t, char *, vnode_t);
 #define arfs_setattr	((vnop_setattr_t)vop_nullop)
 #define arfs_inactive	((vnop_inactive_t)vop_nullop)
 #define arfs_truncate	((vnop_truncate_t)vop_nullop)
+#define arfs_poll	((vnop_poll_t)vop_pollready)
 
 static char iobuf[BSIZE*2];
 
@@ -110,6 +111,7 @@ const struct vnops arfs_vnops = {
 	arfs_setattr,		/* setattr */
 	arfs_inactive,		/* inactive */
 	arfs_truncate,		/* truncate */
+	arfs_poll,		/* poll */
 };
 
 /*
@@ -208,7 +210,7 @@ static int
 arfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	off_t off, file_pos, buf_pos;
-	int blkno, err;
+	int blkno, lastblk, err;
 	size_t nr_read, nr_copy;
 	mount_t mp;
 	struct buf *bp;
@@ -231,6 +233,7 @@ arfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 
 	/* Read and copy data */
 	off = (off_t)vp->v_data;
+	lastblk = (off + vp->v_size - 1) / BSIZE;
 	nr_read = 0;
 	for (;;) {
 		DPRINTF(("arfs_read: file_pos=%d buf=%x size=%d\n",
@@ -238,7 +241,8 @@ arfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 
 		blkno = (off + file_pos) / BSIZE;
 		buf_pos = (off + file_pos) % BSIZE;
-		if ((err = bread(mp->m_dev, blkno, &bp)) != 0)
+		err = breada(mp->m_dev, blkno, lastblk - blkno, &vp->v_ra, &bp);
+		if (err)
 			goto out;
 		nr_copy = BSIZE;
 		if (buf_pos > 0)
@@ -331,6 +335,8 @@ arfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 	dir->d_namlen = strlen(dir->d_name);
 	dir->d_fileno = fp->f_offset;
 	dir->d_type = DT_REG;
+	dir->d_size = size;
+	dir->d_mode = S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
 
 	fp->f_offset++;
 	err = 0;
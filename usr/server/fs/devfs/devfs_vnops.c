@@ -37,6 +37,7 @@
 #include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/syslog.h>
+#include <sys/ioctl.h>
 
 #include <ctype.h>
 #include <unistd.h>
@@ -74,6 +75,7 @@ static int devfs_lookup	(vnode_t, char *, vnode_t);
 #define devfs_setattr	((vnop_setattr_t)vop_nullop)
 #define devfs_inactive	((vnop_inactive_t)vop_nullop)
 #define devfs_truncate	((vnop_truncate_t)vop_nullop)
+static int devfs_poll	(vnode_t, file_t, int, int *);
 
 struct vnops devfs_vnops;
 
@@ -112,6 +114,7 @@ struct vnops devfs_vnops = {
 	devfs_setattr,		/* setattr */
 	devfs_inactive,		/* inactive */
 	devfs_truncate,		/* truncate */
+	devfs_poll,		/* poll */
 };
 
 static int
@@ -193,6 +196,29 @@ devfs_ioctl(vnode_t vp, file_t fp, u_long cmd, void *arg)
 	return err;
 }
 
+/*
+ * The driver is asked for the readiness of a device.  The
+ * kernel posts devpoll_sem when a device may become ready.
+ */
+static int
+devfs_poll(vnode_t vp, file_t fp, int events, int *revents)
+{
+	struct devpoll dp;
+	int err;
+
+	if (vp->v_type != VCHR && vp->v_type != VBLK)
+		return vop_pollready(vp, fp, events, revents);
+
+	dp.events = events;
+	dp.revents = 0;
+	dp.sem = devpoll_sem;
+	err = device_ioctl((device_t)vp->v_data, DEVIOC_POLL, &dp);
+	*revents = dp.revents;
+
+	DPRINTF(("devfs_poll: err=%d revents=%x\n", err, *revents));
+	return err;
+}
+
 static int
 devfs_lookup(vnode_t dvp, char *name, vnode_t vp)
 {
@@ -250,6 +276,7 @@ devfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 	strcpy((char *)&dir->d_name, info.name);
 	dir->d_fileno = fp->f_offset;
 	dir->d_namlen = strlen(dir->d_name);
+	dir->d_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
 
 	DPRINTF(("devfs_readdir: %s\n", dir->d_name));
 	fp->f_offset++;
@@ -139,6 +139,24 @@ struct fat32_bpb {
 	uint8_t		file_sys_id[8];		/* 82 ~ 89 	: 0x52 ~ 0x59	*/
 } __packed;
 
+/*
+ * FSInfo sector of FAT32
+ */
+struct fat_fsinfo {
+	uint32_t	lead_sig;		/* 0 ~ 3	: 0x41615252	*/
+	uint8_t		reserved1[480];
+	uint32_t	struct_sig;		/* 484 ~ 487	: 0x61417272	*/
+	uint32_t	free_count;		/* 488 ~ 491	: free clusters	*/
+	uint32_t	next_free;		/* 492 ~ 495	: hint		*/
+	uint8_t		reserved2[12];
+	uint32_t	trail_sig;		/* 508 ~ 511	: 0xaa550000	*/
+} __packed;
+
+#define FSI_LEAD_SIG	0x41615252
+#define FSI_STRUCT_SIG	0x61417272
+#define FSI_TRAIL_SIG	0xaa550000
+#define FSI_UNKNOWN	0xffffffff
+
 /*
  * FAT directory entry
  */
@@ -195,6 +213,16 @@ struct fatfsmount {
 	u_long	last_cluster;	/* last cluser */
 	u_long	fat_mask;	/* mask for cluster# */
 	u_long	free_scan;	/* start cluster# to free search */
+	u_long	fat_sectors;	/* sectors per FAT */
+	u_long	fat_count;	/* number of FAT copies */
+	char	*fat_cache;	/* in-memory FAT, or NULL */
+	uint8_t	*fat_dirty;	/* bitmap of dirty sectors in fat_cache */
+	u_long	fat_ndirty;	/* number of dirty sectors */
+	uint8_t	*free_map;	/* bitmap of used or reserved clusters */
+	u_long	free_count;	/* free clusters, FSI_UNKNOWN if unknown */
+	u_long	fsinfo_sec;	/* FSInfo sector#, 0 if none */
+	int	fsinfo_dirty;	/* FSInfo needs update */
+	struct list resv_list;	/* nodes holding reserved clusters */
 	vnode_t	root_vnode;	/* vnode for root */
 	char	*io_buf;	/* local data buffer */
 	char	*fat_buf;	/* buffer for fat entry */
@@ -221,6 +249,49 @@ struct fatfs_node {
 	struct fat_dirent dirent; /* copy of directory entry */
 	u_long	sector;		/* sector# for directory entry */
 	u_long	offset;		/* offset of directory entry in sector */
+	u_long	resv_cl;	/* first cluster reserved for appends */
+	u_long	resv_len;	/* number of reserved clusters */
+	struct list resv_link;	/* link for resv_list, if resv_len > 0 */
+	int	nopens;		/* number of open files */
+	struct fat_extmap *extmap; /* cluster chain map, or NULL */
+};
+
+/*
+ * Max clusters reserved ahead of a file growing by appends.
+ */
+#define PREALLOC_MAX	32
+
+/*
+ * Cluster chain map of a file.
+ *
+ * The extents map the head of the chain in file order, and are
+ * filled in as the chain is walked.  Past the last extent, the
+ * last position found by a walk is remembered.
+ */
+#define FAT_NEXTENT	16
+
+struct fat_extent {
+	u_long	index;		/* cluster index in file */
+	u_long	cl;		/* first cluster# of the run */
+	u_long	len;		/* number of clusters in the run */
+};
+
+struct fat_extmap {
+	int	count;		/* number of extents */
+	u_long	last_index;	/* cluster index of the last position */
+	u_long	last_cl;	/* cluster# of the last position, or 0 */
+	struct fat_extent ext[FAT_NEXTENT];
+};
+
+/*
+ * Directory read cursor, kept in f_data of an open directory.
+ * It points at the entry returned last by readdir.
+ */
+struct fatfs_dircur {
+	int	index;		/* index of the entry, -1 if none */
+	u_long	cl;		/* cluster# (CL_ROOT for the FAT12/16 root) */
+	u_long	sec;		/* sector# */
+	u_long	slot;		/* entry# in the sector */
 };
 
 extern struct vnops fatfs_vnops;
@@ -230,13 +301,21 @@ extern struct vnops fatfs_vnops;
 	(fat->data_start + (cl - 2) * fat->sec_per_cl)
 
 __BEGIN_DECLS
+int	 fat_cache_init(struct fatfsmount *fmp);
+void	 fat_cache_free(struct fatfsmount *fmp);
+void	 fat_cache_sync(struct fatfsmount *fmp);
 int	 fat_next_cluster(struct fatfsmount *fmp, u_long cl, u_long *next);
 int	 fat_set_cluster(struct fatfsmount *fmp, u_long cl, u_long next);
 int	 fat_alloc_cluster(struct fatfsmount *fmp, u_long scan_start, u_long *free);
 int	 fat_free_clusters(struct fatfsmount *fmp, u_long start);
-int	 fat_seek_cluster(struct fatfsmount *fmp, u_long start, u_long offset,
-			    u_long *cl);
-int	 fat_expand_file(struct fatfsmount *fmp, u_long cl, int size);
+int	 fat_free_init(struct fatfsmount *fmp);
+void	 fat_free_sync(struct fatfsmount *fmp);
+void	 fat_release(struct fatfsmount *fmp, struct fatfs_node *np);
+int	 fat_seek_cluster(struct fatfsmount *fmp, struct fatfs_node *np,
+			  u_long start, u_long offset, u_long *cl);
+void	 fat_extmap_clear(struct fatfs_node *np);
+int	 fat_expand_file(struct fatfsmount *fmp, struct fatfs_node *np,
+			 u_long cl, int size);
 int	 fat_expand_dir(struct fatfsmount *fmp, u_long cl, u_long *new_cl);
 
 void	 fat_convert_name(char *org, char *name);
@@ -247,7 +326,8 @@ void	 fat_mode_to_attr(mode_t mode, u_char *attr);
 void	 fat_attr_to_mode(u_char attr, mode_t *mode);
 
 int	 fatfs_lookup_node(vnode_t dvp, char *name, struct fatfs_node *node);
-int	 fatfs_get_node(vnode_t dvp, int index, struct fatfs_node *node);
+int	 fatfs_get_node(vnode_t dvp, int index, struct fatfs_dircur *dc,
+			struct fatfs_node *node);
 int	 fatfs_put_node(struct fatfsmount *fmp, struct fatfs_node *node);
 int	 fatfs_add_node(vnode_t dvp, struct fatfs_node *node);
 __END_DECLS
@@ -37,33 +37,164 @@
 
 #include "fatfs.h"
 
+#ifdef CONFIG_FAT_CACHE
+#define FAT_CACHE_MAX	CONFIG_FAT_CACHE	/* max FAT sectors to cache */
+#else
+#define FAT_CACHE_MAX	0
+#endif
+
+static int	fat_reclaim(struct fatfsmount *);
+
+/*
+ * Byte offset of the FAT entry for specified cluster.
+ */
+static u_long
+fat_entry_offset(struct fatfsmount *fmp, u_long cl)
+{
+
+	if (FAT32(fmp))
+		return cl * 4;
+	if (FAT16(fmp))
+		return cl * 2;
+	return cl * 3 / 2;
+}
+
+/*
+ * Load the whole FAT into memory if it is small enough.
+ * Without the cache, FAT entries are read through the
+ * buffer cache one sector at a time.
+ */
+int
+fat_cache_init(struct fatfsmount *fmp)
+{
+	size_t size;
+	int err;
+
+	fmp->fat_cache = NULL;
+	fmp->fat_dirty = NULL;
+	fmp->fat_ndirty = 0;
+	if (fmp->fat_sectors == 0 || fmp->fat_sectors > FAT_CACHE_MAX)
+		return 0;
+
+	size = fmp->fat_sectors * SEC_SIZE;
+	if ((fmp->fat_cache = malloc(size)) == NULL)
+		return 0;
+	if ((fmp->fat_dirty = malloc((fmp->fat_sectors + 7) / 8)) == NULL) {
+		free(fmp->fat_cache);
+		fmp->fat_cache = NULL;
+		return 0;
+	}
+	memset(fmp->fat_dirty, 0, (fmp->fat_sectors + 7) / 8);
+
+	err = bread_cluster(fmp->dev, fmp->fat_start, fmp->fat_sectors,
+			    fmp->fat_cache);
+	if (err) {
+		fat_cache_free(fmp);
+		return err;
+	}
+	DPRINTF(("fat_cache_init: %d sectors\n", fmp->fat_sectors));
+	return 0;
+}
+
+void
+fat_cache_free(struct fatfsmount *fmp)
+{
+
+	if (fmp->fat_cache == NULL)
+		return;
+	free(fmp->fat_dirty);
+	free(fmp->fat_cache);
+	fmp->fat_cache = NULL;
+	fmp->fat_dirty = NULL;
+}
+
+/*
+ * Write the dirty sectors of the cached FAT to every FAT copy.
+ * The sectors are written back later by the flusher.
+ */
+void
+fat_cache_sync(struct fatfsmount *fmp)
+{
+	struct buf *bp;
+	u_long sec, i;
+
+	if (fmp->fat_ndirty == 0)
+		return;
+
+	for (sec = 0; sec < fmp->fat_sectors; sec++) {
+		if ((fmp->fat_dirty[sec / 8] & (1 << (sec % 8))) == 0)
+			continue;
+		fmp->fat_dirty[sec / 8] &= ~(1 << (sec % 8));
+		for (i = 0; i < fmp->fat_count; i++) {
+			bp = getblk(fmp->dev, fmp->fat_start +
+				    i * fmp->fat_sectors + sec);
+			memcpy(bp->b_data, fmp->fat_cache + sec * SEC_SIZE,
+			       SEC_SIZE);
+			bdwrite(bp);
+		}
+	}
+	fmp->fat_ndirty = 0;
+}
+
+/*
+ * Mark the cached FAT sector holding specified byte offset dirty.
+ */
+static void
+fat_cache_dirty(struct fatfsmount *fmp, u_long offset)
+{
+	u_long sec;
+
+	sec = offset / SEC_SIZE;
+	if ((fmp->fat_dirty[sec / 8] & (1 << (sec % 8))) == 0) {
+		fmp->fat_dirty[sec / 8] |= 1 << (sec % 8);
+		fmp->fat_ndirty++;
+	}
+}
+
+/*
+ * Decode the FAT entry for specified cluster at p.
+ */
+static u_long
+fat_decode(struct fatfsmount *fmp, char *p, u_long cl)
+{
+	uint32_t val;
+
+	if (FAT32(fmp))
+		return (u_long)*((uint32_t *)p);
+
+	val = *((uint16_t *)p);
+
+	/* Adjust data for FAT12 entry */
+	if (FAT12(fmp)) {
+		if (cl & 1)
+			val >>= 4;
+		else
+			val &= 0xfff;
+	}
+	return (u_long)val;
+}
+
 /*
  * Read the FAT entry for specified cluster.
  */
 static int
 read_fat_entry(struct fatfsmount *fmp, u_long cl)
 {
-	u_long sec;
+	u_long sec, offset;
 	char *buf = fmp->fat_buf;
 	int err, border = 0;
 	struct buf *bp;
 
 	/* Get the sector number in FAT entry. */
-	if (FAT32(fmp)) {
-		sec = (cl * 4) / SEC_SIZE;
-	} else if (FAT16(fmp)) {
-		sec = (cl * 2) / SEC_SIZE;
-	} else {
-		sec = (cl * 3 / 2) / SEC_SIZE;
-		/*
-		 * Check if the entry data is placed at the
-		 * end of sector. If so, we have to read one
-		 * more sector to get complete FAT12 entry.
-		 */
-		if ((cl * 3 / 2) % SEC_SIZE == SEC_SIZE - 1)
-			border = 1;
-	}
-	sec += fmp->fat_start;
+	offset = fat_entry_offset(fmp, cl);
+	sec = fmp->fat_start + offset / SEC_SIZE;
+	/*
+	 * Check if the entry data is placed at the
+	 * end of sector. If so, we have to read one
+	 * more sector to get complete FAT12 entry.
+	 */
+	if (FAT12(fmp) && offset % SEC_SIZE == SEC_SIZE - 1)
+		border = 1;
 
 	/* Read first sector. */
 	if ((err = bread(fmp->dev, sec, &bp)) != 0)
@@ -83,43 +214,39 @@ read_fat_entry(struct fatfsmount *fmp, u_long cl)
 }
 
 /*
- * Write fat entry from buffer.
+ * Write fat entry from buffer to every FAT copy.
+ * The sectors are written back later by the flusher.
  */
 static int
 write_fat_entry(struct fatfsmount *fmp, u_long cl)
 {
-	u_long sec;
+	u_long sec, offset, i;
 	char *buf = fmp->fat_buf;
-	int err, border = 0;
+	int border = 0;
 	struct buf *bp;
 
 	/* Get the sector number in FAT entry. */
-	if (FAT32(fmp)) {
-		sec = (cl * 4) / SEC_SIZE;
-	} else if (FAT16(fmp)) {
-		sec = (cl * 2) / SEC_SIZE;
-	} else {
-		sec = (cl * 3 / 2) / SEC_SIZE;
-		/* Check if border entry for FAT12 */
-		if ((cl * 3 / 2) % SEC_SIZE == SEC_SIZE - 1)
-			border = 1;
+	offset = fat_entry_offset(fmp, cl);
+	sec = fmp->fat_start + offset / SEC_SIZE;
+	/* Check if border entry for FAT12 */
+	if (FAT12(fmp) && offset % SEC_SIZE == SEC_SIZE - 1)
+		border = 1;
+
+	for (i = 0; i < fmp->fat_count; i++) {
+		/* Write first sector. */
+		bp = getblk(fmp->dev, sec);
+		memcpy(bp->b_data, buf, SEC_SIZE);
+		bdwrite(bp);
+
+		/* Write second sector for the border entry of FAT12. */
+		if (border) {
+			bp = getblk(fmp->dev, sec + 1);
+			memcpy(bp->b_data, buf + SEC_SIZE, SEC_SIZE);
+			bdwrite(bp);
+		}
+		sec += fmp->fat_sectors;
 	}
-	sec += fmp->fat_start;
-
-	/* Write first sector. */
-	bp = getblk(fmp->dev, sec);
-	memcpy(bp->b_data, buf, SEC_SIZE);
-	if ((err = bwrite(bp)) != 0)
-		return err;
-
-	if (!FAT12(fmp) || border == 0)
-		return 0;
-
-	/* Write second sector for the border entry of FAT12. */
-	bp = getblk(fmp->dev, sec + 1);
-	memcpy(bp->b_data, buf + SEC_SIZE, SEC_SIZE);
-	err = bwrite(bp);
-	return err;
+	return 0;
 }
 
 /*
@@ -131,37 +258,25 @@ write_fat_entry(struct fatfsmount *fmp, u_long cl)
 int
 fat_next_cluster(struct fatfsmount *fmp, u_long cl, u_long *next)
 {
-	u_int offset;
-	uint32_t val;
+	u_long offset;
+	char *p;
 	int err;
 
-	/* Read FAT entry */
-	err = read_fat_entry(fmp, cl);
-	if (err)
-		return err;
+	if (cl >= fmp->last_cluster)
+		return EIO;
 
-	/* Get offset in buffer. */
-	if (FAT32(fmp)) {
-		offset = (cl * 4) % SEC_SIZE;
-		val = *((uint32_t *)(fmp->fat_buf + offset));
-		*next = (u_long)val;
+	offset = fat_entry_offset(fmp, cl);
+	if (fmp->fat_cache != NULL) {
+		p = fmp->fat_cache + offset;
 	} else {
-		if (FAT16(fmp))
-			offset = (cl * 2) % SEC_SIZE;
-		else
-			offset = (cl * 3 / 2) % SEC_SIZE;
-
-		val = *((uint16_t *)(fmp->fat_buf + offset));
-
-		/* Adjust data for FAT12 entry */
-		if (FAT12(fmp)) {
-			if (cl & 1)
-				val >>= 4;
-			else
-				val &= 0xfff;
-		}
-		*next = (u_long)val;
+		/* Read FAT entry */
+		err = read_fat_entry(fmp, cl);
+		if (err)
+			return err;
+		p = fmp->fat_buf + offset % SEC_SIZE;
 	}
+
+	*next = fat_decode(fmp, p, cl);
 	//DPRINTF(("fat_next_cluster: %d => %d\n", cl, *next));
 	return 0;
 }
@@ -175,32 +290,52 @@ fat_next_cluster(struct fatfsmount *fmp, u_long cl, u_long *next)
 int
 fat_set_cluster(struct fatfsmount *fmp, u_long cl, u_long next)
 {
-	u_int offset;
-	char *buf = fmp->fat_buf;
+	u_long offset, old;
+	char *p;
 	int err;
 	uint32_t val, tmp;
 
-	/* Read FAT entry */
-	err = read_fat_entry(fmp, cl);
-	if (err)
-		return err;
+	if (cl >= fmp->last_cluster)
+		return EIO;
+
+	offset = fat_entry_offset(fmp, cl);
+	if (fmp->fat_cache != NULL) {
+		p = fmp->fat_cache + offset;
+	} else {
+		/* Read FAT entry */
+		err = read_fat_entry(fmp, cl);
+		if (err)
+			return err;
+		p = fmp->fat_buf + offset % SEC_SIZE;
+	}
+
+	/* Keep the free map and the free count in step. */
+	old = fat_decode(fmp, p, cl) & fmp->fat_mask;
+	if (next == CL_FREE) {
+		if (fmp->free_map != NULL)
+			clrbit(fmp->free_map, cl);
+		if (old != CL_FREE && fmp->free_count != FSI_UNKNOWN) {
+			fmp->free_count++;
+			fmp->fsinfo_dirty = 1;
+		}
+	} else {
+		if (fmp->free_map != NULL)
+			setbit(fmp->free_map, cl);
+		if (old == CL_FREE && fmp->free_count != FSI_UNKNOWN) {
+			fmp->free_count--;
+			fmp->fsinfo_dirty = 1;
+		}
+	}
 
-	/* Get offset in buffer. */
 	if (FAT32(fmp)) {
-		offset = (cl * 4) % SEC_SIZE;
 		val = (uint32_t)(next & fmp->fat_mask);
-		*((uint32_t *)(buf + offset)) = val;
+		*((uint32_t *)p) = val;
 	} else {
-		if (FAT16(fmp))
-			offset = (cl * 2) % SEC_SIZE;
-		else
-			offset = (cl * 3 / 2) % SEC_SIZE;
-
 		/* Modify FAT entry for target cluster. */
 		val = (uint16_t)(next & fmp->fat_mask);
 
 		if (FAT12(fmp)) {
-			tmp = *((uint16_t *)(buf + offset));
+			tmp = *((uint16_t *)p);
 			if (cl & 1) {
 				val <<= 4;
 				val |= (tmp & 0xf);
@@ -209,25 +344,78 @@ fat_set_cluster(struct fatfsmount *fmp, u_long cl, u_long next)
 				val |= tmp;
 			}
 		}
-		*((uint16_t *)(buf + offset)) = val;
+		*((uint16_t *)p) = val;
 	}
 
+	if (fmp->fat_cache != NULL) {
+		fat_cache_dirty(fmp, offset);
+		/* FAT12 entry may cross the sector border. */
+		if (FAT12(fmp) && offset % SEC_SIZE == SEC_SIZE - 1)
+			fat_cache_dirty(fmp, offset + 1);
+		return 0;
+	}
 	/* Write FAT entry */
 	err = write_fat_entry(fmp, cl);
 	return err;
 }
 
+/*
+ * Find the first free cluster after specified cluster in the free
+ * map, wrapping around at the end of the volume.  Returns 0 if no
+ * cluster is free.
+ */
+static u_long
+fat_find_free(struct fatfsmount *fmp, u_long start)
+{
+	u_long cl, n, nclusters;
+
+	nclusters = fmp->last_cluster - CL_FIRST;
+	cl = start;
+	for (n = 0; n < nclusters; n++) {
+		if (++cl >= fmp->last_cluster)
+			cl = CL_FIRST;
+		/* Skip 8 used clusters at once. */
+		if ((cl & 7) == 0 && fmp->free_map[cl / NBBY] == 0xff &&
+		    n + 8 <= nclusters) {
+			cl += 7;
+			n += 7;
+			continue;
+		}
+		if (isclr(fmp->free_map, cl))
+			return cl;
+	}
+	return 0;
+}
+
+/*
+ * Count free clusters from specified cluster, up to max.
+ */
+static u_long
+fat_free_run(struct fatfsmount *fmp, u_long cl, u_long max)
+{
+	u_long n;
+
+	for (n = 0; n < max && cl + n < fmp->last_cluster; n++) {
+		if (isset(fmp->free_map, cl + n))
+			break;
+	}
+	return n;
+}
+
 /*
  * Allocate free cluster in FAT chain.
  *
  * @fmp: fat mount data
  * @scan_start: cluster# to scan first. If 0, use the previous used value.
  * @free: allocated cluster# to return
+ *
+ * The cluster is not marked used until it is linked with
+ * fat_set_cluster().
  */
 int
 fat_alloc_cluster(struct fatfsmount *fmp, u_long scan_start, u_long *free)
 {
-	u_long cl, next;
+	u_long cl, n, next, nclusters;
 	int err;
 
 	if (scan_start == 0)
@@ -235,22 +423,229 @@ fat_alloc_cluster(struct fatfsmount *fmp, u_long scan_start, u_long *free)
 
 	DPRINTF(("fat_alloc_cluster: start=%d\n", scan_start));
 
-	cl = scan_start + 1;
-	while (cl != scan_start) {
+	if (fmp->free_map != NULL) {
+		if ((cl = fat_find_free(fmp, scan_start)) == 0 &&
+		    (!fat_reclaim(fmp) ||
+		     (cl = fat_find_free(fmp, scan_start)) == 0))
+			return ENOSPC;
+		DPRINTF(("fat_alloc_cluster: free cluster=%d\n", cl));
+		fmp->free_scan = cl;
+		*free = cl;
+		return 0;
+	}
+
+	nclusters = fmp->last_cluster - CL_FIRST;
+	cl = scan_start;
+	for (n = 0; n < nclusters; n++) {
+		if (++cl >= fmp->last_cluster)
+			cl = CL_FIRST;
 		err = fat_next_cluster(fmp, cl, &next);
 		if (err)
 			return err;
 		if (next == CL_FREE) {	/* free ? */
 			DPRINTF(("fat_alloc_cluster: free cluster=%d\n", cl));
+			fmp->free_scan = cl;
 			*free = cl;
 			return 0;
 		}
-		if (++cl >= fmp->last_cluster)
-			cl = CL_FIRST;
 	}
 	return ENOSPC;		/* no space */
 }
 
+/*
+ * Allocate a run of free clusters.  The first run of want clusters
+ * after scan_start is taken.  If there is none, the longest run is
+ * returned and the caller allocates the rest in another call.
+ *
+ * @fmp: fat mount data
+ * @scan_start: cluster# to scan first
+ * @want: number of clusters wanted
+ * @start: first cluster# of the run to return
+ * @len: length of the run to return
+ */
+static int
+fat_alloc_extent(struct fatfsmount *fmp, u_long scan_start, u_long want,
+		 u_long *start, u_long *len)
+{
+	u_long cl, first, n, next, best, best_len;
+	int err, wrapped;
+
+	if (fmp->free_map == NULL) {
+		/* No free map. One cluster at a time. */
+		if ((err = fat_alloc_cluster(fmp, scan_start, start)) != 0)
+			return err;
+		*len = 1;
+		return 0;
+	}
+
+	if ((first = fat_find_free(fmp, scan_start)) == 0 &&
+	    (!fat_reclaim(fmp) ||
+	     (first = fat_find_free(fmp, scan_start)) == 0))
+		return ENOSPC;
+	best = first;
+	best_len = 0;
+	wrapped = 0;
+	cl = first;
+	for (;;) {
+		n = fat_free_run(fmp, cl, want);
+		if (n > best_len) {
+			best = cl;
+			best_len = n;
+			if (n == want)
+				break;
+		}
+		/* Stop when the scan comes around to the first run. */
+		next = fat_find_free(fmp, cl + n - 1);
+		if (next <= cl)
+			wrapped = 1;
+		if (wrapped && next >= first)
+			break;
+		cl = next;
+	}
+
+	DPRINTF(("fat_alloc_extent: want=%d cl=%d len=%d\n", want, best,
+		 best_len));
+	fmp->free_scan = best + best_len - 1;
+	*start = best;
+	*len = best_len;
+	return 0;
+}
+
+/*
+ * Build the free map from the FAT at mount time.  The FSInfo
+ * sector of FAT32 gives the free count and the next free hint
+ * when there is no memory for the map.
+ */
+int
+fat_free_init(struct fatfsmount *fmp)
+{
+	struct fat_fsinfo *fsi;
+	struct buf *bp;
+	u_long cl, next, offset, sec, loaded;
+	size_t size;
+	char *p;
+	int err;
+
+	fmp->free_map = NULL;
+	fmp->free_count = FSI_UNKNOWN;
+	fmp->fsinfo_dirty = 0;
+
+	if (fmp->fsinfo_sec != 0) {
+		if ((err = bread(fmp->dev, fmp->fsinfo_sec, &bp)) != 0)
+			return err;
+		fsi = (struct fat_fsinfo *)bp->b_data;
+		if (fsi->lead_sig == FSI_LEAD_SIG &&
+		    fsi->struct_sig == FSI_STRUCT_SIG &&
+		    fsi->trail_sig == FSI_TRAIL_SIG) {
+			if (fsi->free_count <= fmp->last_cluster - CL_FIRST)
+				fmp->free_count = fsi->free_count;
+			if (fsi->next_free >= CL_FIRST &&
+			    fsi->next_free < fmp->last_cluster)
+				fmp->free_scan = fsi->next_free;
+		} else
+			fmp->fsinfo_sec = 0;
+		brelse(bp);
+	}
+
+	size = (fmp->last_cluster + NBBY - 1) / NBBY;
+	if ((fmp->free_map = malloc(size)) == NULL)
+		return 0;
+	memset(fmp->free_map, 0, size);
+	setbit(fmp->free_map, 0);
+	setbit(fmp->free_map, 1);
+
+	/*
+	 * Scan the FAT.  Without the FAT cache, each sector is read
+	 * once through fat_buf.
+	 */
+	fmp->free_count = 0;
+	loaded = SEC_INVAL;
+	for (cl = CL_FIRST; cl < fmp->last_cluster; cl++) {
+		offset = fat_entry_offset(fmp, cl);
+		if (fmp->fat_cache != NULL) {
+			p = fmp->fat_cache + offset;
+		} else {
+			/*
+			 * A FAT12 entry on the sector border needs the
+			 * next sector, so it is always read.
+			 */
+			sec = offset / SEC_SIZE;
+			if (FAT12(fmp) && offset % SEC_SIZE == SEC_SIZE - 1)
+				loaded = SEC_INVAL;
+			if (sec != loaded) {
+				if ((err = read_fat_entry(fmp, cl)) != 0) {
+					free(fmp->free_map);
+					fmp->free_map = NULL;
+					return err;
+				}
+				loaded = sec;
+			}
+			p = fmp->fat_buf + offset % SEC_SIZE;
+		}
+		next = fat_decode(fmp, p, cl) & fmp->fat_mask;
+		if (next != CL_FREE)
+			setbit(fmp->free_map, cl);
+		else
+			fmp->free_count++;
+	}
+	DPRINTF(("fat_free_init: %d free clusters\n", fmp->free_count));
+	return 0;
+}
+
+/*
+ * Update the FSInfo sector of FAT32.
+ * The sector is written back later by the flusher.
+ */
+void
+fat_free_sync(struct fatfsmount *fmp)
+{
+	struct fat_fsinfo *fsi;
+	struct buf *bp;
+
+	if (fmp->fsinfo_sec == 0 || !fmp->fsinfo_dirty)
+		return;
+	if (bread(fmp->dev, fmp->fsinfo_sec, &bp) != 0)
+		return;
+	fsi = (struct fat_fsinfo *)bp->b_data;
+	fsi->free_count = (uint32_t)fmp->free_count;
+	fsi->next_free = (uint32_t)fmp->free_scan;
+	bdwrite(bp);
+	fmp->fsinfo_dirty = 0;
+}
+
+/*
+ * Return the clusters reserved for a node to the free map.
+ * They were never linked in the FAT.
+ */
+void
+fat_release(struct fatfsmount *fmp, struct fatfs_node *np)
+{
+	u_long i;
+
+	if (fmp->free_map == NULL || np == NULL || np->resv_len == 0)
+		return;
+	for (i = 0; i < np->resv_len; i++)
+		clrbit(fmp->free_map, np->resv_cl + i);
+	np->resv_len = 0;
+	list_remove(&np->resv_link);
+}
+
+/*
+ * Take back the clusters reserved by all nodes.
+ * Returns 1 if any cluster was freed.
+ */
+static int
+fat_reclaim(struct fatfsmount *fmp)
+{
+	struct fatfs_node *np, *tmp;
+
+	if (list_empty(&fmp->resv_list))
+		return 0;
+	list_for_each_entry_safe(np, tmp, &fmp->resv_list, resv_link)
+		fat_release(fmp, np);
+	return 1;
+}
+
 /*
  * Deallocate needless cluster.
  * @fmp: fat mount data
@@ -275,42 +670,147 @@ fat_free_clusters(struct fatfsmount *fmp, u_long start)
 			return err;
 		cl = next;
 	}
-	/* Clear eof, 20090215, champ: necessary? */
-	if (!FAT32(fmp)) {
-		err = fat_set_cluster(fmp, cl, CL_FREE);
-		if (err)
-			return err;
+	return 0;
+}
+
+/*
+ * Look up the cluster# in the extents of a chain map.
+ * Returns 0 if the index is not mapped.
+ */
+static u_long
+fat_extmap_lookup(struct fat_extmap *map, u_long index)
+{
+	struct fat_extent *e;
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = map->count - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		e = &map->ext[mid];
+		if (index < e->index)
+			hi = mid - 1;
+		else if (index >= e->index + e->len)
+			lo = mid + 1;
+		else
+			return e->cl + (index - e->index);
 	}
 	return 0;
 }
 
+/*
+ * Forget the chain map of a node.
+ * This must be called when clusters are removed from the chain.
+ */
+void
+fat_extmap_clear(struct fatfs_node *np)
+{
+
+	if (np->extmap != NULL) {
+		np->extmap->count = 0;
+		np->extmap->last_cl = 0;
+	}
+}
+
 /*
  * Get the cluster# for the specific file offset.
  *
+ * If np is given, its chain map is used and extended, so that
+ * most seeks do not have to walk the FAT from the first cluster.
+ *
  * @fmp: fat mount data
+ * @np: fat node of the file, or NULL
  * @start: start cluster# of file.
  * @offset: file offset
  * @cl: cluster# to return
  */
 int
-fat_seek_cluster(struct fatfsmount *fmp, u_long start, u_long offset,
-		 u_long *cl)
+fat_seek_cluster(struct fatfsmount *fmp, struct fatfs_node *np,
+		 u_long start, u_long offset, u_long *cl)
 {
-	int err;
-	u_long i, c, target;
+	struct fat_extmap *map;
+	struct fat_extent *e;
+	int err, grow;
+	u_long i, c, next, target;
 
 	if (start > fmp->last_cluster)
 		return EIO;
 
-	c = start;
 	target = offset / fmp->cluster_size;
-	for (i = 0; i < target; i++) {
-		err = fat_next_cluster(fmp, c, &c);
+
+	map = NULL;
+	if (np != NULL) {
+		if (np->extmap == NULL) {
+			np->extmap = malloc(sizeof(struct fat_extmap));
+			if (np->extmap != NULL)
+				fat_extmap_clear(np);
+		}
+		map = np->extmap;
+	}
+	if (map == NULL) {
+		/* No map. Walk from the first cluster. */
+		c = start;
+		for (i = 0; i < target; i++) {
+			err = fat_next_cluster(fmp, c, &c);
+			if (err)
+				return err;
+			if (IS_EOFCL(fmp, c))
+				return EIO;
+		}
+		*cl = c;
+		return 0;
+	}
+
+	if (map->count == 0) {
+		e = &map->ext[0];
+		e->index = 0;
+		e->cl = start;
+		e->len = 1;
+		map->count = 1;
+	}
+	if ((c = fat_extmap_lookup(map, target)) != 0) {
+		*cl = c;
+		return 0;
+	}
+
+	/*
+	 * Walk from the end of the extents, or from the last
+	 * position if it is nearer.  New runs are added to the
+	 * extents while there is room.
+	 */
+	e = &map->ext[map->count - 1];
+	if (map->last_cl != 0 && map->last_index >= e->index + e->len &&
+	    map->last_index <= target) {
+		i = map->last_index;
+		c = map->last_cl;
+		grow = 0;
+	} else {
+		i = e->index + e->len - 1;
+		c = e->cl + e->len - 1;
+		grow = 1;
+	}
+	while (i < target) {
+		err = fat_next_cluster(fmp, c, &next);
 		if (err)
 			return err;
-		if (IS_EOFCL(fmp, c))
+		if (IS_EOFCL(fmp, next))
 			return EIO;
+		i++;
+		if (grow) {
+			if (next == c + 1)
+				e->len++;
+			else if (map->count < FAT_NEXTENT) {
+				e = &map->ext[map->count++];
+				e->index = i;
+				e->cl = next;
+				e->len = 1;
+			} else
+				grow = 0;
+		}
+		c = next;
 	}
+	map->last_index = i;
+	map->last_cl = c;
 	*cl = c;
 	return 0;
 }
@@ -318,38 +818,78 @@ fat_seek_cluster(struct fatfsmount *fmp, u_long start, u_long offset,
 /*
  * Expand file size.
  *
+ * The clusters are allocated as runs sized to the growth.  If np is
+ * given, the file is being appended to and the clusters following
+ * its new end are reserved for the next append, so that the file
+ * stays contiguous while other files grow.
+ *
  * @fmp: fat mount data
+ * @np: fat node for reservation, or NULL
  * @cl: cluster# of target file.
  * @size: new size of file in bytes.
  */
 int
-fat_expand_file(struct fatfsmount *fmp, u_long cl, int size)
+fat_expand_file(struct fatfsmount *fmp, struct fatfs_node *np, u_long cl,
+		int size)
 {
-	int i, cl_len, alloc, err;
-	u_long next;
+	u_long want, n, next, start, len, i;
+	int err, grown;
 
-	alloc = 0;
-	cl_len = size / fmp->cluster_size + 1;
+	want = (size + fmp->cluster_size - 1) / fmp->cluster_size;
+	if (want == 0)
+		want = 1;
 
-	for (i = 0; i < cl_len; i++) {
+	/* Find the last cluster of the file. */
+	for (n = 1; n < want; n++) {
 		err = fat_next_cluster(fmp, cl, &next);
 		if (err)
 			return err;
-		if (alloc || next >= fmp->fat_eof) {
-			err = fat_alloc_cluster(fmp, cl, &next);
+		if (IS_EOFCL(fmp, next))
+			break;
+		cl = next;
+	}
+
+	grown = (n < want);
+	while (n < want) {
+		if (np != NULL && np->resv_len > 0 && np->resv_cl == cl + 1) {
+			/* Take from the reservation. */
+			start = np->resv_cl;
+			len = MIN(np->resv_len, want - n);
+			np->resv_cl += len;
+			np->resv_len -= len;
+			if (np->resv_len == 0)
+				list_remove(&np->resv_link);
+		} else {
+			if (np != NULL)
+				fat_release(fmp, np);
+			err = fat_alloc_extent(fmp, cl, want - n, &start, &len);
 			if (err)
 				return err;
-			alloc = 1;
 		}
-		if (alloc) {
-			err = fat_set_cluster(fmp, cl, next);
+		/* Link the run to the end of the chain. */
+		for (i = 0; i < len; i++) {
+			err = fat_set_cluster(fmp, cl, start + i);
 			if (err)
 				return err;
+			cl = start + i;
 		}
-		cl = next;
+		err = fat_set_cluster(fmp, cl, fmp->fat_eof);	/* add eof */
+		if (err)
+			return err;
+		n += len;
+	}
+
+	/* Reserve ahead of an appender, as much as it has grown. */
+	if (grown && np != NULL && np->resv_len == 0 &&
+	    fmp->free_map != NULL) {
+		len = fat_free_run(fmp, cl + 1, MIN(want, PREALLOC_MAX));
+		for (i = 0; i < len; i++)
+			setbit(fmp->free_map, cl + 1 + i);
+		np->resv_cl = cl + 1;
+		np->resv_len = len;
+		if (len > 0)
+			list_insert(&fmp->resv_list, &np->resv_link);
 	}
-	if (alloc)
-		fat_set_cluster(fmp, cl, fmp->fat_eof);	/* add eof */
 	DPRINTF(("fat_expand_file: new size=%d\n", size));
 	return 0;
 }
@@ -370,10 +910,12 @@ fat_expand_dir(struct fatfsmount *fmp, u_long cl, u_long *new_cl)
 	u_long next;
 
 	/* Find last cluster number of FAT chain. */
-	while (!IS_EOFCL(fmp, cl)) {
+	for (;;) {
 		err = fat_next_cluster(fmp, cl, &next);
 		if (err)
 			return err;
+		if (IS_EOFCL(fmp, next))
+			break;
 		cl = next;
 	}
 
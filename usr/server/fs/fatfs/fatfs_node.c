@@ -56,6 +56,7 @@ fat_read_dirent(struct fatfsmount *fmp, u_long sec)
 
 /*
  * Write directory entry from buffer.
+ * The sector is written back later by the flusher.
  */
 static int
 fat_write_dirent(struct fatfsmount *fmp, u_long sec)
@@ -64,7 +65,8 @@ fat_write_dirent(struct fatfsmount *fmp, u_long sec)
 
 	bp = getblk(fmp->dev, sec);
 	memcpy(bp->b_data, fmp->dir_buf, SEC_SIZE);
-	return bwrite(bp);
+	bdwrite(bp);
+	return 0;
 }
 
 /*
@@ -165,96 +167,97 @@ fatfs_lookup_node(vnode_t dvp, char *name, struct fatfs_node *np)
 	return ENOENT;
 }
 
-/*
- * Get directory entry for specified index in sector.
- * The directory entry is filled if success.
- *
- * @fmp: fatfs mount point
- * @sec: sector#
- * @target: target index
- * @index: current index
- * @np: pointer to fat node
- */
-static int
-fat_get_dirent(struct fatfsmount *fmp, u_long sec, int target, int *index,
-	       struct fatfs_node *np)
-{
-	struct fat_dirent *de;
-	u_long i;
-	int err;
-
-	err = fat_read_dirent(fmp, sec);
-	if (err)
-		return err;
-
-	de = (struct fat_dirent *)fmp->dir_buf;
-	for (i = 0; i < DIR_PER_SEC; i++) {
-		if (IS_EMPTY(de))
-			return ENOENT;
-		if (!IS_DELETED(de) && !IS_VOL(de)) {
-			/* valid file */
-			if (*index == target) {
-				*(&np->dirent) = *de;
-				np->sector = sec;
-				np->offset = sizeof(struct fat_dirent) * i;
-				DPRINTF(("fat_get_dirent: found index=%d\n", *index));
-				return 0;
-			}
-			(*index)++;
-		}
-		DPRINTF(("fat_get_dirent: %s\n", de->name));
-		de++;
-	}
-	return EAGAIN;
-}
-
 /*
  * Get directory entry for specified index.
  *
+ * The search starts from the cursor when it is at or before the
+ * requested index, so a sequential read of the directory touches
+ * each sector only once.  The cursor is moved to the entry found.
+ *
  * @dvp: vnode for directory.
  * @index: index of the entry
+ * @dc: directory cursor of the open file
  * @np: pointer to fat node
  */
 int
-fatfs_get_node(vnode_t dvp, int index, struct fatfs_node *np)
+fatfs_get_node(vnode_t dvp, int index, struct fatfs_dircur *dc,
+	       struct fatfs_node *np)
 {
 	struct fatfsmount *fmp;
-	u_long i, cl, sec, sec_start;
+	struct fat_dirent *de;
+	u_long cl, sec, slot, sec_end;
 	int cur_index, err;
 
 	fmp = (struct fatfsmount *)dvp->v_mount->m_data;
-	cl = dvp->v_blkno;
-	cur_index = 0;
 
-	DPRINTF(("fatfs_get_node: index=%d\n", index));
-
-	if (cl == CL_ROOT && !(FAT32(fmp))) {
-		/* Get entry from the root directory */
-		sec_start = fmp->root_start;
-		for (sec = sec_start; sec < fmp->data_start; sec++) {
-			err = fat_get_dirent(fmp, sec, index, &cur_index, np);
-			if (err != EAGAIN)
-				return err;
+	DPRINTF(("fatfs_get_node: index=%d cursor=%d\n", index, dc->index));
+
+	if (dc->index >= 0 && dc->index <= index) {
+		/*
+		 * Resume at the cursor.  Start after the entry if it
+		 * was already returned, so removing it does not shift
+		 * the index of the entries that follow.
+		 */
+		cl = dc->cl;
+		sec = dc->sec;
+		slot = dc->slot;
+		cur_index = dc->index;
+		if (index > dc->index) {
+			slot++;
+			cur_index++;
 		}
 	} else {
-		if(cl == CL_ROOT)	/* CL_ROOT of FAT32 */
+		cl = dvp->v_blkno;
+		if (cl == CL_ROOT && FAT32(fmp))
 			cl = fmp->root_start;
-		/* Get entry from the sub directory */
-		while (!IS_EOFCL(fmp, cl)) {
+		if (cl == CL_ROOT)
+			sec = fmp->root_start;
+		else
 			sec = cl_to_sec(fmp, cl);
-			for (i = 0; i < fmp->sec_per_cl; i++) {
-				err = fat_get_dirent(fmp, sec, index,
-						     &cur_index, np);
-				if (err != EAGAIN)
-					return err;
-				sec++;
+		slot = 0;
+		cur_index = 0;
+	}
+
+	for (;;) {
+		if ((err = fat_read_dirent(fmp, sec)) != 0)
+			return err;
+		de = (struct fat_dirent *)fmp->dir_buf + slot;
+		for (; slot < DIR_PER_SEC; slot++, de++) {
+			if (IS_EMPTY(de))
+				return ENOENT;
+			if (IS_DELETED(de) || IS_VOL(de))
+				continue;
+			if (cur_index == index) {
+				*(&np->dirent) = *de;
+				np->sector = sec;
+				np->offset = sizeof(struct fat_dirent) * slot;
+				dc->index = index;
+				dc->cl = cl;
+				dc->sec = sec;
+				dc->slot = slot;
+				return 0;
 			}
-			err = fat_next_cluster(fmp, cl, &cl);
-			if (err)
-				return err;
+			cur_index++;
+		}
+		slot = 0;
+
+		/* Move to the next sector. */
+		sec++;
+		if (cl == CL_ROOT) {
+			/* The root directory of FAT12/16 */
+			if (sec >= fmp->data_start)
+				return ENOENT;
+			continue;
 		}
+		sec_end = cl_to_sec(fmp, cl) + fmp->sec_per_cl;
+		if (sec < sec_end)
+			continue;
+		if ((err = fat_next_cluster(fmp, cl, &cl)) != 0)
+			return err;
+		if (IS_EOFCL(fmp, cl))
+			return ENOENT;
+		sec = cl_to_sec(fmp, cl);
 	}
-	return ENOENT;
 }
 
 /*
@@ -303,7 +306,7 @@ fatfs_add_node(vnode_t dvp, struct fatfs_node *np)
 	struct fatfsmount *fmp;
 	u_long cl, sec, sec_start;
 	int err;
-	u_long i, next;
+	u_long i, last, next;
 
 	fmp = (struct fatfsmount *)dvp->v_mount->m_data;
 	cl = dvp->v_blkno;
@@ -322,6 +325,7 @@ fatfs_add_node(vnode_t dvp, struct fatfs_node *np)
 		/* Search entry in sub directory */
 		if(cl == CL_ROOT)	/* CL_ROOT of FAT32 */
 			cl = fmp->root_start;
+		last = cl;
 		while (!IS_EOFCL(fmp, cl)) {
 			sec = cl_to_sec(fmp, cl);
 			for (i = 0; i < fmp->sec_per_cl; i++) {
@@ -333,11 +337,12 @@ fatfs_add_node(vnode_t dvp, struct fatfs_node *np)
 			err = fat_next_cluster(fmp, cl, &next);
 			if (err)
 				return err;
+			last = cl;
 			cl = next;
 		}
 		/* No entry found, add one more free cluster for directory */
 		DPRINTF(("fatfs_add_node: expand dir\n"));
-		err = fat_expand_dir(fmp, cl, &next);
+		err = fat_expand_dir(fmp, last, &next);
 		if (err)
 			return err;
 
@@ -46,7 +46,7 @@
 
 static int fatfs_mount	(mount_t mp, char *dev, int flags, void *data);
 static int fatfs_unmount(mount_t mp);
-#define fatfs_sync	((vfsop_sync_t)vfs_nullop)
+static int fatfs_sync	(mount_t mp);
 static int fatfs_vget	(mount_t mp, vnode_t vp);
 #define fatfs_statfs	((vfsop_statfs_t)vfs_nullop)
 
@@ -106,6 +106,8 @@ fat_read_bpb(struct fatfsmount *fmp)
 	fatsize = bpb->sectors_per_fat;
 	if (fatsize == 0)
 		fatsize = bpb32->sectors_per_fat32;
+	fmp->fat_sectors = fatsize;
+	fmp->fat_count = bpb->num_of_fats;
 
 	fatsize *= bpb->num_of_fats;
 	fmp->fat_start = bpb->reserved_sectors;
@@ -121,10 +123,13 @@ fat_read_bpb(struct fatfsmount *fmp)
 	maxclust = (totalsect - fmp->data_start) / bpb->sectors_per_cluster;
 	fmp->last_cluster = maxclust + CL_FIRST;
 	fmp->free_scan = CL_FIRST;
+	fmp->fsinfo_sec = 0;
 
 	if (maxclust >= 0xFFF7) {
 		/* Root directory start cluster */
 		fmp->root_start = bpb32->root_clust;
+		if (bpb32->fsinfo != 0 && bpb32->fsinfo != 0xffff)
+			fmp->fsinfo_sec = bpb32->fsinfo;
 		fmp->fat_type = 32;
 		fmp->fat_mask = FAT32_MASK;
 		fmp->fat_eof = CL_EOF & FAT32_MASK;
@@ -182,7 +187,7 @@ fatfs_mount(mount_t mp, char *dev, int flags, void *data)
 		return ENOMEM;
 
 	fmp->dev = mp->m_dev;
-	if (fat_read_bpb(fmp) != 0)
+	if ((err = fat_read_bpb(fmp)) != 0)
 		goto err1;
 
 	err = ENOMEM;
@@ -198,11 +203,22 @@ fatfs_mount(mount_t mp, char *dev, int flags, void *data)
 	if (fmp->dir_buf == NULL)
 		goto err3;
 
+	if ((err = fat_cache_init(fmp)) != 0)
+		goto err4;
+
+	if ((err = fat_free_init(fmp)) != 0)
+		goto err5;
+
+	list_init(&fmp->resv_list);
 	mutex_init(&fmp->lock);
 	mp->m_data = fmp;
 	vp = mp->m_root;
 	vp->v_blkno = CL_ROOT;
 	return 0;
+ err5:
+	fat_cache_free(fmp);
+ err4:
+	free(fmp->dir_buf);
  err3:
 	free(fmp->fat_buf);
  err2:
@@ -221,6 +237,11 @@ fatfs_unmount(mount_t mp)
 	struct fatfsmount *fmp;
 
 	fmp = mp->m_data;
+	fat_cache_sync(fmp);
+	fat_free_sync(fmp);
+	fat_cache_free(fmp);
+	if (fmp->free_map != NULL)
+		free(fmp->free_map);
 	free(fmp->dir_buf);
 	free(fmp->fat_buf);
 	free(fmp->io_buf);
@@ -229,6 +250,22 @@ fatfs_unmount(mount_t mp)
 	return 0;
 }
 
+/*
+ * Write back the cached FAT and the FSInfo sector.
+ */
+static int
+fatfs_sync(mount_t mp)
+{
+	struct fatfsmount *fmp;
+
+	fmp = mp->m_data;
+	mutex_lock(&fmp->lock);
+	fat_cache_sync(fmp);
+	fat_free_sync(fmp);
+	mutex_unlock(&fmp->lock);
+	return 0;
+}
+
 /*
  * Prepare the FAT specific node and fill the vnode.
  */
@@ -240,6 +277,9 @@ fatfs_vget(mount_t mp, vnode_t vp)
 	np = malloc(sizeof(struct fatfs_node));
 	if (np == NULL)
 		return ENOMEM;
+	np->resv_len = 0;
+	np->nopens = 0;
+	np->extmap = NULL;
 	vp->v_data = np;
 	return 0;
 }
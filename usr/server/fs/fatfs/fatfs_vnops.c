@@ -29,6 +29,7 @@
 
 #include <prex/prex.h>
 
+#include <sys/param.h>
 #include <sys/vnode.h>
 #include <sys/file.h>
 #include <sys/mount.h>
@@ -51,13 +52,13 @@
 #define TEMP_DATE   0x3021
 #define TEMP_TIME   0
 
-#define fatfs_open	((vnop_open_t)vop_nullop)
-#define fatfs_close	((vnop_close_t)vop_nullop)
+static int fatfs_open	(vnode_t, int, mode_t);
+static int fatfs_close	(vnode_t, file_t);
 static int fatfs_read	(vnode_t, file_t, void *, size_t, size_t *);
 static int fatfs_write	(vnode_t, file_t, void *, size_t, size_t *);
 #define fatfs_seek	((vnop_seek_t)vop_nullop)
 #define fatfs_ioctl	((vnop_ioctl_t)vop_einval)
-#define fatfs_fsync	((vnop_fsync_t)vop_nullop)
+static int fatfs_fsync	(vnode_t, file_t);
 static int fatfs_readdir(vnode_t, file_t, struct dirent *);
 static int fatfs_lookup	(vnode_t, char *, vnode_t);
 static int fatfs_create	(vnode_t, char *, int, mode_t);
@@ -70,6 +71,7 @@ static int fatfs_getattr(vnode_t, struct vattr *);
 static int fatfs_setattr(vnode_t, struct vattr *);
 static int fatfs_inactive(vnode_t);
 static int fatfs_truncate(vnode_t);
+#define fatfs_poll	((vnop_poll_t)vop_pollready)
 
 /*
  * vnode operations
@@ -94,6 +96,7 @@ struct vnops fatfs_vnops = {
 	fatfs_setattr,		/* setattr */
 	fatfs_inactive,		/* inactive */
 	fatfs_truncate,		/* truncate */
+	fatfs_poll,		/* poll */
 };
 
 /*
@@ -102,12 +105,9 @@ struct vnops fatfs_vnops = {
 static int
 fat_read_cluster(struct fatfsmount *fmp, u_long cluster)
 {
-	u_long sec;
-	size_t size;
 
-	sec = cl_to_sec(fmp, cluster);
-	size = fmp->sec_per_cl * SEC_SIZE;
-	return device_read(fmp->dev, fmp->io_buf, &size, sec);
+	return bread_cluster(fmp->dev, cl_to_sec(fmp, cluster),
+			     fmp->sec_per_cl, fmp->io_buf);
 }
 
 /*
@@ -116,12 +116,9 @@ fat_read_cluster(struct fatfsmount *fmp, u_long cluster)
 static int
 fat_write_cluster(struct fatfsmount *fmp, u_long cluster)
 {
-	u_long sec;
-	size_t size;
 
-	sec = cl_to_sec(fmp, cluster);
-	size = fmp->sec_per_cl * SEC_SIZE;
-	return device_write(fmp->dev, fmp->io_buf, &size, sec);
+	return bwrite_cluster(fmp->dev, cl_to_sec(fmp, cluster),
+			      fmp->sec_per_cl, fmp->io_buf);
 }
 
 /*
@@ -163,12 +160,41 @@ fatfs_lookup(vnode_t dvp, char *name, vnode_t vp)
 	return 0;
 }
 
+/*
+ * Find the run of contiguous clusters which starts at the
+ * specified cluster.
+ *
+ * @fmp: fat mount data
+ * @cl: first cluster# of the run
+ * @max: max number of clusters in the run
+ * @end: last cluster# of the run to return
+ * @next: cluster# following the run to return
+ */
+static int
+fat_cluster_run(struct fatfsmount *fmp, u_long cl, u_long max, u_long *end,
+		u_long *next)
+{
+	u_long c, n;
+	int err;
+
+	for (c = cl;; c++) {
+		if ((err = fat_next_cluster(fmp, c, &n)) != 0)
+			return err;
+		if (n != c + 1 || c - cl + 1 >= max)
+			break;
+	}
+	*end = c;
+	*next = n;
+	return 0;
+}
+
 static int
 fatfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct fatfsmount *fmp;
-	int nr_read, nr_copy, buf_pos, err;
-	u_long cl, file_pos;
+	struct buf *bp;
+	int nr_read, nr_copy, buf_pos, nra, err;
+	u_long cl, sec, run_end, run_next, file_pos, last_sec, ra_max;
 
 	DPRINTF(("fatfs_read: vp=%x\n", vp));
 
@@ -190,41 +216,90 @@ fatfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	/* Get the actual read size. */
 	if (vp->v_size - file_pos < size)
 		size = vp->v_size - file_pos;
+	last_sec = (vp->v_size - 1) / SEC_SIZE;
+
+	/* Runs for read-ahead are limited to its window. */
+	ra_max = MAX(MAXRABLKS / fmp->sec_per_cl, 1);
 
 	/* Seek to the cluster for the file offset */
-	err = fat_seek_cluster(fmp, vp->v_blkno, file_pos, &cl);
+	err = fat_seek_cluster(fmp, vp->v_data, vp->v_blkno, file_pos,
+	    &cl);
+	if (err)
+		goto out;
+	err = fat_cluster_run(fmp, cl, ra_max, &run_end, &run_next);
 	if (err)
 		goto out;
 
-	/* Read and copy data */
+	/* Read and copy data with read-ahead */
 	nr_read = 0;
-	buf_pos = file_pos % fmp->cluster_size;
-	do {
-		if (fat_read_cluster(fmp, cl)) {
-			err = EIO;
-			goto out;
+	for (;;) {
+		/* Whole clusters are read directly to the caller. */
+		if (file_pos % fmp->cluster_size == 0 &&
+		    size >= fmp->cluster_size) {
+			err = fat_cluster_run(fmp, cl, size / fmp->cluster_size,
+					      &run_end, &run_next);
+			if (err)
+				goto out;
+			err = bread_direct(fmp->dev, cl_to_sec(fmp, cl),
+				(run_end - cl + 1) * fmp->sec_per_cl, buf);
+			if (err)
+				goto out;
+			nr_copy = (run_end - cl + 1) * fmp->cluster_size;
+			file_pos += nr_copy;
+			nr_read += nr_copy;
+			size -= nr_copy;
+			if (size <= 0)
+				break;
+			buf = (void *)((u_long)buf + nr_copy);
+			cl = run_next;
+			if (IS_EOFCL(fmp, cl))
+				break;
+			err = fat_cluster_run(fmp, cl, ra_max, &run_end,
+					      &run_next);
+			if (err)
+				goto out;
+			continue;
 		}
 
-		nr_copy = fmp->cluster_size;
-		if (buf_pos > 0)
-			nr_copy -= buf_pos;
-		if (buf_pos + size < fmp->cluster_size)
-			nr_copy = size;
-		memcpy(buf, fmp->io_buf + buf_pos, nr_copy);
+		sec = (file_pos % fmp->cluster_size) / SEC_SIZE;
+		buf_pos = file_pos % SEC_SIZE;
+
+		/* Sectors left in this run of clusters and in file. */
+		nra = (run_end - cl + 1) * fmp->sec_per_cl - sec - 1;
+		if (nra > (int)(last_sec - file_pos / SEC_SIZE))
+			nra = last_sec - file_pos / SEC_SIZE;
+
+		sec += cl_to_sec(fmp, cl);
+		err = breada(fmp->dev, sec, nra, &vp->v_ra, &bp);
+		if (err)
+			goto out;
+
+		nr_copy = MIN(SEC_SIZE - buf_pos, (int)size);
+		memcpy(buf, bp->b_data + buf_pos, nr_copy);
+		brelse(bp);
 
 		file_pos += nr_copy;
 		nr_read += nr_copy;
 		size -= nr_copy;
 		if (size <= 0)
 			break;
-
-		err = fat_next_cluster(fmp, cl, &cl);
-		if (err)
-			goto out;
-
 		buf = (void *)((u_long)buf + nr_copy);
-		buf_pos = 0;
-	} while (!IS_EOFCL(fmp, cl));
+
+		/* Move to the next cluster. */
+		if (file_pos % fmp->cluster_size == 0) {
+			if (cl != run_end) {
+				cl++;
+				continue;
+			}
+			cl = run_next;
+			if (IS_EOFCL(fmp, cl))
+				break;
+			err = fat_cluster_run(fmp, cl, ra_max, &run_end,
+					      &run_next);
+			if (err)
+				goto out;
+		}
+	}
 
 	fp->f_offset = file_pos;
 	*result = nr_read;
@@ -240,9 +315,10 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	struct fatfsmount *fmp;
 	struct fatfs_node *np;
 	struct fat_dirent *de;
-	int nr_copy, nr_write, buf_pos, i, cl_size, err;
-	off_t file_pos, end_pos;
-	u_long cl;
+	struct buf *bp;
+	int nr_copy, nr_write, buf_pos, err;
+	off_t file_pos, end_pos, old_size;
+	u_long cl, sec, run_end, run_next;
 
 	DPRINTF(("fatfs_write: vp=%x size=%d\n", vp, size));
 
@@ -257,19 +333,21 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	mutex_lock(&fmp->lock);
 
 	/* Check if file position exceeds the end of file. */
+	old_size = vp->v_size;
 	end_pos = vp->v_size;
 	file_pos = (fp->f_flags & O_APPEND) ? end_pos : fp->f_offset;
 	if ((off_t)(file_pos + size) > end_pos) {
 		/* Expand the file size before writing to it */
 		end_pos = file_pos + size;
-		err = fat_expand_file(fmp, vp->v_blkno, end_pos);
+		np = vp->v_data;
+		err = fat_expand_file(fmp,
+		    file_pos == (off_t)vp->v_size ? np : NULL, vp->v_blkno, end_pos);
 		if (err) {
 			err = EIO;
 			goto out;
 		}
 
 		/* Update directory entry */
-		np = vp->v_data;
 		de = &np->dirent;
 		de->size = end_pos;
 		err = fatfs_put_node(fmp, np);
@@ -279,47 +357,72 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	}
 
 	/* Seek to the cluster for the file offset */
-	err = fat_seek_cluster(fmp, vp->v_blkno, file_pos, &cl);
+	err = fat_seek_cluster(fmp, vp->v_data, vp->v_blkno, file_pos,
+	    &cl);
 	if (err)
 		goto out;
 
-	buf_pos = file_pos % fmp->cluster_size;
-	cl_size = size / fmp->cluster_size + 1;
 	nr_write = 0;
-	i = 0;
-	do {
-		/* First and last cluster must be read before write */
-		if (i == 0 || i == cl_size) {
-			if (fat_read_cluster(fmp, cl)) {
-				err = EIO;
+	for (;;) {
+		/* Whole clusters are written directly from the caller. */
+		if (file_pos % fmp->cluster_size == 0 &&
+		    size >= fmp->cluster_size) {
+			err = fat_cluster_run(fmp, cl, size / fmp->cluster_size,
+					      &run_end, &run_next);
+			if (err)
 				goto out;
-			}
+			err = bwrite_cluster(fmp->dev, cl_to_sec(fmp, cl),
+				(run_end - cl + 1) * fmp->sec_per_cl, buf);
+			if (err)
+				goto out;
+			nr_copy = (run_end - cl + 1) * fmp->cluster_size;
+			file_pos += nr_copy;
+			nr_write += nr_copy;
+			size -= nr_copy;
+			if (size <= 0)
+				break;
+			buf = (void *)((u_long)buf + nr_copy);
+			cl = run_next;
+			if (IS_EOFCL(fmp, cl))
+				break;
+			continue;
 		}
-		nr_copy = fmp->cluster_size;
-		if (buf_pos > 0)
-			nr_copy -= buf_pos;
-		if (buf_pos + size < fmp->cluster_size)
-			nr_copy = size;
-		memcpy(fmp->io_buf + buf_pos, buf, nr_copy);
-
-		if (fat_write_cluster(fmp, cl)) {
-			err = EIO;
+
+		sec = cl_to_sec(fmp, cl) +
+			(file_pos % fmp->cluster_size) / SEC_SIZE;
+		buf_pos = file_pos % SEC_SIZE;
+		nr_copy = MIN(SEC_SIZE - buf_pos, (int)size);
+
+		/*
+		 * Partial sector must be read before write, unless
+		 * it lies past the old end of file.
+		 */
+		if (nr_copy == SEC_SIZE)
+			bp = getblk(fmp->dev, sec);
+		else if (file_pos - buf_pos >= old_size) {
+			bp = getblk(fmp->dev, sec);
+			memset(bp->b_data, 0, SEC_SIZE);
+		} else if ((err = bread(fmp->dev, sec, &bp)) != 0)
 			goto out;
-		}
+		memcpy(bp->b_data + buf_pos, buf, nr_copy);
+		bdwrite(bp);
+
 		file_pos += nr_copy;
 		nr_write += nr_copy;
 		size -= nr_copy;
 		if (size <= 0)
 			break;
-
-		err = fat_next_cluster(fmp, cl, &cl);
-		if (err)
-			goto out;
-
 		buf = (void *)((u_long)buf + nr_copy);
-		buf_pos = 0;
-		i++;
-	} while (!IS_EOFCL(fmp, cl));
+
+		/* Move to the next cluster. */
+		if (file_pos % fmp->cluster_size == 0) {
+			err = fat_next_cluster(fmp, cl, &cl);
+			if (err)
+				goto out;
+			if (IS_EOFCL(fmp, cl))
+				break;
+		}
+	}
 
 	fp->f_offset = file_pos;
 
@@ -333,22 +436,89 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	*result = nr_write;
 	err = 0;
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
 
+/*
+ * Write back the delayed write blocks.
+ */
+static int
+fatfs_fsync(vnode_t vp, file_t fp)
+{
+	struct fatfsmount *fmp;
+
+	fmp = vp->v_mount->m_data;
+	mutex_lock(&fmp->lock);
+	fat_cache_sync(fmp);
+	fat_free_sync(fmp);
+	mutex_unlock(&fmp->lock);
+	return bio_sync();
+}
+
+/*
+ * Free the directory cursor.
+ */
+static int
+fatfs_open(vnode_t vp, int flags, mode_t mode)
+{
+	struct fatfsmount *fmp;
+	struct fatfs_node *np;
+
+	fmp = vp->v_mount->m_data;
+	mutex_lock(&fmp->lock);
+	np = vp->v_data;
+	np->nopens++;
+	mutex_unlock(&fmp->lock);
+	return 0;
+}
+
+static int
+fatfs_close(vnode_t vp, file_t fp)
+{
+	struct fatfsmount *fmp;
+	struct fatfs_node *np;
+
+	if (fp->f_data != NULL) {
+		free(fp->f_data);
+		fp->f_data = NULL;
+	}
+
+	/*
+	 * The vnode may stay cached long after the last close.
+	 * Give back the clusters reserved for appends now.
+	 */
+	fmp = vp->v_mount->m_data;
+	mutex_lock(&fmp->lock);
+	np = vp->v_data;
+	if (np->nopens > 0 && --np->nopens == 0)
+		fat_release(fmp, np);
+	mutex_unlock(&fmp->lock);
+	return 0;
+}
+
 static int
 fatfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 {
 	struct fatfsmount *fmp;
 	struct fatfs_node np;
+	struct fatfs_dircur *dc;
 	struct fat_dirent *de;
 	int err;
 
 	fmp = vp->v_mount->m_data;
 	mutex_lock(&fmp->lock);
 
-	err = fatfs_get_node(vp, fp->f_offset, &np);
+	if ((dc = fp->f_data) == NULL) {
+		if ((dc = malloc(sizeof(struct fatfs_dircur))) == NULL) {
+			err = ENOMEM;
+			goto out;
+		}
+		dc->index = -1;
+		fp->f_data = dc;
+	}
+	err = fatfs_get_node(vp, fp->f_offset, dc, &np);
 	if (err)
 		goto out;
 	de = &np.dirent;
@@ -363,6 +533,8 @@ fatfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 
 	dir->d_fileno = fp->f_offset;
 	dir->d_namlen = strlen(dir->d_name);
+	dir->d_size = de->size;
+	dir->d_mode = ALLPERMS;
 
 	fp->f_offset++;
 	err = 0;
@@ -394,8 +566,14 @@ fatfs_create(vnode_t dvp, char *name, int flags, mode_t mode)
 	fmp = dvp->v_mount->m_data;
 	mutex_lock(&fmp->lock);
 
-	/* Allocate free cluster for new file. */
+	/*
+	 * Allocate free cluster for new file.  It is marked used
+	 * now, since adding the entry may expand the directory.
+	 */
 	err = fat_alloc_cluster(fmp, 0, &cl);
+	if (err)
+		goto out;
+	err = fat_set_cluster(fmp, cl, fmp->fat_eof);
 	if (err)
 		goto out;
 
@@ -409,9 +587,9 @@ fatfs_create(vnode_t dvp, char *name, int flags, mode_t mode)
 	fat_mode_to_attr(mode, &de->attr);
 	err = fatfs_add_node(dvp, &np);
 	if (err)
-		goto out;
-	err = fat_set_cluster(fmp, cl, fmp->fat_eof);
+		fat_set_cluster(fmp, cl, CL_FREE);
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
@@ -444,6 +622,8 @@ fatfs_remove(vnode_t dvp, vnode_t vp, char *name)
 	}
 
 	/* Remove clusters */
+	if (vp != NULL)
+		fat_release(fmp, vp->v_data);
 	err = fat_free_clusters(fmp, (de->cluster_hi << 16) | de->cluster);
 	if (err)
 		goto out;
@@ -452,6 +632,7 @@ fatfs_remove(vnode_t dvp, vnode_t vp, char *name)
 	de->name[0] = 0xe5;
 	err = fatfs_put_node(fmp, &np);
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
@@ -475,7 +656,7 @@ fatfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 
 	if (IS_FILE(de1)) {
 		/* Remove destination file, first */
-		err = fatfs_remove(dvp2, vp1, name2);
+		err = fatfs_remove(dvp2, vp2, name2);
 		if (err == EIO)
 			goto out;
 
@@ -495,7 +676,7 @@ fatfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 				goto out;
 
 			/* Remove souce file */
-			err = fatfs_remove(dvp1, vp2, name1);
+			err = fatfs_remove(dvp1, vp1, name1);
 			if (err)
 				goto out;
 		}
@@ -550,6 +731,7 @@ fatfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 		}
 	}
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
@@ -574,6 +756,9 @@ fatfs_mkdir(vnode_t dvp, char *name, mode_t mode)
 
 	/* Allocate free cluster for directory data */
 	err = fat_alloc_cluster(fmp, 0, &cl);
+	if (err)
+		goto out;
+	err = fat_set_cluster(fmp, cl, fmp->fat_eof);
 	if (err)
 		goto out;
 
@@ -586,8 +771,10 @@ fatfs_mkdir(vnode_t dvp, char *name, mode_t mode)
 	de->date = TEMP_DATE;
 	fat_mode_to_attr(mode, &de->attr);
 	err = fatfs_add_node(dvp, &np);
-	if (err)
+	if (err) {
+		fat_set_cluster(fmp, cl, CL_FREE);
 		goto out;
+	}
 
 	/* Initialize "." and ".." for new directory */
 	memset(fmp->io_buf, 0, fmp->cluster_size);
@@ -607,13 +794,10 @@ fatfs_mkdir(vnode_t dvp, char *name, mode_t mode)
 	de->time = TEMP_TIME;
 	de->date = TEMP_DATE;
 
-	if (fat_write_cluster(fmp, cl)) {
+	if (fat_write_cluster(fmp, cl))
 		err = EIO;
-		goto out;
-	}
-	/* Add eof */
-	err = fat_set_cluster(fmp, cl, fmp->fat_eof);
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
@@ -655,6 +839,7 @@ fatfs_rmdir(vnode_t dvp, vnode_t vp, char *name)
 
 	err = fatfs_put_node(fmp, &np);
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
@@ -677,8 +862,18 @@ fatfs_setattr(vnode_t vp, struct vattr *vap)
 static int
 fatfs_inactive(vnode_t vp)
 {
+	struct fatfsmount *fmp;
+	struct fatfs_node *np;
 
-	free(vp->v_data);
+	/* Give back the clusters reserved for appends. */
+	fmp = vp->v_mount->m_data;
+	mutex_lock(&fmp->lock);
+	np = vp->v_data;
+	fat_release(fmp, np);
+	mutex_unlock(&fmp->lock);
+	if (np->extmap != NULL)
+		free(np->extmap);
+	free(np);
 	return 0;
 }
 
@@ -688,6 +883,7 @@ fatfs_truncate(vnode_t vp)
 	struct fatfsmount *fmp;
 	struct fatfs_node *np;
 	struct fat_dirent *de;
+	u_long cl, next;
 	int err;
 
 	fmp = vp->v_mount->m_data;
@@ -695,11 +891,27 @@ fatfs_truncate(vnode_t vp)
 
 	np = vp->v_data;
 	de = &np->dirent;
+	fat_release(fmp, np);
+	fat_extmap_clear(np);
 
-	/* Remove clusters */
-	err = fat_free_clusters(fmp, (de->cluster_hi << 16) | de->cluster);
-	if (err)
-		goto out;
+	/*
+	 * Keep the first cluster which the directory entry still
+	 * points to, and remove the rest of the chain.
+	 */
+	cl = (de->cluster_hi << 16) | de->cluster;
+	if (cl >= CL_FIRST) {
+		err = fat_next_cluster(fmp, cl, &next);
+		if (err)
+			goto out;
+		if (!IS_EOFCL(fmp, next)) {
+			err = fat_free_clusters(fmp, next);
+			if (err)
+				goto out;
+			err = fat_set_cluster(fmp, cl, fmp->fat_eof);
+			if (err)
+				goto out;
+		}
+	}
 
 	de->size = 0;
 
@@ -709,6 +921,7 @@ fatfs_truncate(vnode_t vp)
 
 	vp->v_size = 0;
  out:
+	fat_cache_sync(fmp);
 	mutex_unlock(&fmp->lock);
 	return err;
 }
@@ -45,6 +45,16 @@
 #define ASSERT(e)
 #endif
 
+/*
+ * The pipe buffer starts with PIPE_BUF bytes, and it is doubled
+ * while a writer finds it full, up to FIFO_MAX bytes.
+ */
+#ifdef CONFIG_PIPE_MAX
+#define FIFO_MAX	CONFIG_PIPE_MAX
+#else
+#define FIFO_MAX	PIPE_BUF
+#endif
+
 #if CONFIG_FS_THREADS > 1
 #define malloc(s)		malloc_r(s)
 #define free(p)			free_r(p)
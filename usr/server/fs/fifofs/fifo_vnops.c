@@ -39,6 +39,8 @@
 #include <sys/syslog.h>
 #include <sys/dirent.h>
 #include <sys/list.h>
+#include <sys/param.h>
+#include <sys/poll.h>
 
 #include <ctype.h>
 #include <unistd.h>
@@ -62,6 +64,11 @@ struct fifo_node {
 	int	fn_start;	/* start offset of buffer data */
 	size_t	fn_size;	/* size of buffer data */
 	char	*fn_buf;	/* pointer to buffer */
+	size_t	fn_bufsize;	/* allocated buffer size */
+	file_t	fn_rfp;		/* reader waiting for direct copy */
+	char	*fn_rbuf;	/* buffer of the waiting reader */
+	size_t	fn_rsize;	/* size of fn_rbuf */
+	size_t	fn_rdone;	/* bytes copied to fn_rbuf */
 };
 
 #define fifo_mount	((vfsop_mount_t)vfs_nullop)
@@ -89,6 +96,7 @@ static int fifo_remove	(vnode_t, vnode_t, char *);
 #define fifo_setattr	((vnop_setattr_t)vop_nullop)
 #define fifo_inactive	((vnop_inactive_t)vop_nullop)
 #define fifo_truncate	((vnop_truncate_t)vop_nullop)
+static int fifo_poll	(vnode_t, file_t, int, int *);
 
 static void wait_reader(vnode_t);
 static void wakeup_reader(vnode_t);
@@ -124,6 +132,7 @@ struct vnops fifofs_vnops = {
 	fifo_setattr,		/* setattr */
 	fifo_inactive,		/* inactive */
 	fifo_truncate,		/* truncate */
+	fifo_poll,		/* poll */
 };
 
 /*
@@ -210,12 +219,76 @@ fifo_close(vnode_t vp, file_t fp)
 	return 0;
 }
 
+/*
+ * Copy data out of the ring buffer.
+ */
+static void
+fifo_copyout(struct fifo_node *np, char *p, size_t nbytes)
+{
+	size_t len;
+
+	len = MIN(nbytes, np->fn_bufsize - np->fn_start);
+	memcpy(p, np->fn_buf + np->fn_start, len);
+	memcpy(p + len, np->fn_buf, nbytes - len);
+	np->fn_start += nbytes;
+	if (np->fn_start >= (int)np->fn_bufsize)
+		np->fn_start -= np->fn_bufsize;
+	np->fn_size -= nbytes;
+}
+
+/*
+ * Copy data into the ring buffer.
+ */
+static void
+fifo_copyin(struct fifo_node *np, char *p, size_t nbytes)
+{
+	size_t pos, len;
+
+	pos = np->fn_start + np->fn_size;
+	if (pos >= np->fn_bufsize)
+		pos -= np->fn_bufsize;
+	len = MIN(nbytes, np->fn_bufsize - pos);
+	memcpy(np->fn_buf + pos, p, len);
+	memcpy(np->fn_buf, p + len, nbytes - len);
+	np->fn_size += nbytes;
+}
+
+/*
+ * Grow the ring buffer to hold at least size bytes, up to
+ * FIFO_MAX.  Returns 0 if the buffer can not grow.
+ */
+static int
+fifo_grow(struct fifo_node *np, size_t size)
+{
+	size_t newsize;
+	char *buf;
+
+	if (np->fn_bufsize >= FIFO_MAX)
+		return 0;
+	newsize = np->fn_bufsize * 2;
+	while (newsize < size && newsize < FIFO_MAX)
+		newsize *= 2;
+	if (newsize > FIFO_MAX)
+		newsize = FIFO_MAX;
+	if ((buf = malloc(newsize)) == NULL)
+		return 0;
+
+	/* Move the data to the head of new buffer. */
+	size = np->fn_size;
+	fifo_copyout(np, buf, size);
+	free(np->fn_buf);
+	np->fn_buf = buf;
+	np->fn_bufsize = newsize;
+	np->fn_start = 0;
+	np->fn_size = size;
+	return 1;
+}
+
 static int
 fifo_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct fifo_node *np = vp->v_data;
-	char *p = buf;
-	size_t pos, nbytes;
+	size_t nbytes;
 
 	DPRINTF(("fifo_read\n"));
 
@@ -231,24 +304,33 @@ fifo_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 			return 0;
 		}
 		/*
- 		 * wait for data
+		 * Wait for data.  If no other reader is waiting,
+		 * let the writer copy the data directly to our
+		 * buffer.
 		 */
+		if (np->fn_rfp != NULL) {
+			wait_writer(vp);
+			continue;
+		}
+		np->fn_rfp = fp;
+		np->fn_rbuf = buf;
+		np->fn_rsize = size;
+		np->fn_rdone = 0;
 		wait_writer(vp);
+		nbytes = np->fn_rdone;
+		np->fn_rfp = NULL;
+		if (nbytes > 0) {
+			*result = nbytes;
+			wakeup_writer(vp);
+			return 0;
+		}
 	}
 	/*
 	 * Read
 	 */
-	nbytes = (np->fn_size < size) ? np->fn_size : size;
-	np->fn_size -= nbytes;
+	nbytes = MIN(np->fn_size, size);
+	fifo_copyout(np, buf, nbytes);
 	*result = nbytes;
-	pos = np->fn_start;
-	while (nbytes > 0) {
-		*p++ = np->fn_buf[pos];
-		if (++pos > PIPE_BUF)
-			pos = 0;
-		nbytes--;
-	}
-	np->fn_start = pos;
 
 	wakeup_writer(vp);
 	return 0;
@@ -259,43 +341,91 @@ fifo_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct fifo_node *np = vp->v_data;
 	char *p = buf;
-	size_t pos, nfree, nbytes;
+	size_t nfree, nbytes, total;
 
 	DPRINTF(("fifo_write\n"));
 
- again:
-	/*
-	 * If the pipe is full,
-	 * wait for reads to deplete
-	 * and truncate it.
-	 */
-	while (np->fn_size >= PIPE_BUF)
-		wait_reader(vp);
+	total = 0;
+	while (size > 0) {
+		if (np->fn_readers == 0) {
+			if (total == 0)
+				return EPIPE;
+			break;
+		}
 
-	/*
-	 * Write
-	 */
-	nfree = PIPE_BUF - np->fn_size;
-	nbytes = (nfree < size) ? nfree : size;
+		/*
+		 * If a reader waits on the empty pipe, copy
+		 * to its buffer directly.
+		 */
+		if (np->fn_size == 0 && np->fn_rfp != NULL &&
+		    np->fn_rdone == 0) {
+			nbytes = MIN(np->fn_rsize, size);
+			memcpy(np->fn_rbuf, p, nbytes);
+			np->fn_rdone = nbytes;
+			p += nbytes;
+			size -= nbytes;
+			total += nbytes;
+			wakeup_reader(vp);
+			continue;
+		}
 
-	pos = np->fn_start + np->fn_size;
-	if (pos >= PIPE_BUF)
-		pos -= PIPE_BUF;
-	np->fn_size += nbytes;
-	size -= nbytes;
-	while (nbytes > 0) {
-		np->fn_buf[pos] = *p++;
-		if (++pos > PIPE_BUF)
-			pos = 0;
-		nbytes--;
+		/*
+		 * If the pipe is full, grow the buffer, or
+		 * wait for reads to deplete.
+		 */
+		nfree = np->fn_bufsize - np->fn_size;
+		if (nfree < size && fifo_grow(np, np->fn_size + size))
+			nfree = np->fn_bufsize - np->fn_size;
+		if (nfree == 0) {
+			wait_reader(vp);
+			continue;
+		}
+
+		/*
+		 * Write
+		 */
+		nbytes = MIN(nfree, size);
+		fifo_copyin(np, p, nbytes);
+		p += nbytes;
+		size -= nbytes;
+		total += nbytes;
+
+		wakeup_reader(vp);
 	}
 
-	wakeup_reader(vp);
+	*result = total;
+	return 0;
+}
+
+/*
+ * Data can be read when the pipe is not empty, and written
+ * while it has space or can grow.  A reader sees POLLHUP when
+ * there is no writer, and a writer sees POLLERR when there is
+ * no reader.
+ */
+static int
+fifo_poll(vnode_t vp, file_t fp, int events, int *revents)
+{
+	struct fifo_node *np = vp->v_data;
+	int mask = 0;
 
-	if (size > 0)
-		goto again;
+	if (np == NULL)
+		return vop_pollready(vp, fp, events, revents);
 
-	*result = size;
+	if (fp->f_flags & FREAD) {
+		if (np->fn_size > 0)
+			mask |= events & (POLLIN | POLLRDNORM);
+		else if (np->fn_writers == 0)
+			mask |= POLLHUP;
+	}
+	if (fp->f_flags & FWRITE) {
+		if (np->fn_readers == 0)
+			mask |= POLLERR;
+		else if (np->fn_size < np->fn_bufsize ||
+			 np->fn_bufsize < FIFO_MAX)
+			mask |= events & POLLOUT;
+	}
+	*revents = mask;
 	return 0;
 }
 
@@ -377,6 +507,8 @@ fifo_create(vnode_t dvp, char *name, int flags, mode_t mode)
 	np->fn_writers = 0;
 	np->fn_start = 0;
 	np->fn_size = 0;
+	np->fn_bufsize = PIPE_BUF;
+	np->fn_rfp = NULL;
 
 	mutex_lock(&fifo_lock);
 	list_insert(&fifo_head, &np->fn_link);
@@ -437,6 +569,7 @@ fifo_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 		}
 		dir->d_type = DT_FIFO;
 		strcpy((char *)&dir->d_name, np->fn_name);
+		dir->d_mode = ALLPERMS;
 	}
 	dir->d_fileno = fp->f_offset;
 	dir->d_namlen = strlen(dir->d_name);
@@ -461,8 +594,8 @@ wait_reader(vnode_t vp)
 	struct fifo_node *np = vp->v_data;
 
 	DPRINTF(("wait_reader: %x\n", np));
-	vn_unlock(vp);
 	mutex_lock(&np->fn_rmtx);
+	vn_unlock(vp);
 	cond_wait(&np->fn_rcond, &np->fn_rmtx, 0);
 	mutex_unlock(&np->fn_rmtx);
 	vn_lock(vp);
@@ -474,7 +607,10 @@ wakeup_writer(vnode_t vp)
 	struct fifo_node *np = vp->v_data;
 
 	DPRINTF(("wakeup_writer: %x\n", np));
+	mutex_lock(&np->fn_rmtx);
 	cond_broadcast(&np->fn_rcond);
+	mutex_unlock(&np->fn_rmtx);
+	vn_pollwakeup(vp);
 }
 
 static void
@@ -483,8 +619,8 @@ wait_writer(vnode_t vp)
 	struct fifo_node *np = vp->v_data;
 
 	DPRINTF(("wait_writer: %x\n", np));
-	vn_unlock(vp);
 	mutex_lock(&np->fn_wmtx);
+	vn_unlock(vp);
 	cond_wait(&np->fn_wcond, &np->fn_wmtx, 0);
 	mutex_unlock(&np->fn_wmtx);
 	vn_lock(vp);
@@ -496,5 +632,8 @@ wakeup_reader(vnode_t vp)
 	struct fifo_node *np = vp->v_data;
 
 	DPRINTF(("wakeup_reader: %x\n", np));
+	mutex_lock(&np->fn_wmtx);
 	cond_broadcast(&np->fn_wcond);
+	mutex_unlock(&np->fn_wmtx);
+	vn_pollwakeup(vp);
 }
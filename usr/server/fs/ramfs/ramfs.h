@@ -55,18 +55,47 @@
 #define mutex_trylock(m)	do {} while (0)
 #endif
 
+/*
+ * Initial number of hash buckets of a directory.  The table is
+ * doubled when the directory has more entries than buckets.
+ */
+#define RAMFS_HASH_MIN	8
+
+/*
+ * The fifo buffer starts with PIPE_BUF bytes, and it is doubled
+ * while a writer finds it full, up to RAMFS_FIFO_MAX bytes.
+ */
+#ifdef CONFIG_PIPE_MAX
+#define RAMFS_FIFO_MAX	CONFIG_PIPE_MAX
+#else
+#define RAMFS_FIFO_MAX	PIPE_BUF
+#endif
+
 /*
  * File/directory node for RAMFS
  */
 struct ramfs_node {
 	struct	ramfs_node *rn_next;   /* next node in the same directory */
+	struct	ramfs_node *rn_prev;   /* previous node in the same directory */
 	struct	ramfs_node *rn_child;  /* first child node */
+	struct	ramfs_node *rn_last;   /* last child node */
+	struct	ramfs_node *rn_hnext;  /* next node in the same hash bucket */
+	struct	ramfs_node **rn_hash;  /* dir: hash table of child nodes */
+	size_t	 rn_hashsize;	/* dir: number of hash buckets */
+	size_t	 rn_nchild;	/* dir: number of child nodes */
+	struct	ramfs_node *rn_rdnode; /* dir: node returned by last readdir */
+	off_t	 rn_rdindex;	/* dir: index of rn_rdnode */
+	u_long	 rn_nextseq;	/* dir: sequence number of next child */
+	u_long	 rn_seq;	/* order in the parent directory */
 	int	 rn_type;	/* file or directory */
 	char	*rn_name;	/* name (null-terminated) */
 	size_t	 rn_namelen;	/* length of name not including terminator */
 	size_t	 rn_size;	/* file size */
-	char	*rn_buf;	/* buffer to the file data */
-	size_t	 rn_bufsize;	/* allocated buffer size */
+	char	*rn_buf;	/* fifo: buffer to the data */
+	size_t	 rn_bufsize;	/* fifo: count of bytes written */
+	size_t	 rn_fifosize;	/* fifo: allocated buffer size */
+	char	**rn_pages;	/* pages of the file data, NULL for holes */
+	size_t	 rn_npages;	/* number of entries in rn_pages */
 	int	 rn_read_fds;	/* fifo: number of fd open for reading */
 	int	 rn_write_fds;	/* fifo: number of fd open for writing */
 };
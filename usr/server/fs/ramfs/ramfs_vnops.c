@@ -39,6 +39,7 @@
 #include <sys/mount.h>
 #include <sys/dirent.h>
 #include <sys/param.h>
+#include <sys/poll.h>
 
 #include <errno.h>
 #include <string.h>
@@ -66,6 +67,7 @@ static int ramfs_mkfifo	(vnode_t, char *, mode_t);
 #define ramfs_setattr	((vnop_setattr_t)vop_nullop)
 #define ramfs_inactive	((vnop_inactive_t)vop_nullop)
 static int ramfs_truncate(vnode_t);
+static int ramfs_poll	(vnode_t, file_t, int, int *);
 
 
 #if CONFIG_FS_THREADS > 1
@@ -95,6 +97,7 @@ struct vnops ramfs_vnops = {
 	ramfs_setattr,		/* setattr */
 	ramfs_inactive,		/* inactive */
 	ramfs_truncate,		/* truncate */
+	ramfs_poll,		/* poll */
 };
 
 struct ramfs_node *
@@ -122,14 +125,185 @@ void
 ramfs_free_node(struct ramfs_node *np)
 {
 
+	if (np->rn_hash != NULL)
+		free(np->rn_hash);
 	free(np->rn_name);
 	free(np);
 }
 
+/*
+ * Return the page of file data at specified page index.
+ * If alloc is set, a missing page is allocated with zero fill.
+ * Returns NULL for a hole, or if no memory is left.
+ */
+static char *
+ramfs_getpage(struct ramfs_node *np, size_t index, int alloc)
+{
+	char **pages;
+	void *page;
+	size_t n;
+
+	if (index < np->rn_npages && np->rn_pages[index] != NULL)
+		return np->rn_pages[index];
+	if (!alloc)
+		return NULL;
+
+	if (index >= np->rn_npages) {
+		/* Grow the page list by doubling its size. */
+		n = MAX(np->rn_npages * 2, 16);
+		while (n <= index)
+			n *= 2;
+		pages = malloc(n * sizeof(char *));
+		if (pages == NULL)
+			return NULL;
+		memset(pages, 0, n * sizeof(char *));
+		if (np->rn_pages != NULL) {
+			memcpy(pages, np->rn_pages,
+			       np->rn_npages * sizeof(char *));
+			free(np->rn_pages);
+		}
+		np->rn_pages = pages;
+		np->rn_npages = n;
+	}
+	if (vm_allocate(task_self(), &page, PAGE_SIZE, 1))
+		return NULL;
+	np->rn_pages[index] = page;
+	return page;
+}
+
+/*
+ * Free all pages of file data.
+ */
+static void
+ramfs_free_pages(struct ramfs_node *np)
+{
+	size_t i;
+
+	if (np->rn_pages == NULL)
+		return;
+	for (i = 0; i < np->rn_npages; i++) {
+		if (np->rn_pages[i] != NULL)
+			vm_free(task_self(), np->rn_pages[i]);
+	}
+	free(np->rn_pages);
+	np->rn_pages = NULL;
+	np->rn_npages = 0;
+}
+
+/*
+ * Get the hash value of the name.
+ */
+static u_int
+ramfs_hash(char *name, size_t len)
+{
+	u_int val = 0;
+
+	while (len-- > 0)
+		val = ((val << 5) + val) + *name++;
+	return val;
+}
+
+/*
+ * Double the hash table of the directory.
+ * The table is built from the list of children, because some of
+ * them may have been added while there was no table.  The old
+ * table is kept if no memory is left.
+ */
+static int
+ramfs_hash_grow(struct ramfs_node *dnp)
+{
+	struct ramfs_node **table, *np;
+	size_t size, h;
+
+	size = dnp->rn_hashsize ? dnp->rn_hashsize * 2 : RAMFS_HASH_MIN;
+	while (size < dnp->rn_nchild)
+		size *= 2;
+	table = malloc(size * sizeof(struct ramfs_node *));
+	if (table == NULL)
+		return ENOMEM;
+	memset(table, 0, size * sizeof(struct ramfs_node *));
+
+	for (np = dnp->rn_child; np != NULL; np = np->rn_next) {
+		h = ramfs_hash(np->rn_name, np->rn_namelen) & (size - 1);
+		np->rn_hnext = table[h];
+		table[h] = np;
+	}
+	if (dnp->rn_hash != NULL)
+		free(dnp->rn_hash);
+	dnp->rn_hash = table;
+	dnp->rn_hashsize = size;
+	return 0;
+}
+
+/*
+ * Add the node to the hash table.  The node must already be
+ * linked to the directory list.
+ */
+static void
+ramfs_hash_insert(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+	size_t h;
+
+	/* A new table has all the children, including np. */
+	if (dnp->rn_nchild > dnp->rn_hashsize &&
+	    ramfs_hash_grow(dnp) == 0)
+		return;
+	if (dnp->rn_hash == NULL)
+		return;
+	h = ramfs_hash(np->rn_name, np->rn_namelen) & (dnp->rn_hashsize - 1);
+	np->rn_hnext = dnp->rn_hash[h];
+	dnp->rn_hash[h] = np;
+}
+
+static void
+ramfs_hash_remove(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+	struct ramfs_node **pp;
+	size_t h;
+
+	if (dnp->rn_hash == NULL)
+		return;
+	h = ramfs_hash(np->rn_name, np->rn_namelen) & (dnp->rn_hashsize - 1);
+	for (pp = &dnp->rn_hash[h]; *pp != NULL; pp = &(*pp)->rn_hnext) {
+		if (*pp == np) {
+			*pp = np->rn_hnext;
+			break;
+		}
+	}
+	np->rn_hnext = NULL;
+}
+
+/*
+ * Find the child node by name.
+ * Must be called with ramfs_lock held.
+ */
+static struct ramfs_node *
+ramfs_find_node(struct ramfs_node *dnp, char *name, size_t len)
+{
+	struct ramfs_node *np;
+
+	if (dnp->rn_hash != NULL) {
+		np = dnp->rn_hash[ramfs_hash(name, len) &
+				  (dnp->rn_hashsize - 1)];
+		for (; np != NULL; np = np->rn_hnext) {
+			if (np->rn_namelen == len &&
+			    memcmp(name, np->rn_name, len) == 0)
+				return np;
+		}
+		return NULL;
+	}
+	for (np = dnp->rn_child; np != NULL; np = np->rn_next) {
+		if (np->rn_namelen == len &&
+		    memcmp(name, np->rn_name, len) == 0)
+			return np;
+	}
+	return NULL;
+}
+
 static struct ramfs_node *
 ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 {
-	struct ramfs_node *np, *prev;
+	struct ramfs_node *np;
 
 	np = ramfs_allocate_node(name, type);
 	if (np == NULL)
@@ -137,15 +311,17 @@ ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 
 	mutex_lock(&ramfs_lock);
 
-	/* Link to the directory list */
-	if (dnp->rn_child == NULL) {
+	/* Link to the end of the directory list */
+	np->rn_prev = dnp->rn_last;
+	if (dnp->rn_last == NULL)
 		dnp->rn_child = np;
-	} else {
-		prev = dnp->rn_child;
-		while (prev->rn_next != NULL)
-			prev = prev->rn_next;
-		prev->rn_next = np;
-	}
+	else
+		dnp->rn_last->rn_next = np;
+	dnp->rn_last = np;
+	dnp->rn_nchild++;
+	np->rn_seq = dnp->rn_nextseq++;
+	ramfs_hash_insert(dnp, np);
+
 	mutex_unlock(&ramfs_lock);
 	return np;
 }
@@ -153,26 +329,40 @@ ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 static int
 ramfs_remove_node(struct ramfs_node *dnp, struct ramfs_node *np)
 {
-	struct ramfs_node *prev;
 
 	if (dnp->rn_child == NULL)
 		return EBUSY;
 
 	mutex_lock(&ramfs_lock);
 
+	if (ramfs_find_node(dnp, np->rn_name, np->rn_namelen) != np) {
+		mutex_unlock(&ramfs_lock);
+		return ENOENT;
+	}
+
+	/*
+	 * Keep the readdir position.  The nodes after np move down
+	 * by one, so the next node takes the place of np.  The list
+	 * is kept in rn_seq order.
+	 */
+	if (dnp->rn_rdnode == np)
+		dnp->rn_rdnode = np->rn_next;
+	else if (dnp->rn_rdnode != NULL &&
+		 np->rn_seq < dnp->rn_rdnode->rn_seq)
+		dnp->rn_rdindex--;
+
 	/* Unlink from the directory list */
-	if (dnp->rn_child == np) {
+	if (np->rn_prev == NULL)
 		dnp->rn_child = np->rn_next;
-	} else {
-		for (prev = dnp->rn_child; prev->rn_next != np;
-		     prev = prev->rn_next) {
-			if (prev->rn_next == NULL) {
-				mutex_unlock(&ramfs_lock);
-				return ENOENT;
-			}
-		}
-		prev->rn_next = np->rn_next;
-	}
+	else
+		np->rn_prev->rn_next = np->rn_next;
+	if (np->rn_next == NULL)
+		dnp->rn_last = np->rn_prev;
+	else
+		np->rn_next->rn_prev = np->rn_prev;
+	dnp->rn_nchild--;
+	ramfs_hash_remove(dnp, np);
+
 	ramfs_free_node(np);
 
 	mutex_unlock(&ramfs_lock);
@@ -180,51 +370,48 @@ ramfs_remove_node(struct ramfs_node *dnp, struct ramfs_node *np)
 }
 
 static int
-ramfs_rename_node(struct ramfs_node *np, char *name)
+ramfs_rename_node(struct ramfs_node *dnp, struct ramfs_node *np, char *name)
 {
 	size_t len;
 	char *tmp;
 
 	len = strlen(name);
-	if (len <= np->rn_namelen) {
-		/* Reuse current name buffer */
-		strcpy(np->rn_name, name);
-	} else {
+	if (len > np->rn_namelen) {
 		/* Expand name buffer */
 		tmp = malloc(len + 1);
 		if (tmp == NULL)
 			return ENOMEM;
+	} else
+		tmp = NULL;
+
+	mutex_lock(&ramfs_lock);
+	ramfs_hash_remove(dnp, np);
+	if (tmp == NULL) {
+		/* Reuse current name buffer */
+		strcpy(np->rn_name, name);
+	} else {
 		strcpy(tmp, name);
 		free(np->rn_name);
 		np->rn_name = tmp;
 	}
 	np->rn_namelen = len;
+	ramfs_hash_insert(dnp, np);
+	mutex_unlock(&ramfs_lock);
 	return 0;
 }
 
 static int
 ramfs_lookup(vnode_t dvp, char *name, vnode_t vp)
 {
-	struct ramfs_node *np, *dnp;
-	size_t len;
-	int found;
+	struct ramfs_node *np;
 
 	if (*name == '\0')
 		return ENOENT;
 
 	mutex_lock(&ramfs_lock);
 
-	len = strlen(name);
-	dnp = dvp->v_data;
-	found = 0;
-	for (np = dnp->rn_child; np != NULL; np = np->rn_next) {
-		if (np->rn_namelen == len &&
-		    memcmp(name, np->rn_name, len) == 0) {
-			found = 1;
-			break;
-		}
-	}
-	if (found == 0) {
+	np = ramfs_find_node(dvp->v_data, name, strlen(name));
+	if (np == NULL) {
 		mutex_unlock(&ramfs_lock);
 		return ENOENT;
 	}
@@ -261,11 +448,12 @@ ramfs_rmdir(vnode_t dvp, vnode_t vp, char *name)
 	return ramfs_remove_node(dvp->v_data, vp->v_data);
 }
 
-/* notify read or write if blocked */
+/* notify read or write if blocked, and wake up pollers */
 static void notify(vnode_t vp)
 {
 	if (vp->v_cond != COND_INITIALIZER)
 		cond_signal(&vp->v_cond);
+	vn_pollwakeup(vp);
 }
 
 /*
@@ -314,6 +502,36 @@ static int ramfs_close(vnode_t vp, file_t fp)
 	return 0;
 }
 
+/*
+ * Regular files are always ready.  A fifo can be read when it
+ * has data, and written while it has space or can grow.
+ */
+static int
+ramfs_poll(vnode_t vp, file_t fp, int events, int *revents)
+{
+	struct ramfs_node *np = vp->v_data;
+	int mask = 0;
+
+	if (vp->v_type != VFIFO)
+		return vop_pollready(vp, fp, events, revents);
+
+	if (fp->f_flags & FREAD) {
+		if (np->rn_bufsize != np->rn_size)
+			mask |= events & (POLLIN | POLLRDNORM);
+		else if (np->rn_write_fds == 0)
+			mask |= POLLHUP;
+	}
+	if (fp->f_flags & FWRITE) {
+		if (np->rn_read_fds == 0)
+			mask |= POLLERR;
+		else if (np->rn_bufsize - np->rn_size < np->rn_fifosize ||
+			 np->rn_fifosize < RAMFS_FIFO_MAX)
+			mask |= events & POLLOUT;
+	}
+	*revents = mask;
+	return 0;
+}
+
 /*
  * Create fifo.
  */
@@ -336,6 +554,7 @@ ramfs_mkfifo(vnode_t dvp, char *name, mode_t mode)
 		ramfs_remove_node(dvp->v_data, node);
 		return ENOMEM;
 	}
+	node->rn_fifosize = PIPE_BUF;
 	return 0;
 }
 
@@ -348,13 +567,11 @@ ramfs_remove(vnode_t dvp, vnode_t vp, char *name)
 	DPRINTF(("remove %s in %s\n", name, dvp->v_path));
 	np = vp->v_data;
 	if (np->rn_buf != NULL) {
-		if (vp->v_type == VFIFO)
-			free(np->rn_buf);
-		else
-			vm_free(task_self(), np->rn_buf);
+		free(np->rn_buf);
 		np->rn_buf = NULL; /* incase remove_node fails */
 		np->rn_bufsize = 0;
 	}
+	ramfs_free_pages(np);
 	vp->v_size = 0;
 	return ramfs_remove_node(dvp->v_data, np);
 }
@@ -367,11 +584,8 @@ ramfs_truncate(vnode_t vp)
 
 	DPRINTF(("truncate %s\n", vp->v_path));
 	np = vp->v_data;
-	if (np->rn_buf != NULL) {
-		vm_free(task_self(), np->rn_buf);
-		np->rn_buf = NULL;
-		np->rn_bufsize = 0;
-	}
+	ramfs_free_pages(np);
+	np->rn_size = 0;
 	vp->v_size = 0;
 	return 0;
 }
@@ -430,16 +644,16 @@ ramfs_read_fifo(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 			if (err)
 				break;
 			continue; /* validate data available */
-		} else if (avail == PIPE_BUF)
+		} else if (avail == np->rn_fifosize)
 			notify(vp); /* notify write: will have space when we
 				       unlock the mutex */
 
 		/* offset into circular buf */
-		size_t off = np->rn_size & (PIPE_BUF-1);
+		size_t off = np->rn_size & (np->rn_fifosize - 1);
 
 		/* contiguius data available to end of curcular buffer */
-		if (avail > PIPE_BUF - off)
-			avail = PIPE_BUF - off;
+		if (avail > np->rn_fifosize - off)
+			avail = np->rn_fifosize - off;
 
 		size_t len = (size < avail) ? size : avail;
 		DPRINTF(("read: off %d len %d avail %d\n", off, len, avail));
@@ -454,6 +668,37 @@ ramfs_read_fifo(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	return (read) ? 0 : err;
 }
 
+/*
+ * Double the fifo buffer, up to RAMFS_FIFO_MAX bytes.
+ * Returns 0 if the buffer can not grow.
+ */
+static int
+ramfs_fifo_grow(struct ramfs_node *np)
+{
+	size_t newsize, pos, off, newoff, len;
+	char *buf;
+
+	newsize = np->rn_fifosize * 2;
+	if (newsize > RAMFS_FIFO_MAX)
+		return 0;
+	if ((buf = malloc(newsize)) == NULL)
+		return 0;
+
+	/* Place the data at the offsets of the read / write counts. */
+	for (pos = np->rn_size; pos != np->rn_bufsize; pos += len) {
+		off = pos & (np->rn_fifosize - 1);
+		newoff = pos & (newsize - 1);
+		len = np->rn_bufsize - pos;
+		len = MIN(len, np->rn_fifosize - off);
+		len = MIN(len, newsize - newoff);
+		memcpy(buf + newoff, np->rn_buf + off, len);
+	}
+	free(np->rn_buf);
+	np->rn_buf = buf;
+	np->rn_fifosize = newsize;
+	return 1;
+}
+
 static int
 ramfs_write_fifo(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
@@ -466,8 +711,10 @@ ramfs_write_fifo(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 			err = EPIPE;
 			break;
 		}
-		size_t free = PIPE_BUF - (np->rn_bufsize - np->rn_size);
+		size_t free = np->rn_fifosize - (np->rn_bufsize - np->rn_size);
 		DPRINTF(("written: %d, %d remaining\n", written, size));
+		if (free < size && ramfs_fifo_grow(np))
+			continue; /* calculate free again */
 		if (free == 0) {
 			if (fp->f_flags & O_NONBLOCK) {
 				err = EAGAIN;
@@ -479,14 +726,14 @@ ramfs_write_fifo(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 			if (err)
 				break;
 			continue; /* calculate free again */
-		} else if (free == PIPE_BUF)
+		} else if (free == np->rn_fifosize)
 			notify(vp); /* notify read: will have data
 				       when we unlock the mutex */
 
 		/* offset into circular buf */
-		size_t off = np->rn_bufsize & (PIPE_BUF-1);
-		if (free > PIPE_BUF - off)
-			free = PIPE_BUF - off; /* space wrapped in buffer */
+		size_t off = np->rn_bufsize & (np->rn_fifosize - 1);
+		if (free > np->rn_fifosize - off)
+			free = np->rn_fifosize - off; /* space wrapped in buffer */
 
 		size_t len = (size < free) ? size : free;
 		DPRINTF(("write: off %d len %d free %d\n", off, len, free));
@@ -506,6 +753,8 @@ ramfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct ramfs_node *np;
 	off_t off;
+	size_t pos, len, resid;
+	char *page;
 
 	*result = 0;
 	if (vp->v_type == VFIFO)
@@ -522,8 +771,19 @@ ramfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	if (vp->v_size - off < size)
 		size = vp->v_size - off;
 
+	/* Copy page by page. A hole reads as zero. */
 	np = vp->v_data;
-	memcpy(buf, np->rn_buf + off, size);
+	for (resid = size; resid > 0; resid -= len) {
+		pos = off & PAGE_MASK;
+		len = MIN(PAGE_SIZE - pos, resid);
+		page = ramfs_getpage(np, off / PAGE_SIZE, 0);
+		if (page == NULL)
+			memset(buf, 0, len);
+		else
+			memcpy(buf, page + pos, len);
+		buf = (char *)buf + len;
+		off += len;
+	}
 
 	fp->f_offset += size;
 	*result = size;
@@ -535,9 +795,8 @@ ramfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct ramfs_node *np;
 	off_t file_pos, end_pos;
-	void *new_buf;
-	size_t new_size;
-	task_t task;
+	size_t pos, len, resid;
+	char *page;
 
 	*result = 0;
 	if (vp->v_type == VFIFO)
@@ -548,40 +807,34 @@ ramfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 		return EINVAL;
 
 	np = vp->v_data;
-	/* Check if the file position exceeds the end of file. */
-	end_pos = vp->v_size;
-	file_pos = (fp->f_flags & O_APPEND) ? end_pos : fp->f_offset;
-	if (file_pos + size > (size_t)end_pos) {
-		/* Expand the file size before writing to it */
-		end_pos = file_pos + size;
-		if (end_pos > (off_t)np->rn_bufsize) {
-			task = task_self();
-			/*
-			 * We allocate the data buffer in page boundary.
-			 * So that we can reduce the memory allocation unless
-			 * the file size exceeds next page boundary.
-			 * This will prevent the memory fragmentation by
-			 * many malloc/free calls.
-			 */
-			new_size = PAGE_ALIGN(end_pos);
-			if (vm_allocate(task, &new_buf, new_size, 1))
-				return EIO;
-			if (np->rn_size != 0) {
-				memcpy(new_buf, np->rn_buf, vp->v_size);
-				vm_free(task, np->rn_buf);
-			}
-			if (vp->v_size < (size_t)file_pos) /* sparse file */
-				memset((char *)new_buf + vp->v_size, 0,
-				       file_pos - vp->v_size);
-			np->rn_buf = new_buf;
-			np->rn_bufsize = new_size;
+	file_pos = (fp->f_flags & O_APPEND) ? (off_t)vp->v_size : fp->f_offset;
+
+	/*
+	 * Copy page by page.  The pages are allocated as they are
+	 * written, so the pages skipped by a seek stay as holes.
+	 */
+	for (resid = size; resid > 0; resid -= len) {
+		pos = file_pos & PAGE_MASK;
+		len = MIN(PAGE_SIZE - pos, resid);
+		page = ramfs_getpage(np, file_pos / PAGE_SIZE, 1);
+		if (page == NULL) {
+			if (resid == size)
+				return ENOSPC;
+			break;
 		}
+		memcpy(page + pos, buf, len);
+		buf = (char *)buf + len;
+		file_pos += len;
+	}
+
+	/* Expand the file size */
+	end_pos = file_pos;
+	if (end_pos > (off_t)vp->v_size) {
 		np->rn_size = end_pos;
 		vp->v_size = end_pos;
 	}
-	memcpy(np->rn_buf + file_pos, buf, size);
-	fp->f_offset += size;
-	*result = size;
+	fp->f_offset = file_pos;
+	*result = size - resid;
 	return 0;
 }
 
@@ -602,6 +855,7 @@ ramfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 
 	if (vp2) {
 		/* Remove destination file, first */
+		ramfs_free_pages(vp2->v_data);
 		err = ramfs_remove_node(dvp2->v_data, vp2->v_data);
 		if (err)
 			return err;
@@ -609,7 +863,7 @@ ramfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 	/* Same directory ? */
 	if (dvp1 == dvp2) {
 		/* Change the name of existing file */
-		err = ramfs_rename_node(vp1->v_data, name2);
+		err = ramfs_rename_node(dvp1->v_data, vp1->v_data, name2);
 		if (err)
 			return err;
 	} else {
@@ -620,10 +874,10 @@ ramfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 			return ENOMEM;
 
 		if (vp1->v_type == VREG) {
-			/* Copy file data */
-			np->rn_buf = old_np->rn_buf;
+			/* Move file data */
+			np->rn_pages = old_np->rn_pages;
+			np->rn_npages = old_np->rn_npages;
 			np->rn_size = old_np->rn_size;
-			np->rn_bufsize = old_np->rn_bufsize;
 		}
 		/* Remove source file */
 		ramfs_remove_node(dvp1->v_data, vp1->v_data);
@@ -649,25 +903,33 @@ ramfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 		dir->d_type = DT_DIR;
 		strcpy((char *)&dir->d_name, "..");
 	} else {
+		/* Continue from the node returned last, if possible. */
 		dnp = vp->v_data;
-		np = dnp->rn_child;
+		if (dnp->rn_rdnode != NULL &&
+		    dnp->rn_rdindex <= fp->f_offset - 2) {
+			np = dnp->rn_rdnode;
+			i = dnp->rn_rdindex;
+		} else {
+			np = dnp->rn_child;
+			i = 0;
+		}
+		for (; np != NULL && i != (fp->f_offset - 2); i++)
+			np = np->rn_next;
 		if (np == NULL) {
 			mutex_unlock(&ramfs_lock);
 			return ENOENT;
 		}
-
-		for (i = 0; i != (fp->f_offset - 2); i++) {
-			np = np->rn_next;
-			if (np == NULL) {
-				mutex_unlock(&ramfs_lock);
-				return ENOENT;
-			}
-		}
+		dnp->rn_rdnode = np;
+		dnp->rn_rdindex = i;
 		if (np->rn_type == VDIR)
 			dir->d_type = DT_DIR;
+		else if (np->rn_type == VFIFO)
+			dir->d_type = DT_FIFO;
 		else
 			dir->d_type = DT_REG;
 		strcpy((char *)&dir->d_name, np->rn_name);
+		dir->d_size = (np->rn_type == VFIFO) ? 0 : np->rn_size;
+		dir->d_mode = ALLPERMS;
 	}
 	dir->d_fileno = fp->f_offset;
 	dir->d_namlen = strlen(dir->d_name);
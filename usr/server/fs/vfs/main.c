@@ -39,8 +39,9 @@
  *  - Validate the some of passed arguments in the message.
  *  - Mapping of the task ID and cwd/file pointers.
  *
- * Note: All path string is translated to the full path before passing
- * it to the sys_* routines.
+ * Note: A relative path is passed to the sys_* routines with the
+ * vnode of the directory to start the lookup.  It is the cwd of the
+ * task, or the directory descriptor given to the *at() requests.
  */
 
 #include <prex/prex.h>
@@ -124,17 +125,14 @@ fs_sync(struct task *t, struct msg *msg)
 }
 
 static int
-fs_open(struct task *t, struct open_msg *msg)
+fs_openat(struct task *t, struct open_msg *msg)
 {
-	char path[PATH_MAX];
+	vnode_t dvp, vp;
 	file_t fp;
+	char *name;
 	int fd, err;
 	mode_t mode;
 
-	/* Find empty slot for file descriptor. */
-	if ((fd = task_newfd(t)) == -1)
-		return EMFILE;
-
 	/*
 	 * Check the capability of caller task.
 	 */
@@ -146,17 +144,65 @@ fs_open(struct task *t, struct open_msg *msg)
 	if ((mode & 0444) && (t->cap & CAP_FS_READ) == 0)
 		return EACCES;
 
-	if ((err = task_conv(t, msg->path, path)) != 0)
-		return err;
-	if ((err = sys_open(path, msg->flags, mode, &fp)) != 0)
-		return err;
+	/*
+	 * Find empty slot for file descriptor, and take a reference
+	 * on the start directory.  We run without the task lock, so
+	 * take it while the fd table and the cwd are read.
+	 */
+	mutex_lock(&t->lock);
+	if ((fd = task_newfd(t, 0)) == -1) {
+		task_unlock(t);
+		return EMFILE;
+	}
+	err = task_getdir(t, msg->fd, msg->path, &dvp);
+	task_unlock(t);
 
-	t->file[fd] = fp;
-	t->nopens++;
+	if (!err) {
+		err = sys_open(dvp, msg->path, msg->flags, mode, &fp);
+		if (dvp)
+			vrele(dvp);
+	}
+	if (!err) {
+		/*
+		 * A task which is allowed device I/O can read and
+		 * write a character device directly.  Return the
+		 * device name and the open flags, so that it can
+		 * open the device.
+		 */
+		msg->path[0] = '\0';
+		vp = fp->f_vnode;
+		if (vp->v_type == VCHR && (t->cap & CAP_DEVIO)) {
+			name = vp->v_path;
+			if (*name == '/')
+				name++;
+			if (strlcpy(msg->path, name, MAXDEVNAME) < MAXDEVNAME)
+				msg->flags = fp->f_flags;
+			else
+				msg->path[0] = '\0';
+		}
+	}
+	mutex_lock(&t->lock);
+	if (err)
+		task_setfd(t, fd, NULL);
+	else {
+		task_setfd(t, fd, fp);
+		t->nopens++;
+	}
+	task_unlock(t);
+	if (err)
+		return err;
 	msg->fd = fd;
 	return 0;
 }
 
+static int
+fs_open(struct task *t, struct open_msg *msg)
+{
+
+	msg->fd = AT_FDCWD;
+	return fs_openat(t, msg);
+}
+
 static int
 fs_close(struct task *t, struct msg *msg)
 {
@@ -164,32 +210,33 @@ fs_close(struct task *t, struct msg *msg)
 	int fd, err;
 
 	fd = msg->data[0];
-	if (fd >= OPEN_MAX)
-		return EBADF;
-
-	fp = t->file[fd];
-	if (fp == NULL)
+	if ((fp = task_getfp(t, fd)) == NULL)
 		return EBADF;
 
 	if ((err = sys_close(fp)) != 0)
 		return err;
 
-	t->file[fd] = NULL;
+	mutex_lock(&t->lock);
+	task_setfd(t, fd, NULL);
 	t->nopens--;
+	task_unlock(t);
 	return 0;
 }
 
 static int
 fs_mknod(struct task *t, struct open_msg *msg)
 {
-	char path[PATH_MAX];
+	vnode_t dvp;
 	int err;
 
 	if ((t->cap & CAP_FS_WRITE) == 0)
 		return EACCES;
-	if ((err = task_conv(t, msg->path, path)) != 0)
+	if ((err = task_getdir(t, AT_FDCWD, msg->path, &dvp)) != 0)
 		return err;
-	return sys_mknod(path, msg->mode);
+	err = sys_mknod(dvp, msg->path, msg->mode);
+	if (dvp)
+		vrele(dvp);
+	return err;
 }
 
 static int
@@ -257,6 +304,102 @@ fs_write(struct task *t, struct io_msg *msg)
 	return err;
 }
 
+/*
+ * Map the caller's i/o vector and all of its buffers, so that
+ * the whole transfer is done with one call into the file system.
+ */
+static int
+fs_rwv(struct task *t, struct uio_msg *msg, int rw)
+{
+	struct iovec iov[IOV_MAX], *uiov;
+	file_t fp;
+	size_t total, bytes;
+	int i, n, err;
+
+	if ((fp = task_getfp(t, msg->fd)) == NULL)
+		return EBADF;
+	n = msg->iovcnt;
+	if (n <= 0 || n > IOV_MAX)
+		return EINVAL;
+	if (msg->offset < 0 && msg->offset != -1)
+		return EINVAL;
+	if (vm_map(msg->hdr.task, (void *)msg->iov, n * sizeof(*iov),
+		   (void *)&uiov) != 0)
+		return EFAULT;
+	memcpy(iov, uiov, n * sizeof(*iov));
+	vm_free(task_self(), uiov);
+
+	total = 0;
+	for (i = 0; i < n; i++) {
+		if (iov[i].iov_len > SSIZE_MAX - total)
+			return EINVAL;
+		total += iov[i].iov_len;
+	}
+	err = 0;
+	for (i = 0; i < n; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		if (vm_map(msg->hdr.task, iov[i].iov_base, iov[i].iov_len,
+			   &iov[i].iov_base) != 0) {
+			err = EFAULT;
+			break;
+		}
+	}
+	if (!err) {
+		if (rw == FREAD)
+			err = sys_preadv(fp, iov, n, msg->offset, &bytes);
+		else
+			err = sys_pwritev(fp, iov, n, msg->offset, &bytes);
+		msg->size = bytes;
+	}
+	while (--i >= 0) {
+		if (iov[i].iov_len != 0)
+			vm_free(task_self(), iov[i].iov_base);
+	}
+	return err;
+}
+
+static int
+fs_preadv(struct task *t, struct uio_msg *msg)
+{
+
+	return fs_rwv(t, msg, FREAD);
+}
+
+static int
+fs_pwritev(struct task *t, struct uio_msg *msg)
+{
+
+	return fs_rwv(t, msg, FWRITE);
+}
+
+static int
+fs_copy(struct task *t, struct copy_msg *msg)
+{
+	file_t in, out;
+	size_t bytes;
+	int err;
+
+	if ((in = task_getfp(t, msg->infd)) == NULL)
+		return EBADF;
+	if ((out = task_getfp(t, msg->outfd)) == NULL)
+		return EBADF;
+	if ((msg->inoff < 0 && msg->inoff != -1) ||
+	    (msg->outoff < 0 && msg->outoff != -1))
+		return EINVAL;
+	/*
+	 * Copy a bounded amount per request, so that a large copy
+	 * does not hold a server thread and the file locks for
+	 * long.  The caller loops on the short count.
+	 */
+	if (msg->size > COPYMAX)
+		msg->size = COPYMAX;
+
+	err = sys_copy(in, msg->inoff, out, msg->outoff, msg->size, &bytes);
+	msg->size = bytes;
+	return err;
+}
+
 static int
 fs_ioctl(struct task *t, struct ioctl_msg *msg)
 {
@@ -267,6 +410,64 @@ fs_ioctl(struct task *t, struct ioctl_msg *msg)
 	return sys_ioctl(fp, msg->request, msg->buf);
 }
 
+/*
+ * Poll the descriptors of a task.  The revents field is
+ * written directly to the caller's array.
+ */
+static int
+fs_poll(struct task *t, struct poll_msg *msg)
+{
+	struct pollfd *fds;
+	file_t fp;
+	task_t owner;
+	nfds_t i;
+	int revents, count, err;
+
+	if (msg->sem != SEM_NULL)
+		vn_pollcancel(t, msg->sem);
+	msg->count = 0;
+	if (msg->nfds == 0)
+		return 0;
+	if (msg->nfds > OPEN_MAX)
+		return EINVAL;
+	/*
+	 * We post the semaphore later with our own capabilities,
+	 * so it must belong to the caller.
+	 */
+	if (msg->sem != SEM_NULL &&
+	    (sem_owner(&msg->sem, &owner) != 0 || owner != msg->hdr.task))
+		return EPERM;
+	if (vm_map(msg->hdr.task, msg->fds,
+		   msg->nfds * sizeof(struct pollfd), (void *)&fds) != 0)
+		return EFAULT;
+
+	count = 0;
+	err = 0;
+	for (i = 0; i < msg->nfds; i++) {
+		fds[i].revents = 0;
+		if (fds[i].fd < 0)
+			continue;
+		if ((fp = task_getfp(t, fds[i].fd)) == NULL) {
+			fds[i].revents = POLLNVAL;
+			count++;
+			continue;
+		}
+		if ((err = sys_poll(t, fp, fds[i].events, msg->sem,
+				    &revents)) != 0)
+			break;
+		if (revents != 0) {
+			fds[i].revents = (short)revents;
+			count++;
+		}
+	}
+	/* Nobody will wait for the files left. */
+	if ((err || count > 0) && msg->sem != SEM_NULL)
+		vn_pollcancel(t, msg->sem);
+	vm_free(task_self(), fds);
+	msg->count = count;
+	return err;
+}
+
 static int
 fs_fsync(struct task *t, struct msg *msg)
 {
@@ -277,6 +478,20 @@ fs_fsync(struct task *t, struct msg *msg)
 	return sys_fsync(fp);
 }
 
+static int
+fs_fstatat(struct task *t, struct stat_msg *msg)
+{
+	vnode_t dvp;
+	int err;
+
+	if ((err = task_getdir(t, msg->fd, msg->path, &dvp)) != 0)
+		return err;
+	err = sys_stat(dvp, msg->path, &msg->st);
+	if (dvp)
+		vrele(dvp);
+	return err;
+}
+
 static int
 fs_fstat(struct task *t, struct stat_msg *msg)
 {
@@ -292,20 +507,24 @@ fs_fstat(struct task *t, struct stat_msg *msg)
 static int
 fs_opendir(struct task *t, struct open_msg *msg)
 {
-	char path[PATH_MAX];
+	vnode_t dvp;
 	file_t fp;
 	int fd, err;
 
 	/* Find empty slot for file descriptor. */
-	if ((fd = task_newfd(t)) == -1)
+	if ((fd = task_newfd(t, 0)) == -1)
 		return EMFILE;
 
-	/* Get the mounted file system and node */
-	if ((err = task_conv(t, msg->path, path)) != 0)
-		return err;
-	if ((err = sys_opendir(path, &fp)) != 0)
+	if ((err = task_getdir(t, AT_FDCWD, msg->path, &dvp)) == 0) {
+		err = sys_opendir(dvp, msg->path, &fp);
+		if (dvp)
+			vrele(dvp);
+	}
+	if (err) {
+		task_setfd(t, fd, NULL);
 		return err;
-	t->file[fd] = fp;
+	}
+	task_setfd(t, fd, fp);
 	msg->fd = fd;
 	return 0;
 }
@@ -317,14 +536,11 @@ fs_closedir(struct task *t, struct msg *msg)
 	int fd, err;
 
 	fd = msg->data[0];
-	if (fd >= OPEN_MAX)
-		return EBADF;
-	fp = t->file[fd];
-	if (fp == NULL)
+	if ((fp = task_getfp(t, fd)) == NULL)
 		return EBADF;
 	if ((err = sys_closedir(fp)) != 0)
 		return err;
-	t->file[fd] = NULL;
+	task_setfd(t, fd, NULL);
 	return 0;
 }
 
@@ -338,6 +554,27 @@ fs_readdir(struct task *t, struct dir_msg *msg)
 	return sys_readdir(fp, &msg->dirent);
 }
 
+static int
+fs_getdents(struct task *t, struct io_msg *msg)
+{
+	file_t fp;
+	void *buf;
+	size_t size, bytes;
+	off_t base;
+	int err;
+
+	if ((fp = task_getfp(t, msg->fd)) == NULL)
+		return EBADF;
+	size = msg->size;
+	if ((err = vm_map(msg->hdr.task, msg->buf, size, &buf)) != 0)
+		return EFAULT;
+	err = sys_getdents(fp, buf, size, &bytes, &base);
+	msg->size = bytes;
+	msg->offset = base;
+	vm_free(task_self(), buf);
+	return err;
+}
+
 static int
 fs_rewinddir(struct task *t, struct msg *msg)
 {
@@ -377,78 +614,125 @@ fs_telldir(struct task *t, struct msg *msg)
 }
 
 static int
-fs_mkdir(struct task *t, struct open_msg *msg)
+fs_mkdirat(struct task *t, struct open_msg *msg)
 {
-	char path[PATH_MAX];
+	vnode_t dvp;
 	int err;
 
 	if ((t->cap & CAP_FS_WRITE) == 0)
 		return EACCES;
-	if ((err = task_conv(t, msg->path, path)) != 0)
+	if ((err = task_getdir(t, msg->fd, msg->path, &dvp)) != 0)
 		return err;
-	return sys_mkdir(path, msg->mode);
+	err = sys_mkdir(dvp, msg->path, msg->mode);
+	if (dvp)
+		vrele(dvp);
+	return err;
 }
 
 static int
-fs_rmdir(struct task *t, struct path_msg *msg)
+fs_mkdir(struct task *t, struct open_msg *msg)
 {
-	char path[PATH_MAX];
+
+	msg->fd = AT_FDCWD;
+	return fs_mkdirat(t, msg);
+}
+
+static int
+fs_unlinkat(struct task *t, struct path_msg *msg)
+{
+	vnode_t dvp;
 	int err;
 
 	if ((t->cap & CAP_FS_WRITE) == 0)
 		return EACCES;
-	if (msg->path == NULL)
-		return ENOENT;
-	if ((err = task_conv(t, msg->path, path)) != 0)
+	if ((err = task_getdir(t, msg->fd, msg->path, &dvp)) != 0)
 		return err;
-	return sys_rmdir(path);
+	if (msg->data[0] & AT_REMOVEDIR)
+		err = sys_rmdir(dvp, msg->path);
+	else
+		err = sys_unlink(dvp, msg->path);
+	if (dvp)
+		vrele(dvp);
+	return err;
+}
+
+static int
+fs_rmdir(struct task *t, struct path_msg *msg)
+{
+
+	msg->fd = AT_FDCWD;
+	msg->data[0] = AT_REMOVEDIR;
+	return fs_unlinkat(t, msg);
 }
 
 static int
 fs_mkfifo(struct task *t, struct open_msg *msg)
 {
-	char path[PATH_MAX];
+	vnode_t dvp;
 	int err;
 
 	if ((t->cap & CAP_FS_WRITE) == 0)
 		return EACCES;
-	if ((err = task_conv(t, msg->path, path)) != 0)
+	if ((err = task_getdir(t, AT_FDCWD, msg->path, &dvp)) != 0)
 		return err;
-	return sys_mkfifo(path, msg->mode);
+	err = sys_mkfifo(dvp, msg->path, msg->mode);
+	if (dvp)
+		vrele(dvp);
+	return err;
 }
 
 static int
-fs_rename(struct task *t, struct path_msg *msg)
+fs_renameat(struct task *t, struct path_msg *msg)
 {
-	char src[PATH_MAX];
-	char dest[PATH_MAX];
+	vnode_t sdvp, ddvp;
 	int err;
 
 	if ((t->cap & CAP_FS_WRITE) == 0)
 		return EACCES;
-	if (msg->path == NULL || msg->path2 == NULL)
-		return ENOENT;
-	if ((err = task_conv(t, msg->path, src)) != 0)
+	if ((err = task_getdir(t, msg->fd, msg->path, &sdvp)) != 0)
 		return err;
-	if ((err = task_conv(t, msg->path2, dest)) != 0)
+	if ((err = task_getdir(t, msg->data[0], msg->path2, &ddvp)) != 0) {
+		if (sdvp)
+			vrele(sdvp);
 		return err;
-	return sys_rename(src, dest);
+	}
+	err = sys_rename(sdvp, msg->path, ddvp, msg->path2);
+	if (sdvp)
+		vrele(sdvp);
+	if (ddvp)
+		vrele(ddvp);
+	return err;
+}
+
+static int
+fs_rename(struct task *t, struct path_msg *msg)
+{
+
+	msg->fd = AT_FDCWD;
+	msg->data[0] = AT_FDCWD;
+	return fs_renameat(t, msg);
 }
 
 static int
 fs_chdir(struct task *t, struct path_msg *msg)
 {
 	char path[PATH_MAX];
+	vnode_t dvp;
 	file_t fp;
 	int err;
 
-	if (msg->path == NULL)
-		return ENOENT;
-	if ((err = task_conv(t, msg->path, path)) != 0)
+	if ((err = task_getdir(t, AT_FDCWD, msg->path, &dvp)) != 0)
 		return err;
 	/* Check if directory exits */
-	if ((err = sys_opendir(path, &fp)) != 0)
+	err = sys_opendir(dvp, msg->path, &fp);
+	if (dvp)
+		vrele(dvp);
+	if (err)
+		return err;
+	if ((err = task_conv(t, msg->path, path)) != 0) {
+		sys_closedir(fp);
 		return err;
+	}
 	if (t->cwdfp)
 		sys_closedir(t->cwdfp);
 	t->cwdfp = fp;
@@ -466,27 +750,18 @@ fs_link(struct task *t, struct msg *msg)
 static int
 fs_unlink(struct task *t, struct path_msg *msg)
 {
-	char path[PATH_MAX];
 
-	if ((t->cap & CAP_FS_WRITE) == 0)
-		return EACCES;
-	if (msg->path == NULL)
-		return ENOENT;
-	task_conv(t, msg->path, path);
-	return sys_unlink(path);
+	msg->fd = AT_FDCWD;
+	msg->data[0] = 0;
+	return fs_unlinkat(t, msg);
 }
 
 static int
 fs_stat(struct task *t, struct stat_msg *msg)
 {
-	char path[PATH_MAX];
-	struct stat *st;
-	int err;
 
-	task_conv(t, msg->path, path);
-	st = &msg->st;
-	err = sys_stat(path, st);
-	return err;
+	msg->fd = AT_FDCWD;
+	return fs_fstatat(t, msg);
 }
 
 static int
@@ -507,17 +782,14 @@ fs_dup(struct task *t, struct msg *msg)
 	int old_fd, new_fd;
 
 	old_fd = msg->data[0];
-	if (old_fd >= OPEN_MAX)
-		return EBADF;
-	fp = t->file[old_fd];
-	if (fp == NULL)
+	if ((fp = task_getfp(t, old_fd)) == NULL)
 		return EBADF;
 
 	/* Find smallest empty slot as new fd. */
-	if ((new_fd = task_newfd(t)) == -1)
+	if ((new_fd = task_newfd(t, 0)) == -1)
 		return EMFILE;
 
-	t->file[new_fd] = fp;
+	task_setfd(t, new_fd, fp);
 
 	/* Increment file reference */
 	vref(fp->f_vnode);
@@ -539,18 +811,25 @@ fs_dup2(struct task *t, struct msg *msg)
 
 	old_fd = msg->data[0];
 	new_fd = msg->data[1];
-	if (old_fd >= OPEN_MAX || new_fd >= OPEN_MAX)
+	if ((fp = task_getfp(t, old_fd)) == NULL)
 		return EBADF;
-	fp = t->file[old_fd];
-	if (fp == NULL)
+	if (new_fd < 0 || new_fd >= OPEN_MAX)
 		return EBADF;
-	org = t->file[new_fd];
+	msg->data[0] = new_fd;
+	if (new_fd == old_fd)
+		return 0;
+
+	org = task_getfp(t, new_fd);
+	if ((err = task_setfd(t, new_fd, fp)) != 0)
+		return err;
 	if (org != NULL) {
 		/* Close previous file if it's opened. */
-		err = sys_close(org);
+		sys_close(org);
 	}
-	t->file[new_fd] = fp;
-	msg->data[0] = new_fd;
+
+	/* Increment file reference */
+	vref(fp->f_vnode);
+	fp->f_count++;
 	return 0;
 }
 
@@ -569,13 +848,16 @@ fs_fcntl(struct task *t, struct fcntl_msg *msg)
 	arg = msg->arg;
 	switch (msg->cmd) {
 	case F_DUPFD:
-		if (arg >= OPEN_MAX)
+		if (arg < 0 || arg >= OPEN_MAX)
 			return EINVAL;
 
-		/* Find smallest empty slot as new fd. */
-		if ((new_fd = task_newfd(t)) == -1)
+		/* Find smallest empty slot from arg as new fd. */
+		if ((new_fd = task_newfd(t, arg)) == -1)
 			return EMFILE;
-		t->file[new_fd] = fp;
+		task_setfd(t, new_fd, fp);
+		vref(fp->f_vnode);
+		fp->f_count++;
+		msg->arg = new_fd;
 		break;
 	case F_GETFD:
 		msg->arg = fp->f_flags & FD_CLOEXEC;
@@ -600,7 +882,7 @@ fs_fcntl(struct task *t, struct fcntl_msg *msg)
 static int
 fs_access(struct task *t, struct path_msg *msg)
 {
-	char path[PATH_MAX];
+	vnode_t dvp;
 	int mode, err;
 
 	mode = msg->data[0];
@@ -608,8 +890,12 @@ fs_access(struct task *t, struct path_msg *msg)
 	/*
 	 * Check file permission.
 	 */
-	task_conv(t, msg->path, path);
-	if ((err = sys_access(path, mode)) != 0)
+	if ((err = task_getdir(t, AT_FDCWD, msg->path, &dvp)) != 0)
+		return err;
+	err = sys_access(dvp, msg->path, mode);
+	if (dvp)
+		vrele(dvp);
+	if (err)
 		return err;
 
 	/*
@@ -647,17 +933,25 @@ fs_fork(struct task *t, struct msg *msg)
 	 */
 	newtask->cwdfp = t->cwdfp;
 	strcpy(newtask->cwd, t->cwd);
-	for (i = 0; i < OPEN_MAX; i++) {
+	for (i = 0; i < t->nfiles; i++) {
 		fp = t->file[i];
-		newtask->file[i] = fp;
+		if (fp == NULL)
+			continue;
+		if ((err = task_setfd(newtask, i, fp)) != 0) {
+			/* Drop the files copied so far. */
+			while (--i >= 0) {
+				if ((fp = newtask->file[i]) != NULL)
+					sys_close(fp);
+			}
+			task_free(newtask);
+			return err;
+		}
 		/*
 		 * Increment file reference if it's
 		 * already opened.
 		 */
-		if (fp != NULL) {
-			vref(fp->f_vnode);
-			fp->f_count++;
-		}
+		vref(fp->f_vnode);
+		fp->f_count++;
 	}
 	if (newtask->cwdfp)
 		newtask->cwdfp->f_count++;
@@ -690,12 +984,12 @@ fs_exec(struct task *t, struct msg *msg)
 	task_update(target, new_id);
 
 	/* Close all directory descriptor */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < target->nfiles; fd++) {
 		fp = target->file[fd];
 		if (fp) {
 			if (fp->f_vnode->v_type == VDIR) {
 				sys_close(fp);
-				target->file[fd] = NULL;
+				task_setfd(target, fd, NULL);
 			}
 
 			/* XXX: need to check close-on-exec flag */
@@ -717,7 +1011,7 @@ fs_exit(struct task *t, struct msg *msg)
 	/*
 	 * Close all files opened by task.
 	 */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < t->nfiles; fd++) {
 		fp = t->file[fd];
 		if (fp != NULL)
 			sys_close(fp);
@@ -760,33 +1054,31 @@ fs_pipe(struct task *t, struct msg *msg)
 
 	DPRINTF(VFSDB_CORE, ("fs_pipe\n"));
 
-	if ((rfd = task_newfd(t)) == -1)
+	if ((rfd = task_newfd(t, 0)) == -1)
 		return EMFILE;
-	t->file[rfd] = (file_t)1; /* temp */
-
-	if ((wfd = task_newfd(t)) == -1) {
-		t->file[rfd] = NULL;
+	if ((wfd = task_newfd(t, 0)) == -1) {
+		task_setfd(t, rfd, NULL);
 		return EMFILE;
 	}
 	sprintf(path, "/fifo/%x-%d", (u_int)t->task, rfd);
 
-	if ((err = sys_mknod(path, S_IFIFO)) != 0)
+	if ((err = sys_mknod(NULL, path, S_IFIFO)) != 0)
 		goto out;
-	if ((err = sys_open(path, O_RDONLY | O_NONBLOCK, 0, &rfp)) != 0) {
+	if ((err = sys_open(NULL, path, O_RDONLY | O_NONBLOCK, 0, &rfp)) != 0) {
 		goto out;
 	}
-	if ((err = sys_open(path, O_WRONLY | O_NONBLOCK, 0, &wfp)) != 0) {
+	if ((err = sys_open(NULL, path, O_WRONLY | O_NONBLOCK, 0, &wfp)) != 0) {
 		goto out;
 	}
-	t->file[rfd] = rfp;
-	t->file[wfd] = wfp;
+	task_setfd(t, rfd, rfp);
+	task_setfd(t, wfd, wfp);
 	t->nopens += 2;
 	msg->data[0] = rfd;
 	msg->data[1] = wfd;
 	return 0;
  out:
-	t->file[rfd] = NULL;
-	t->file[wfd] = NULL;
+	task_setfd(t, rfd, NULL);
+	task_setfd(t, wfd, NULL);
 	return err;
 #else
 	return ENOSYS;
@@ -815,7 +1107,10 @@ fs_debug(struct task *t, struct msg *msg)
 	dprintf("<File System Server>\n");
 	task_dump();
 	vnode_dump();
+	dcache_dump();
 	mount_dump();
+	bio_dump();
+	malloc_stats();
 #endif
 	return 0;
 }
@@ -866,6 +1161,8 @@ fs_init(void)
 	task_init();
 	bio_init();
 	vnode_init();
+	dcache_init();
+	mount_init();
 
 	/*
 	 * Initialize each file system.
@@ -886,7 +1183,7 @@ fs_init(void)
 /*
  * Run specified routine as a thread.
  */
-static int
+int
 thread_run(void (*entry)(void))
 {
 	task_t self;
@@ -952,6 +1249,16 @@ static const struct msg_map fsmsg_map[] = {
 	MSGMAP( FS_EXIT,	fs_exit ),
 	MSGMAP( FS_REGISTER,	fs_register ),
 	MSGMAP( FS_PIPE,	fs_pipe ),
+	MSGMAP_UNLOCK( FS_OPENAT,	fs_openat ),
+	MSGMAP( FS_FSTATAT,	fs_fstatat ),
+	MSGMAP( FS_MKDIRAT,	fs_mkdirat ),
+	MSGMAP( FS_UNLINKAT,	fs_unlinkat ),
+	MSGMAP( FS_RENAMEAT,	fs_renameat ),
+	MSGMAP( FS_GETDENTS,	fs_getdents ),
+	MSGMAP( FS_POLL,	fs_poll ),
+	MSGMAP_UNLOCK( FS_PREADV,	fs_preadv ),
+	MSGMAP_UNLOCK( FS_PWRITEV,	fs_pwritev ),
+	MSGMAP_UNLOCK( FS_COPY,	fs_copy ),
 	MSGMAP( 0,		NULL ),
 };
 
@@ -1021,6 +1328,21 @@ fs_thread(void)
 	}
 }
 
+/*
+ * Device poll thread.
+ * The kernel posts devpoll_sem when a polled device may have
+ * become ready, and the tasks polling devices are woken.
+ */
+static void
+devpoll_thread(void)
+{
+
+	for (;;) {
+		if (sem_wait(&devpoll_sem, 0) == 0)
+			devpoll_wakeup();
+	}
+}
+
 /*
  * Main routine for file system service
  */
@@ -1047,6 +1369,12 @@ main(int argc, char *argv[])
 	if (object_create(OBJNAME_FS, &fs_obj))
 		sys_panic("VFS: fail to create object");
 
+	/*
+	 * Start the thread to wake the pollers of devices.
+	 */
+	if (sem_init(&devpoll_sem, 0) || thread_run(devpoll_thread))
+		goto err;
+
 	/*
 	 * Create new server threads.
 	 */
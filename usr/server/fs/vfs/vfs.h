@@ -36,6 +36,7 @@
 #include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/dirent.h>
+#include <sys/uio.h>
 
 #include <assert.h>
 
@@ -77,18 +78,32 @@ extern int vfs_debug;
 #define mutex_trylock(m)	do {} while (0)
 #endif
 
+#define NDFILE		8		/* initial size of file table */
+#define COPYBUFSZ	4096		/* buffer size for sys_copy() */
+#define COPYMAX		(COPYBUFSZ * 16) /* max bytes per copy request */
+
 /*
  * per task data
+ *
+ * The file table starts with NDFILE entries in dfile, and it is
+ * doubled when it is full, up to OPEN_MAX entries.
  */
 struct task {
-	struct list	link;		/* hash link */
+	struct hnode	link;		/* hash link */
 	task_t		task;		/* task id */
 	char 		cwd[PATH_MAX];	/* current working directory */
 	file_t		cwdfp;		/* directory for cwd */
-	file_t		file[OPEN_MAX];	/* array of file pointers */
+	file_t		*file;		/* array of file pointers */
+	u_char		*fdmap;		/* bitmap of used descriptors */
+	int		nfiles;		/* size of file array */
+	int		fdfree;		/* no free descriptor below this */
+	void		*ftables;	/* allocated file tables */
 	int		nopens;		/* number of opening files */
 	mutex_t		lock;		/* lock for this task */
 	cap_t		cap;		/* task capabilities */
+	struct list	poll;		/* poll waiters of this task */
+	file_t		dfile[NDFILE];	/* initial file array */
+	u_char		dfdmap[howmany(NDFILE, NBBY)];
 };
 
 extern const struct vfssw vfssw_table[];
@@ -100,51 +115,79 @@ void	 task_free(struct task *t);
 void	 task_update(struct task *t, task_t task);
 void	 task_unlock(struct task *t);
 file_t	 task_getfp(struct task *t, int fd);
-int	 task_newfd(struct task *t);
+int	 task_getdir(struct task *t, int fd, char *path, vnode_t *dvp);
+int	 task_newfd(struct task *t, int minfd);
+int	 task_setfd(struct task *t, int fd, file_t fp);
 int	 task_conv(struct task *t, char *path, char *full);
 void	 task_dump(void);
 void	 task_init(void);
 
-int	 namei(char *path, vnode_t *vpp);
-int	 lookup(char *path, vnode_t *vpp, char **name);
+int	 namei(vnode_t dvp, char *path, vnode_t *vpp);
+int	 lookup(vnode_t dvp, char *path, vnode_t *vpp, char **name);
 void	 vnode_init(void);
+int	 vn_pollwait(vnode_t vp, struct task *t, sem_t sem);
+void	 vn_pollcancel(struct task *t, sem_t sem);
+int	 devpoll_start(void);
+int	 devpoll_wait(struct task *t, sem_t sem, int gen);
+void	 devpoll_wakeup(void);
 #ifdef DEBUG
 void	 vnode_dump(void);
 #endif
+int	 dcache_lookup(mount_t mp, char *path);
+void	 dcache_enter(mount_t mp, char *path, vnode_t vp);
+void	 dcache_purge(vnode_t dvp, char *name);
+void	 dcache_init(void);
+#ifdef DEBUG
+void	 dcache_dump(void);
+#endif
 int	 vfs_findroot(char *path, mount_t *mp, char **root);
+void	 mount_init(void);
 void	 vfs_busy(mount_t mp);
 void	 vfs_unbusy(mount_t mp);
 #ifdef DEBUG
 void	 mount_dump(void);
+void	 bio_dump(void);
 #endif
 
-int	 sys_open(char *path, int flags, mode_t mode, file_t *pfp);
+int	 sys_open(vnode_t dvp, char *path, int flags, mode_t mode,
+		  file_t *pfp);
 int	 sys_close(file_t fp);
 int	 sys_read(file_t fp, void *buf, size_t size, size_t *result);
 int	 sys_write(file_t fp, void *buf, size_t size, size_t *result);
+int	 sys_preadv(file_t fp, struct iovec *iov, int iovcnt, off_t offset,
+		    size_t *result);
+int	 sys_pwritev(file_t fp, struct iovec *iov, int iovcnt, off_t offset,
+		     size_t *result);
+int	 sys_copy(file_t in, off_t inoff, file_t out, off_t outoff,
+		  size_t size, size_t *result);
 int	 sys_lseek(file_t fp, off_t off, int type, off_t * cur_off);
 int	 sys_ioctl(file_t fp, u_long request, void *buf);
+int	 sys_poll(struct task *t, file_t fp, int events, sem_t sem,
+		  int *revents);
 int	 sys_fstat(file_t fp, struct stat *st);
 int	 sys_fsync(file_t fp);
 
-int	 sys_opendir(char *path, file_t * file);
+int	 sys_opendir(vnode_t dvp, char *path, file_t *file);
 int	 sys_closedir(file_t fp);
 int	 sys_readdir(file_t fp, struct dirent *dirent);
+int	 sys_getdents(file_t fp, void *buf, size_t size, size_t *count, off_t *base);
 int	 sys_rewinddir(file_t fp);
 int	 sys_seekdir(file_t fp, long loc);
 int	 sys_telldir(file_t fp, long *loc);
-int	 sys_mkdir(char *path, mode_t mode);
-int	 sys_rmdir(char *path);
-int	 sys_mkfifo(char *path, mode_t mode);
-int	 sys_mknod(char *path, mode_t mode);
-int	 sys_rename(char *src, char *dest);
-int	 sys_unlink(char *path);
-int	 sys_access(char *path, int mode);
-int	 sys_stat(char *path, struct stat *st);
+int	 sys_mkdir(vnode_t dvp, char *path, mode_t mode);
+int	 sys_rmdir(vnode_t dvp, char *path);
+int	 sys_mkfifo(vnode_t dvp, char *path, mode_t mode);
+int	 sys_mknod(vnode_t dvp, char *path, mode_t mode);
+int	 sys_rename(vnode_t sdvp, char *src, vnode_t ddvp, char *dest);
+int	 sys_unlink(vnode_t dvp, char *path);
+int	 sys_access(vnode_t dvp, char *path, int mode);
+int	 sys_stat(vnode_t dvp, char *path, struct stat *st);
 
 int	 sys_mount(char *dev, char *dir, char *fsname, int flags, void *data);
 int	 sys_umount(char *path);
 int	 sys_sync(void);
+
+int	 thread_run(void (*entry)(void));
 __END_DECLS
 
 #endif /* !_VFS_H */
@@ -41,6 +41,7 @@
 #include <sys/param.h>
 #include <sys/buf.h>
 
+#include <errno.h>
 #include <limits.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -48,8 +49,41 @@
 
 #include "vfs.h"
 
-/* number of buffer cache */
+/*
+ * The pool starts with NBUFS buffers and grows on demand up to
+ * NBUFS_MAX buffers.  Buffers are allocated in chunks which share
+ * one page of data.  When no block has been missed for SHRINK_AGE,
+ * the flusher gives back one idle chunk per pass until the pool
+ * is down to NBUFS again.
+ */
 #define NBUFS		CONFIG_BUF_CACHE
+#ifdef CONFIG_BUF_CACHE_MAX
+#define NBUFS_MAX	CONFIG_BUF_CACHE_MAX
+#else
+#define NBUFS_MAX	CONFIG_BUF_CACHE
+#endif
+#define BUFS_PER_CHUNK	(PAGE_SIZE / BSIZE)
+
+/*
+ * Delayed write buffers are written back by the flusher thread
+ * when they get older than DIRTY_AGE, or when more than DIRTY_RATIO
+ * percent of the cache is dirty.  Adjacent dirty blocks are written
+ * together with one device_write() up to MAXWBLKS blocks.
+ */
+#define FLUSH_INTERVAL	1000		/* interval of flusher in msec */
+#define DIRTY_AGE	3000		/* max age of dirty block in msec */
+#define DIRTY_RATIO	50		/* max percent of dirty blocks */
+#define MAXWBLKS	16		/* max blocks per write */
+#define MAXCBLKS	32		/* max blocks per cluster i/o */
+#define SHRINK_AGE	10000		/* idle time before shrink in msec */
+
+#define DIRTY_AGE_TICKS	(DIRTY_AGE * CONFIG_HZ / 1000)
+#define SHRINK_AGE_TICKS (SHRINK_AGE * CONFIG_HZ / 1000)
+
+/* hash table for (dev, blkno). must be power of 2 */
+#define BUF_BUCKETS	64
+#define BUF_HASH(dev, blkno) \
+	(((u_int)(dev) + (u_int)(blkno)) & (BUF_BUCKETS - 1))
 
 /* macros to clear/set/test flags. */
 #define	SET(t, f)	(t) |= (f)
@@ -68,90 +102,391 @@ static mutex_t bio_lock = MUTEX_INITIALIZER;
 #define BIO_UNLOCK()
 #endif
 
+/*
+ * Chunk of buffers
+ */
+struct buf_chunk {
+	struct list	c_link;		/* link to chunk list */
+	char		*c_data;	/* page for buffer data */
+	struct buf	c_buf[BUFS_PER_CHUNK];
+};
+
+static struct list buf_hash[BUF_BUCKETS];	/* hash table */
+static struct list clean_list = LIST_INIT(clean_list); /* LRU of clean buffers */
+static struct list dirty_list = LIST_INIT(dirty_list); /* LRU of dirty buffers */
+static struct list chunk_list = LIST_INIT(chunk_list); /* all chunks */
 
-/* set of buffers */
-static char buffers[NBUFS][BSIZE];
+static int nbufs;		/* number of allocated buffers */
+static int nfree;		/* number of buffers in clean/dirty list */
+static int ndirty;		/* number of buffers in dirty list */
+static int nwaiters;		/* threads waiting for free buffer */
+static sem_t free_sem;		/* wakeup for waiters */
+static u_long miss_time;	/* time of the last cache miss */
+static int bio_error;		/* first failed delayed write */
 
-static struct buf buf_table[NBUFS];
-static struct list free_list = LIST_INIT(free_list);
+/* statistics */
+static u_long bio_hits;		/* found in cache */
+static u_long bio_misses;	/* not found in cache */
+static u_long bio_evicts;	/* valid block was discarded */
+static u_long bio_flushes;	/* dirty block was written by getblk */
+static u_long bio_wruns;	/* write runs issued */
+static u_long bio_wrblks;	/* blocks written by write runs */
+static u_long bio_rablks;	/* blocks read ahead */
+static u_long bio_rahits;	/* read-ahead blocks referenced */
 
-static sem_t free_sem;
+/*
+ * Read-ahead requests are queued to the read-ahead thread.
+ * Requests are silently dropped when the queue is full.
+ */
+#define NRAREQS		8
 
+/* read-ahead window is limited to a quarter of the cache */
+#define RA_MAXWIN	MIN(MAXRABLKS, NBUFS_MAX / 4)
+
+struct rareq {
+	dev_t		dev;		/* device */
+	int		blkno;		/* first block to read */
+	int		nblks;		/* number of blocks */
+};
+
+#if CONFIG_FS_THREADS > 1
+static struct rareq ra_queue[NRAREQS];
+static int ra_head;		/* index of next request */
+static int ra_count;		/* number of queued requests */
+static sem_t ra_sem;		/* wakeup for read-ahead thread */
+#endif
+static char ra_buf[MAXRABLKS * BSIZE];	/* buffer for read-ahead i/o */
+
+#if CONFIG_FS_THREADS > 1
+static sem_t flush_sem;		/* wakeup for flusher thread */
+static mutex_t wr_lock = MUTEX_INITIALIZER;	/* lock for wr_buf */
+#endif
+static char wr_buf[MAXWBLKS * BSIZE];	/* buffer for write runs */
 
 /*
- * Insert buffer to the head of free list
+ * Put the buffer on the free list.
+ * The buffer is queued on the clean or the dirty list
+ * depending on B_DELWRI.
  */
 static void
-bio_insert_head(struct buf *bp)
+bio_insert(struct buf *bp, int head)
 {
+	list_t list;
 
-	list_insert(&free_list, &bp->b_link);
-	sem_post(&free_sem);
+	if (ISSET(bp->b_flags, B_DELWRI)) {
+		list = &dirty_list;
+		ndirty++;
+	} else
+		list = &clean_list;
+	if (head)
+		list_insert(list, &bp->b_link);
+	else
+		list_insert(list_prev(list), &bp->b_link);
+	nfree++;
+	if (nwaiters > 0) {
+		nwaiters--;
+		sem_post(&free_sem);
+	}
 }
 
 /*
- * Insert buffer to the tail of free list
+ * Remove buffer from free list
  */
 static void
-bio_insert_tail(struct buf *bp)
+bio_remove(struct buf *bp)
 {
 
-	list_insert(list_prev(&free_list), &bp->b_link);
-	sem_post(&free_sem);
+	ASSERT(nfree > 0);
+	list_remove(&bp->b_link);
+	nfree--;
+	if (ISSET(bp->b_flags, B_DELWRI))
+		ndirty--;
 }
 
 /*
- * Remove buffer from free list
+ * Remove buffer from the hash table.
  */
 static void
-bio_remove(struct buf *bp)
+bio_unhash(struct buf *bp)
 {
 
-	sem_wait(&free_sem, 0);
-	ASSERT(!list_empty(&free_list));
-	list_remove(&bp->b_link);
+	list_remove(&bp->b_hash);
+	list_init(&bp->b_hash);
+}
+
+/*
+ * Add one chunk of buffers to the pool.
+ */
+static int
+bio_grow(void)
+{
+	struct buf_chunk *cp;
+	struct buf *bp;
+	void *data;
+	int i;
+
+	if ((cp = malloc(sizeof(struct buf_chunk))) == NULL)
+		return ENOMEM;
+	if (vm_allocate(task_self(), &data, PAGE_SIZE, 1) != 0) {
+		free(cp);
+		return ENOMEM;
+	}
+	cp->c_data = data;
+	for (i = 0; i < BUFS_PER_CHUNK; i++) {
+		bp = &cp->c_buf[i];
+		bp->b_flags = B_INVAL;
+		bp->b_dev = 0;
+		bp->b_blkno = 0;
+		bp->b_data = cp->c_data + BSIZE * i;
+		list_init(&bp->b_hash);
+		mutex_init(&bp->b_lock);
+		bio_insert(bp, 1);
+	}
+	list_insert(&chunk_list, &cp->c_link);
+	nbufs += BUFS_PER_CHUNK;
+	return 0;
 }
 
 /*
- * Remove buffer from the head of free list
+ * Release chunks until the pool is back to its initial size.
+ * A chunk is released when all of its buffers are invalid.  If
+ * idle is set, up to one chunk whose buffers are all clean and
+ * not busy is released as well, and its blocks are dropped.
+ */
+static void
+bio_shrink(int idle)
+{
+	struct buf_chunk *cp;
+	struct buf *bp;
+	list_t n, next;
+	int i, flags;
+
+	for (n = list_first(&chunk_list); n != &chunk_list; n = next) {
+		next = list_next(n);
+		if (nbufs - BUFS_PER_CHUNK < NBUFS)
+			break;
+		cp = list_entry(n, struct buf_chunk, c_link);
+		for (i = 0; i < BUFS_PER_CHUNK; i++) {
+			flags = cp->c_buf[i].b_flags;
+			if (idle ? ISSET(flags, B_BUSY | B_DELWRI) :
+			    flags != B_INVAL)
+				break;
+		}
+		if (i < BUFS_PER_CHUNK)
+			continue;
+
+		for (i = 0; i < BUFS_PER_CHUNK; i++) {
+			bp = &cp->c_buf[i];
+			bio_remove(bp);
+			bio_unhash(bp);
+			mutex_destroy(&bp->b_lock);
+		}
+		list_remove(&cp->c_link);
+		vm_free(task_self(), cp->c_data);
+		free(cp);
+		nbufs -= BUFS_PER_CHUNK;
+		if (idle)
+			break;
+	}
+}
+
+/*
+ * Select a clean buffer to be reused.
+ *
+ * The least recently used clean buffer is taken.  If it still
+ * holds valid data, we try to grow the pool instead of
+ * discarding it.  Returns NULL if no clean buffer is available.
  */
 static struct buf *
-bio_remove_head(void)
+bio_getnew(void)
 {
 	struct buf *bp;
 
-	sem_wait(&free_sem, 0);
-	ASSERT(!list_empty(&free_list));
-	bp = list_entry(list_first(&free_list), struct buf, b_link);
-	list_remove(&bp->b_link);
+	if (list_empty(&clean_list) ||
+	    !ISSET(list_entry(list_first(&clean_list),
+			      struct buf, b_link)->b_flags, B_INVAL)) {
+		if (nbufs < NBUFS_MAX)
+			bio_grow();
+	}
+	if (list_empty(&clean_list))
+		return NULL;
+	bp = list_entry(list_first(&clean_list), struct buf, b_link);
+	bio_remove(bp);
 	return bp;
 }
 
+/*
+ * Assign the block to the buffer selected by bio_getnew().
+ */
+static void
+bio_assign(struct buf *bp, dev_t dev, int blkno)
+{
+
+	if (!ISSET(bp->b_flags, B_INVAL)) {
+		bio_unhash(bp);
+		bio_evicts++;
+	}
+	bp->b_flags = B_BUSY;
+	bp->b_dev = dev;
+	bp->b_blkno = blkno;
+	list_insert(&buf_hash[BUF_HASH(dev, blkno)], &bp->b_hash);
+	bio_misses++;
+	sys_time(&miss_time);
+}
+
 /*
  * Determine if a block is in the cache.
  */
 static struct buf *
 incore(dev_t dev, int blkno)
 {
+	list_t head, n;
 	struct buf *bp;
-	int i;
 
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		if (bp->b_blkno == blkno && bp->b_dev == dev &&
-		    !ISSET(bp->b_flags, B_INVAL))
+	head = &buf_hash[BUF_HASH(dev, blkno)];
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		bp = list_entry(n, struct buf, b_hash);
+		if (bp->b_blkno == blkno && bp->b_dev == dev)
 			return bp;
 	}
 	return NULL;
 }
 
+/*
+ * Return the buffer if the block is dirty and not busy.
+ */
+static struct buf *
+bio_dirty(dev_t dev, int blkno)
+{
+	struct buf *bp;
+
+	bp = incore(dev, blkno);
+	if (bp == NULL || ISSET(bp->b_flags, B_BUSY) ||
+	    !ISSET(bp->b_flags, B_DELWRI))
+		return NULL;
+	return bp;
+}
+
+/*
+ * Write the dirty buffer with the adjacent dirty blocks.
+ *
+ * The buffer must be in the dirty list.  The blocks of the run
+ * are written by one device_write().  BIO_LOCK must be held by
+ * the caller, and it is released on return.
+ */
+static int
+bio_writerun(struct buf *bp)
+{
+	struct buf *run[MAXWBLKS];
+	dev_t dev;
+	size_t size;
+	int blkno, i, n, err;
+
+	dev = bp->b_dev;
+	blkno = bp->b_blkno;
+	for (i = 1; i < MAXWBLKS / 2; i++) {
+		if (bio_dirty(dev, blkno - 1) == NULL)
+			break;
+		blkno--;
+	}
+	for (n = 0; n < MAXWBLKS; n++) {
+		if ((run[n] = bio_dirty(dev, blkno + n)) == NULL)
+			break;
+		bio_remove(run[n]);
+		SET(run[n]->b_flags, B_BUSY);
+		mutex_lock(&run[n]->b_lock);
+	}
+	ASSERT(n > 0);
+	bio_wruns++;
+	bio_wrblks += n;
+	BIO_UNLOCK();
+
+	DPRINTF(VFSDB_BIO, ("bio_writerun: dev=%x blkno=%d n=%d\n",
+			    dev, blkno, n));
+	if (n == 1) {
+		if ((err = bwrite(run[0])) != 0) {
+			BIO_LOCK();
+			if (bio_error == 0)
+				bio_error = err;
+			BIO_UNLOCK();
+		}
+		return err;
+	}
+
+	mutex_lock(&wr_lock);
+	for (i = 0; i < n; i++) {
+		CLR(run[i]->b_flags, (B_READ | B_DONE | B_DELWRI));
+		memcpy(wr_buf + BSIZE * i, run[i]->b_data, BSIZE);
+	}
+	size = BSIZE * n;
+	err = device_write((device_t)dev, wr_buf, &size, blkno);
+	mutex_unlock(&wr_lock);
+
+	/*
+	 * The data is lost if the write failed.  Drop the blocks,
+	 * and keep the error for the next bio_sync().
+	 */
+	BIO_LOCK();
+	for (i = 0; i < n; i++)
+		SET(run[i]->b_flags, err ? B_INVAL : B_DONE);
+	if (err && bio_error == 0)
+		bio_error = err;
+	BIO_UNLOCK();
+	for (i = 0; i < n; i++)
+		brelse(run[i]);
+	return err;
+}
+
+/*
+ * Write back the delayed write buffers which are too old, or
+ * the least recently used ones while too many blocks are dirty.
+ */
+static void
+bio_flush(void)
+{
+	struct buf *bp;
+	list_t n;
+	u_long now;
+
+	sys_time(&now);
+	BIO_LOCK();
+	n = list_first(&dirty_list);
+	while (n != &dirty_list) {
+		bp = list_entry(n, struct buf, b_link);
+		if (ndirty * 100 > nbufs * DIRTY_RATIO ||
+		    now - bp->b_time >= DIRTY_AGE_TICKS) {
+			bio_writerun(bp);
+			BIO_LOCK();
+			n = list_first(&dirty_list);
+		} else
+			n = list_next(n);
+	}
+	if (nbufs > NBUFS && (long)(now - miss_time) >= SHRINK_AGE_TICKS)
+		bio_shrink(1);
+	BIO_UNLOCK();
+}
+
+#if CONFIG_FS_THREADS > 1
+/*
+ * Flusher thread.
+ */
+static void
+bio_flusher(void)
+{
+
+	for (;;) {
+		sem_wait(&flush_sem, FLUSH_INTERVAL);
+		bio_flush();
+	}
+}
+#endif
+
 /*
  * Assign a buffer for the given block.
  *
- * The block is selected from the buffer list with LRU
- * algorithm.  If the appropriate block already exists in the
- * block list, return it.  Otherwise, the least recently used
- * block is used.
+ * If the appropriate block already exists in the cache,
+ * return it.  Otherwise, a buffer is selected from the free
+ * lists with LRU algorithm.
  */
 struct buf *
 getblk(dev_t dev, int blkno)
@@ -173,16 +508,28 @@ getblk(dev_t dev, int blkno)
 		}
 		bio_remove(bp);
 		SET(bp->b_flags, B_BUSY);
+		if (ISSET(bp->b_flags, B_RAHEAD)) {
+			CLR(bp->b_flags, B_RAHEAD);
+			bio_rahits++;
+		}
+		bio_hits++;
 	} else {
-		bp = bio_remove_head();
-		if (ISSET(bp->b_flags, B_DELWRI)) {
+		bp = bio_getnew();
+		if (bp == NULL) {
+			if (!list_empty(&dirty_list)) {
+				/* No clean buffer. Write dirty blocks. */
+				bio_flushes++;
+				bio_writerun(list_entry(list_first(&dirty_list),
+							struct buf, b_link));
+				goto start;
+			}
+			/* All buffers are busy. Wait for brelse(). */
+			nwaiters++;
 			BIO_UNLOCK();
-			bwrite(bp);
+			sem_wait(&free_sem, 0);
 			goto start;
 		}
-		bp->b_flags = B_BUSY;
-		bp->b_dev = dev;
-		bp->b_blkno = blkno;
+		bio_assign(bp, dev, blkno);
 	}
 	mutex_lock(&bp->b_lock);
 	BIO_UNLOCK();
@@ -203,10 +550,11 @@ brelse(struct buf *bp)
 	BIO_LOCK();
 	CLR(bp->b_flags, B_BUSY);
 	mutex_unlock(&bp->b_lock);
-	if (ISSET(bp->b_flags, B_INVAL))
-		bio_insert_head(bp);
-	else
-		bio_insert_tail(bp);
+	if (ISSET(bp->b_flags, B_INVAL)) {
+		bio_unhash(bp);
+		bio_insert(bp, 1);
+	} else
+		bio_insert(bp, 0);
 	BIO_UNLOCK();
 }
 
@@ -245,6 +593,334 @@ bread(dev_t dev, int blkno, struct buf **bpp)
 	return 0;
 }
 
+/*
+ * Get a buffer for the block which is not in cache.
+ *
+ * Unlike getblk(), this never waits and never writes a dirty
+ * buffer.  NULL is returned if the block is already cached or
+ * no clean buffer is available.
+ */
+static struct buf *
+bio_getnowait(dev_t dev, int blkno)
+{
+	struct buf *bp;
+
+	BIO_LOCK();
+	if (incore(dev, blkno) != NULL) {
+		BIO_UNLOCK();
+		return NULL;
+	}
+	bp = bio_getnew();
+	if (bp != NULL && ISSET(bp->b_flags, B_RAHEAD)) {
+		/* Do not discard blocks read ahead but not used yet. */
+		bio_insert(bp, 1);
+		bp = NULL;
+	}
+	if (bp != NULL) {
+		bio_assign(bp, dev, blkno);
+		mutex_lock(&bp->b_lock);
+	}
+	BIO_UNLOCK();
+	return bp;
+}
+
+/*
+ * Read the blocks which are not in cache.
+ * Each run of missing blocks is read by one device_read().
+ */
+static void
+bio_rarun(dev_t dev, int blkno, int nblks)
+{
+	struct buf *bp[MAXRABLKS];
+	size_t size;
+	int i, n, err;
+
+	while (nblks > 0) {
+		for (n = 0; n < nblks; n++) {
+			if ((bp[n] = bio_getnowait(dev, blkno + n)) == NULL)
+				break;
+		}
+		if (n > 0) {
+			size = BSIZE * n;
+			err = device_read((device_t)dev, ra_buf, &size, blkno);
+			for (i = 0; i < n; i++) {
+				if (err)
+					SET(bp[i]->b_flags, B_INVAL);
+				else {
+					memcpy(bp[i]->b_data, ra_buf + BSIZE * i,
+					       BSIZE);
+					SET(bp[i]->b_flags,
+					    (B_READ | B_DONE | B_RAHEAD));
+				}
+				brelse(bp[i]);
+			}
+			if (err)
+				return;
+			BIO_LOCK();
+			bio_rablks += n;
+			BIO_UNLOCK();
+		}
+		/* Skip the block which could not be read ahead. */
+		blkno += n + 1;
+		nblks -= n + 1;
+	}
+}
+
+#if CONFIG_FS_THREADS > 1
+/*
+ * Read-ahead thread.
+ */
+static void
+bio_rathread(void)
+{
+	struct rareq req;
+
+	for (;;) {
+		sem_wait(&ra_sem, 0);
+		BIO_LOCK();
+		req = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % NRAREQS;
+		ra_count--;
+		BIO_UNLOCK();
+		bio_rarun(req.dev, req.blkno, req.nblks);
+	}
+}
+#endif
+
+/*
+ * Start reading blocks in background.
+ */
+static void
+bio_readahead(dev_t dev, int blkno, int nblks)
+{
+#if CONFIG_FS_THREADS > 1
+	struct rareq *req;
+
+	BIO_LOCK();
+	if (ra_count < NRAREQS) {
+		req = &ra_queue[(ra_head + ra_count) % NRAREQS];
+		req->dev = dev;
+		req->blkno = blkno;
+		req->nblks = nblks;
+		ra_count++;
+		sem_post(&ra_sem);
+	}
+	BIO_UNLOCK();
+#else
+	bio_rarun(dev, blkno, nblks);
+#endif
+}
+
+/*
+ * Block read with read-ahead.
+ * @dev:   device id to read from.
+ * @blkno: block number.
+ * @nra:   number of contiguous blocks after blkno in the file.
+ * @ra:    read-ahead state of the file.
+ * @bpp:   buffer pointer to be returned.
+ *
+ * The read-ahead is started only for sequential access.  The
+ * window is doubled for each read-ahead up to MAXRABLKS (or a
+ * quarter of the cache), and it is reset by a random access.
+ * The next read-ahead is issued when half of the window has
+ * been consumed.
+ */
+int
+breada(dev_t dev, int blkno, int nra, struct readahead *ra,
+       struct buf **bpp)
+{
+	int start, end;
+
+	DPRINTF(VFSDB_BIO, ("breada: dev=%x blkno=%d nra=%d\n", dev,
+			    blkno, nra));
+
+	if (blkno != ra->ra_next) {
+		/* Random access */
+		ra->ra_win = 0;
+		ra->ra_last = blkno;
+	} else if (nra > 0 && RA_MAXWIN > 0) {
+		if (ra->ra_win == 0)
+			ra->ra_win = MIN(MINRABLKS, RA_MAXWIN);
+		if (ra->ra_last < blkno)
+			ra->ra_last = blkno;
+		if (ra->ra_last - blkno <= ra->ra_win / 2) {
+			start = ra->ra_last + 1;
+			end = blkno + MIN(ra->ra_win, nra);
+			if (end >= start) {
+				bio_readahead(dev, start, end - start + 1);
+				ra->ra_last = end;
+			}
+			ra->ra_win = MIN(ra->ra_win * 2, RA_MAXWIN);
+		}
+	}
+	ra->ra_next = blkno + 1;
+	return bread(dev, blkno, bpp);
+}
+
+/*
+ * Read contiguous blocks to the caller's buffer.
+ * @dev:   device id to read from.
+ * @blkno: first block number.
+ * @nblks: number of blocks.
+ * @data:  buffer of nblks * BSIZE bytes.
+ *
+ * The cached blocks are copied from the cache.  Each run of
+ * the missing blocks is read by one device_read() directly
+ * into the caller's buffer, and it is entered to the cache.
+ */
+int
+bread_cluster(dev_t dev, int blkno, int nblks, void *data)
+{
+	struct buf *bp[MAXCBLKS];
+	char *p = data;
+	size_t size;
+	int i, k, n, err;
+
+	DPRINTF(VFSDB_BIO, ("bread_cluster: dev=%x blkno=%d nblks=%d\n",
+			    dev, blkno, nblks));
+
+	for (i = 0; i < nblks; i += n) {
+		n = 1;
+		bp[0] = getblk(dev, blkno + i);
+		if (ISSET(bp[0]->b_flags, (B_DONE | B_DELWRI))) {
+			memcpy(p + BSIZE * i, bp[0]->b_data, BSIZE);
+			brelse(bp[0]);
+			continue;
+		}
+		while (n < MAXCBLKS && i + n < nblks) {
+			if ((bp[n] = bio_getnowait(dev, blkno + i + n)) == NULL)
+				break;
+			n++;
+		}
+		size = BSIZE * n;
+		err = device_read((device_t)dev, p + BSIZE * i, &size,
+				  blkno + i);
+		for (k = 0; k < n; k++) {
+			if (err)
+				SET(bp[k]->b_flags, B_INVAL);
+			else {
+				memcpy(bp[k]->b_data, p + BSIZE * (i + k),
+				       BSIZE);
+				SET(bp[k]->b_flags, (B_READ | B_DONE));
+			}
+			brelse(bp[k]);
+		}
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * Read contiguous blocks to the caller's buffer bypassing the cache.
+ * @dev:   device id to read from.
+ * @blkno: first block number.
+ * @nblks: number of blocks.
+ * @data:  buffer of nblks * BSIZE bytes.
+ *
+ * Like bread_cluster(), but the blocks read from the device are
+ * not entered to the cache, and a run of missing blocks is read
+ * by one device_read() regardless of its length.  The caller must
+ * serialize the access to these blocks.
+ */
+int
+bread_direct(dev_t dev, int blkno, int nblks, void *data)
+{
+	struct buf *bp;
+	char *p = data;
+	size_t size;
+	int i, n, valid, err;
+
+	DPRINTF(VFSDB_BIO, ("bread_direct: dev=%x blkno=%d nblks=%d\n",
+			    dev, blkno, nblks));
+
+	for (i = 0; i < nblks; i += n) {
+		/* Count the blocks which have no valid copy in cache. */
+		BIO_LOCK();
+		for (n = 0; i + n < nblks; n++) {
+			bp = incore(dev, blkno + i + n);
+			valid = (bp != NULL &&
+				 ISSET(bp->b_flags, (B_DONE | B_DELWRI)));
+			if (valid)
+				break;
+		}
+		BIO_UNLOCK();
+
+		if (n == 0) {
+			n = 1;
+			bp = getblk(dev, blkno + i);
+			if (ISSET(bp->b_flags, (B_DONE | B_DELWRI))) {
+				memcpy(p + BSIZE * i, bp->b_data, BSIZE);
+				brelse(bp);
+				continue;
+			}
+			/* Lost from cache in the meantime. */
+			SET(bp->b_flags, B_INVAL);
+			brelse(bp);
+		}
+		size = BSIZE * n;
+		err = device_read((device_t)dev, p + BSIZE * i, &size,
+				  blkno + i);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * Write contiguous blocks from the caller's buffer.
+ * @dev:   device id to write to.
+ * @blkno: first block number.
+ * @nblks: number of blocks.
+ * @data:  buffer of nblks * BSIZE bytes.
+ *
+ * Up to MAXCBLKS blocks are written by one device_write().
+ * The cached copies of the blocks are updated and held busy
+ * during the write, but the blocks not in cache are not
+ * entered to the cache.  The caller must serialize the access
+ * to these blocks.
+ */
+int
+bwrite_cluster(dev_t dev, int blkno, int nblks, void *data)
+{
+	struct buf *bp[MAXCBLKS];
+	char *p = data;
+	size_t size;
+	int i, k, n, nheld, cached, err;
+
+	DPRINTF(VFSDB_BIO, ("bwrite_cluster: dev=%x blkno=%d nblks=%d\n",
+			    dev, blkno, nblks));
+
+	for (i = 0; i < nblks; i += n) {
+		n = MIN(nblks - i, MAXCBLKS);
+		nheld = 0;
+		for (k = 0; k < n; k++) {
+			BIO_LOCK();
+			cached = (incore(dev, blkno + i + k) != NULL);
+			BIO_UNLOCK();
+			if (!cached)
+				continue;
+			bp[nheld] = getblk(dev, blkno + i + k);
+			memcpy(bp[nheld]->b_data, p + BSIZE * (i + k), BSIZE);
+			nheld++;
+		}
+		size = BSIZE * n;
+		err = device_write((device_t)dev, p + BSIZE * i, &size,
+				   blkno + i);
+		for (k = 0; k < nheld; k++) {
+			CLR(bp[k]->b_flags, (B_READ | B_DELWRI));
+			if (err)
+				SET(bp[k]->b_flags, B_INVAL);
+			else
+				SET(bp[k]->b_flags, B_DONE);
+			brelse(bp[k]);
+		}
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 /*
  * Block write with cache.
  * @buf:   buffer to write.
@@ -269,8 +945,14 @@ bwrite(struct buf *bp)
 	size = BSIZE;
 	err = device_write((device_t)bp->b_dev, bp->b_data, &size,
 			   bp->b_blkno);
-	if (err)
+	if (err) {
+		/* The block on the device is unknown now. */
+		BIO_LOCK();
+		SET(bp->b_flags, B_INVAL);
+		BIO_UNLOCK();
+		brelse(bp);
 		return err;
+	}
 	BIO_LOCK();
 	SET(bp->b_flags, B_DONE);
 	BIO_UNLOCK();
@@ -283,17 +965,34 @@ bwrite(struct buf *bp)
  *
  * The buffer is marked dirty, but an actual I/O is not
  * performed.  This routine should be used when the buffer
- * is expected to be modified again soon.
+ * is expected to be modified again soon.  The block is
+ * written later by the flusher.
  */
 void
 bdwrite(struct buf *bp)
 {
+#if CONFIG_FS_THREADS > 1
+	int kick;
+#endif
 
+	if (!ISSET(bp->b_flags, B_DELWRI))
+		sys_time(&bp->b_time);
 	BIO_LOCK();
 	SET(bp->b_flags, B_DELWRI);
 	CLR(bp->b_flags, B_DONE);
 	BIO_UNLOCK();
 	brelse(bp);
+
+#if CONFIG_FS_THREADS > 1
+	BIO_LOCK();
+	kick = (ndirty * 100 > nbufs * DIRTY_RATIO);
+	BIO_UNLOCK();
+	if (kick)
+		sem_post(&flush_sem);
+#else
+	/* No flusher thread. Check the dirty blocks here. */
+	bio_flush();
+#endif
 }
 
 /*
@@ -316,66 +1015,112 @@ bflush(struct buf *bp)
 void
 binval(dev_t dev)
 {
+	struct buf_chunk *cp;
 	struct buf *bp;
+	list_t n;
 	int i;
 
+ start:
 	BIO_LOCK();
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		if (bp->b_dev == dev) {
-			if (ISSET(bp->b_flags, B_DELWRI))
-				bwrite(bp);
-			else if (ISSET(bp->b_flags, B_BUSY))
-				brelse(bp);
+	for (n = list_first(&chunk_list); n != &chunk_list;
+	     n = list_next(n)) {
+		cp = list_entry(n, struct buf_chunk, c_link);
+		for (i = 0; i < BUFS_PER_CHUNK; i++) {
+			bp = &cp->c_buf[i];
+			if (bp->b_dev != dev || ISSET(bp->b_flags, B_INVAL))
+				continue;
+			if (ISSET(bp->b_flags, B_BUSY)) {
+				BIO_UNLOCK();
+				mutex_lock(&bp->b_lock);
+				mutex_unlock(&bp->b_lock);
+				goto start;
+			}
+			if (ISSET(bp->b_flags, B_DELWRI)) {
+				bio_writerun(bp);
+				goto start;
+			}
+			bio_remove(bp);
+			bio_unhash(bp);
 			bp->b_flags = B_INVAL;
+			bio_insert(bp, 1);
 		}
 	}
+	bio_shrink(0);
 	BIO_UNLOCK();
 }
 
 /*
- * Invalidate all buffers.
- * This is called when unmount.
+ * Write back all delayed write buffers.
+ * Returns the error of the first delayed write which failed
+ * since the last call, if any.
  */
-void
+int
 bio_sync(void)
 {
 	struct buf *bp;
-	int i;
+	int err;
 
- start:
 	BIO_LOCK();
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		if (ISSET(bp->b_flags, B_BUSY)) {
-			BIO_UNLOCK();
-			mutex_lock(&bp->b_lock);
-			mutex_unlock(&bp->b_lock);
-			goto start;
-		}
-		if (ISSET(bp->b_flags, B_DELWRI))
-			bwrite(bp);
+	while (!list_empty(&dirty_list)) {
+		bp = list_entry(list_first(&dirty_list), struct buf, b_link);
+		bio_writerun(bp);
+		BIO_LOCK();
 	}
+	err = bio_error;
+	bio_error = 0;
 	BIO_UNLOCK();
+	return err;
 }
 
+#ifdef DEBUG
+/*
+ * Dump buffer cache statistics.
+ */
+void
+bio_dump(void)
+{
+	u_long total;
+
+	BIO_LOCK();
+	total = bio_hits + bio_misses;
+	dprintf("Dump buffer cache\n");
+	dprintf(" buffers %d (initial %d, max %d) free %d dirty %d\n",
+		nbufs, NBUFS, NBUFS_MAX, nfree, ndirty);
+	dprintf(" hits    %lu (%lu%%)\n", bio_hits,
+		total ? bio_hits * 100 / total : 0);
+	dprintf(" misses  %lu\n", bio_misses);
+	dprintf(" evicts  %lu\n", bio_evicts);
+	dprintf(" flushes %lu\n", bio_flushes);
+	dprintf(" ahead   %lu (used %lu)\n", bio_rablks, bio_rahits);
+	dprintf(" writes  %lu (%lu blocks)\n", bio_wruns, bio_wrblks);
+	dprintf("\n");
+	BIO_UNLOCK();
+}
+#endif
+
 /*
  * Initialize the buffer I/O system.
  */
 void
 bio_init(void)
 {
-	struct buf *bp;
 	int i;
 
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		bp->b_flags = B_INVAL;
-		bp->b_data = buffers[i];
-		mutex_init(&bp->b_lock);
-		list_insert(&free_list, &bp->b_link);
+	for (i = 0; i < BUF_BUCKETS; i++)
+		list_init(&buf_hash[i]);
+	sem_init(&free_sem, 0);
+
+	while (nbufs < NBUFS) {
+		if (bio_grow() != 0)
+			break;
 	}
-	sem_init(&free_sem, NBUFS);
 	DPRINTF(VFSDB_BIO, ("bio: Buffer cache size %dK bytes\n",
-			    BSIZE * NBUFS / 1024));
+			    BSIZE * nbufs / 1024));
+
+#if CONFIG_FS_THREADS > 1
+	sem_init(&ra_sem, 0);
+	sem_init(&flush_sem, 0);
+	if (thread_run(bio_rathread) || thread_run(bio_flusher))
+		sys_panic("bio: failed to create thread");
+#endif
 }
@@ -0,0 +1,316 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dcache.c - name lookup cache
+ */
+
+#include <prex/prex.h>
+#include <sys/list.h>
+#include <sys/vnode.h>
+#include <sys/mount.h>
+
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "vfs.h"
+
+/*
+ * The name cache keeps the result of VOP_LOOKUP() for each path
+ * in a mount.  Since a vnode is named by its path in the mount,
+ * the path stands for the pair of the parent directory and the
+ * name.
+ *
+ * A positive entry holds a reference to the vnode.  The vnode
+ * stays in the vnode table, and namei() gets it by vn_lookup()
+ * without asking the file system again.  A negative entry
+ * records that the path does not exist.
+ *
+ * The entries are replaced in LRU order.  They must be purged
+ * by dcache_purge() when the name space is changed by create,
+ * remove, rename or unmount.
+ */
+
+#define DCACHE_SIZE	64		/* max number of entries */
+#define DCACHE_BUCKETS	32		/* size of hash table */
+
+struct dcache {
+	struct list	d_link;		/* link in hash table */
+	struct list	d_lru;		/* link in lru list */
+	struct list	d_mlink;	/* link in entries of mount */
+	mount_t		d_mount;	/* mount point */
+	vnode_t		d_vnode;	/* vnode, or NULL if negative */
+	char		*d_path;	/* path name in mount */
+};
+
+static struct list dcache_table[DCACHE_BUCKETS];
+static struct list dcache_lru = LIST_INIT(dcache_lru);
+static int dcache_count;
+
+static u_long dcache_hits;		/* negative hits */
+static u_long dcache_enters;
+static u_long dcache_evicts;
+
+#if CONFIG_FS_THREADS > 1
+static mutex_t dcache_lock = MUTEX_INITIALIZER;
+#define DCACHE_LOCK()	mutex_lock(&dcache_lock)
+#define DCACHE_UNLOCK()	mutex_unlock(&dcache_lock)
+#else
+#define DCACHE_LOCK()
+#define DCACHE_UNLOCK()
+#endif
+
+/*
+ * Get the hash value from the mount point and path name.
+ */
+static u_int
+dcache_hash(mount_t mp, char *path)
+{
+	u_int val = 0;
+
+	while (*path)
+		val = ((val << 5) + val) + *path++;
+	return (val ^ (u_int)mp) & (DCACHE_BUCKETS - 1);
+}
+
+/*
+ * Find the cache entry.
+ * Must be called with DCACHE_LOCK held.
+ */
+static struct dcache *
+dcache_find(mount_t mp, char *path)
+{
+	list_t head, n;
+	struct dcache *dc;
+
+	head = &dcache_table[dcache_hash(mp, path)];
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		dc = list_entry(n, struct dcache, d_link);
+		if (dc->d_mount == mp && !strcmp(dc->d_path, path))
+			return dc;
+	}
+	return NULL;
+}
+
+/*
+ * Remove the cache entry from all lists.
+ * Must be called with DCACHE_LOCK held.
+ */
+static void
+dcache_remove(struct dcache *dc)
+{
+
+	list_remove(&dc->d_link);
+	list_remove(&dc->d_lru);
+	list_remove(&dc->d_mlink);
+	dcache_count--;
+}
+
+/*
+ * Release the cache entry removed from the lists.
+ * The reference to the vnode is dropped without the cache
+ * lock, since vrele() may call the file system.
+ */
+static void
+dcache_free(struct dcache *dc)
+{
+
+	if (dc->d_vnode)
+		vrele(dc->d_vnode);
+	free(dc);
+}
+
+/*
+ * Check the negative entry for the path.
+ * Returns ENOENT if the path is known not to exist.
+ */
+int
+dcache_lookup(mount_t mp, char *path)
+{
+	struct dcache *dc;
+	int err = 0;
+
+	DCACHE_LOCK();
+	dc = dcache_find(mp, path);
+	if (dc && dc->d_vnode == NULL) {
+		list_remove(&dc->d_lru);
+		list_insert(&dcache_lru, &dc->d_lru);
+		dcache_hits++;
+		err = ENOENT;
+	}
+	DCACHE_UNLOCK();
+	return err;
+}
+
+/*
+ * Enter the result of the lookup to the cache.
+ * @mp:   mount point.
+ * @path: path name in the mount.
+ * @vp:   vnode found, or NULL if the path does not exist.
+ *
+ * An existing entry is moved to the head of the lru list.
+ * The least recently used entry is replaced if the cache is
+ * full.
+ */
+void
+dcache_enter(mount_t mp, char *path, vnode_t vp)
+{
+	struct dcache *dc, *old = NULL;
+	vnode_t ovp = NULL;
+
+	DCACHE_LOCK();
+	if ((dc = dcache_find(mp, path)) != NULL) {
+		if (dc->d_vnode != vp) {
+			if (vp)
+				vref(vp);
+			ovp = dc->d_vnode;
+			dc->d_vnode = vp;
+		}
+		list_remove(&dc->d_lru);
+		list_insert(&dcache_lru, &dc->d_lru);
+		DCACHE_UNLOCK();
+		if (ovp)
+			vrele(ovp);
+		return;
+	}
+	if (dcache_count >= DCACHE_SIZE) {
+		old = list_entry(list_last(&dcache_lru), struct dcache, d_lru);
+		dcache_remove(old);
+		dcache_evicts++;
+	}
+	dc = malloc(sizeof(struct dcache) + strlen(path) + 1);
+	if (dc != NULL) {
+		dc->d_mount = mp;
+		dc->d_vnode = vp;
+		dc->d_path = (char *)(dc + 1);
+		strcpy(dc->d_path, path);
+		if (vp)
+			vref(vp);
+		list_insert(&dcache_table[dcache_hash(mp, path)], &dc->d_link);
+		list_insert(&dcache_lru, &dc->d_lru);
+		list_insert(&mp->m_dcache, &dc->d_mlink);
+		dcache_count++;
+		dcache_enters++;
+	}
+	DCACHE_UNLOCK();
+
+	if (old)
+		dcache_free(old);
+}
+
+/*
+ * Purge the entries for the path and all paths under it.
+ * @dvp:  vnode held by the caller.
+ * @name: name in the directory dvp, or NULL for dvp itself.
+ *
+ * This must be called when the name space is changed.
+ */
+void
+dcache_purge(vnode_t dvp, char *name)
+{
+	struct list gone;
+	list_t head, n, next;
+	struct dcache *dc;
+	char *path;
+	size_t len, nlen = 0;
+
+	path = dvp->v_path;
+	len = strlen(path);
+	if (len == 1)
+		len = 0;	/* root */
+	if (name != NULL)
+		nlen = strlen(name);
+
+	list_init(&gone);
+	DCACHE_LOCK();
+	head = &dvp->v_mount->m_dcache;
+	for (n = list_first(head); n != head; n = next) {
+		next = list_next(n);
+		dc = list_entry(n, struct dcache, d_mlink);
+		path = dc->d_path;
+		if (strncmp(path, dvp->v_path, len))
+			continue;
+		path += len;
+		if (name != NULL) {
+			if (*path != '/' || strncmp(path + 1, name, nlen))
+				continue;
+			path += nlen + 1;
+		}
+		if (*path != '\0' && *path != '/')
+			continue;
+		dcache_remove(dc);
+		list_insert(&gone, &dc->d_lru);
+	}
+	DCACHE_UNLOCK();
+
+	while (!list_empty(&gone)) {
+		n = list_first(&gone);
+		list_remove(n);
+		dcache_free(list_entry(n, struct dcache, d_lru));
+	}
+}
+
+#ifdef DEBUG
+/*
+ * Dump name cache.
+ */
+void
+dcache_dump(void)
+{
+	list_t n;
+	struct dcache *dc;
+
+	DCACHE_LOCK();
+	dprintf("Dump dcache\n");
+	dprintf(" entries %d/%d\n", dcache_count, DCACHE_SIZE);
+	dprintf(" enters  %lu (evicts %lu)\n", dcache_enters, dcache_evicts);
+	dprintf(" hits    %lu negative\n", dcache_hits);
+	dprintf(" vnode    mount    path\n");
+	dprintf(" -------- -------- ------------------------------\n");
+	for (n = list_first(&dcache_lru); n != &dcache_lru;
+	     n = list_next(n)) {
+		dc = list_entry(n, struct dcache, d_lru);
+		dprintf(" %08x %08x %s\n", (u_int)dc->d_vnode,
+			(u_int)dc->d_mount, dc->d_path);
+	}
+	dprintf("\n");
+	DCACHE_UNLOCK();
+}
+#endif
+
+void
+dcache_init(void)
+{
+	int i;
+
+	for (i = 0; i < DCACHE_BUCKETS; i++)
+		list_init(&dcache_table[i]);
+}
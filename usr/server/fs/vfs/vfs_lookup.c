@@ -44,68 +44,120 @@
 #include "vfs.h"
 
 /*
- * Convert a pathname into a pointer to a locked vnode.
- * @path: full path name.
- * @vpp:  vnode to be returned.
+ * Get the full path name of the parent directory of vnode.
+ * @vp:   locked vnode.
+ * @path: buffer to store the path.
+ *
+ * The root of the mounted file system is replaced by the
+ * vnode covered in the upper file system.
  */
-int
-namei(char *path, vnode_t *vpp)
+static int
+namei_parent(vnode_t vp, char *path)
 {
-	char *p;
-	char node[PATH_MAX];
-	char name[PATH_MAX];
 	mount_t mp;
-	vnode_t dvp, vp;
-	int err, i;
-
-	DPRINTF(VFSDB_VNODE, ("namei: path=%s\n", path));
+	char *p;
 
-	/*
-	 * Convert a full path name to its mount point and
-	 * the local node in the file system.
-	 */
-	if (vfs_findroot(path, &mp, &p))
-		return ENOTDIR;
-	strcpy(node, "/");
-	strlcat(node, p, PATH_MAX);
-	vp = vn_lookup(mp, node);
-	if (vp) {
-		/* vnode is already active. */
-		*vpp = vp;
+	mp = vp->v_mount;
+	while ((vp->v_flags & VROOT) && mp->m_covered != NULL) {
+		vp = mp->m_covered;
+		mp = vp->v_mount;
+	}
+	if (vp->v_flags & VROOT) {
+		/* The parent of the global root is itself. */
+		strcpy(path, "/");
 		return 0;
 	}
-	/*
-	 * Find target vnode, started from root directory.
-	 * This is done to attach the fs specific data to
-	 * the target vnode.
-	 */
-	if ((dvp = mp->m_root) == NULL)
-		sys_panic("VFS: no root");
+	if (strlen(mp->m_path) + strlen(vp->v_path) >= PATH_MAX)
+		return ENAMETOOLONG;
+	strcpy(path, (strlen(mp->m_path) == 1) ? "" : mp->m_path);
+	strcat(path, vp->v_path);
+	p = strrchr(path, '/');
+	if (p == path)
+		p++;
+	*p = '\0';
+	return 0;
+}
 
-	vref(dvp);
-	vn_lock(dvp);
-	node[0] = '\0';
+/*
+ * Walk the path from the directory vnode.
+ * @dvp:  locked directory vnode to start the walk.
+ * @p:    path name relative to dvp.
+ * @vpp:  vnode to be returned.
+ *
+ * The reference and the lock of dvp are passed to this routine.
+ * The walk goes down to the root of a file system mounted on
+ * a directory, and ".." goes up across the mount point.
+ */
+static int
+namei_walk(vnode_t dvp, char *p, vnode_t *vpp)
+{
+	char *name;
+	char node[PATH_MAX];
+	mount_t mp;
+	vnode_t vp;
+	size_t len;
+	int err, i;
+
+	mp = dvp->v_mount;
+	len = strlcpy(node, dvp->v_path, PATH_MAX);
+	if (len == 1)
+		len = 0;	/* root */
 
 	while (*p != '\0') {
+		if (dvp->v_type != VDIR) {
+			vput(dvp);
+			return ENOTDIR;
+		}
+		while (*p == '/')
+			p++;
+		if (*p == '\0')
+			break;
 		/*
-		 * Get lower directory/file name.
+		 * Handle "." and "..".
 		 */
-		while (*p == '/')
+		if (p[0] == '.' && (p[1] == '/' || p[1] == '\0')) {
 			p++;
-		for (i = 0; i < PATH_MAX; i++) {
-			if (*p == '\0' || *p == '/')
-				break;
+			continue;
+		}
+		if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0')) {
+			p += 2;
+			err = namei_parent(dvp, node);
+			vput(dvp);
+			if (err)
+				return err;
+			if ((err = namei(NULL, node, &dvp)) != 0)
+				return err;
+			mp = dvp->v_mount;
+			len = strlcpy(node, dvp->v_path, PATH_MAX);
+			if (len == 1)
+				len = 0;
+			continue;
+		}
+
+		/*
+		 * Append lower directory/file name to the node.
+		 */
+		node[len++] = '/';
+		name = &node[len];
+		for (i = 0; *p != '\0' && *p != '/'; i++) {
+			if (len + i >= PATH_MAX - 1) {
+				vput(dvp);
+				return ENAMETOOLONG;
+			}
 			name[i] = *p++;
 		}
 		name[i] = '\0';
+		len += i;
 
 		/*
 		 * Get a vnode for the target.
 		 */
-		strlcat(node, "/", PATH_MAX);
-		strlcat(node, name, PATH_MAX);
 		vp = vn_lookup(mp, node);
 		if (vp == NULL) {
+			if (dcache_lookup(mp, node) == ENOENT) {
+				vput(dvp);
+				return ENOENT;
+			}
 			vp = vget(mp, node);
 			if (vp == NULL) {
 				vput(dvp);
@@ -113,25 +165,97 @@ namei(char *path, vnode_t *vpp)
 			}
 			/* Find a vnode in this directory. */
 			err = VOP_LOOKUP(dvp, name, vp);
-			if (err || (*p == '/' && vp->v_type != VDIR)) {
+			if (err) {
 				/* Not found */
+				if (err == ENOENT)
+					dcache_enter(mp, node, NULL);
 				vput(vp);
 				vput(dvp);
 				return err;
 			}
 		}
+		dcache_enter(mp, node, vp);
 		vput(dvp);
+
+		/*
+		 * Go to the root of the file system mounted here.
+		 */
+		if (vp->v_mountedhere != NULL) {
+			mp = vp->v_mountedhere;
+			vput(vp);
+			vp = mp->m_root;
+			vref(vp);
+			vn_lock(vp);
+			len = 0;
+		}
 		dvp = vp;
-		while (*p != '\0' && *p != '/')
-			p++;
 	}
-	*vpp = vp;
+	*vpp = dvp;
 	return 0;
 }
 
+/*
+ * Convert a pathname into a pointer to a locked vnode.
+ * @dvp:  directory vnode to start the lookup, or NULL.
+ * @path: path name.
+ * @vpp:  vnode to be returned.
+ *
+ * A relative path is looked up from dvp, or from the global
+ * root if dvp is NULL.
+ */
+int
+namei(vnode_t dvp, char *path, vnode_t *vpp)
+{
+	char *p;
+	char node[PATH_MAX];
+	mount_t mp;
+	vnode_t vp;
+
+	DPRINTF(VFSDB_VNODE, ("namei: path=%s\n", path));
+
+	if (dvp != NULL && *path != '/') {
+		vref(dvp);
+		vn_lock(dvp);
+		return namei_walk(dvp, path, vpp);
+	}
+
+	/*
+	 * Convert a full path name to its mount point and
+	 * the local node in the file system.
+	 */
+	if (vfs_findroot((*path == '/') ? path : "/", &mp, &p))
+		return ENOTDIR;
+	if (*path != '/')
+		p = path;
+	strcpy(node, "/");
+	strlcat(node, p, PATH_MAX);
+	vp = vn_lookup(mp, node);
+	if (vp) {
+		/* vnode is already active. */
+		dcache_enter(mp, node, vp);
+		*vpp = vp;
+		return 0;
+	}
+	if (dcache_lookup(mp, node) == ENOENT)
+		return ENOENT;
+
+	/*
+	 * Find target vnode, started from root directory.
+	 * This is done to attach the fs specific data to
+	 * the target vnode.
+	 */
+	if ((dvp = mp->m_root) == NULL)
+		sys_panic("VFS: no root");
+
+	vref(dvp);
+	vn_lock(dvp);
+	return namei_walk(dvp, p, vpp);
+}
+
 /*
  * Search a pathname.
- * @path: full path.
+ * @dvp:  directory vnode to start the lookup, or NULL.
+ * @path: path name.
  * @vpp:  pointer to locked vnode for directory.
  * @name: pointer to file name in path.
  *
@@ -139,10 +263,9 @@ namei(char *path, vnode_t *vpp)
  * This routine returns a locked directory vnode and file name.
  */
 int
-lookup(char *path, vnode_t *vpp, char **name)
+lookup(vnode_t dvp, char *path, vnode_t *vpp, char **name)
 {
 	char buf[PATH_MAX];
-	char root[] = "/";
 	char *file, *dir;
 	vnode_t vp;
 	int err;
@@ -152,12 +275,14 @@ lookup(char *path, vnode_t *vpp, char **name)
 	/*
 	 * Get the path for directory.
 	 */
-	strcpy(buf, path);
-	file = strrchr(buf, '/');
-	if (!buf[0])
+	if (!path[0])
 		return ENOTDIR;
-	if (file == buf)
-		dir = root;
+	strlcpy(buf, path, PATH_MAX);
+	file = strrchr(buf, '/');
+	if (file == NULL)
+		dir = "";
+	else if (file == buf)
+		dir = "/";
 	else {
 		*file = '\0';
 		dir = buf;
@@ -165,7 +290,7 @@ lookup(char *path, vnode_t *vpp, char **name)
 	/*
 	 * Get the vnode for directory
 	 */
-	if ((err = namei(dir, &vp)) != 0)
+	if ((err = namei(dvp, dir, &vp)) != 0)
 		return err;
 	if (vp->v_type != VDIR) {
 		vput(vp);
@@ -176,6 +301,7 @@ lookup(char *path, vnode_t *vpp, char **name)
 	/*
 	 * Get the file name
 	 */
-	*name = strrchr(path, '/') + 1;
+	file = strrchr(path, '/');
+	*name = (file == NULL) ? path : file + 1;
 	return 0;
 }
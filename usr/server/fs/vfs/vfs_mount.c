@@ -56,6 +56,16 @@
  */
 static struct list mount_list = LIST_INIT(mount_list);
 
+#define MOUNT_BUCKETS	16		/* size of mount hash table */
+
+/*
+ * Hash table for mount points.
+ * vfs_findroot() looks up each leading directory of the path
+ * in this table, up to the depth of the deepest mount point.
+ */
+static struct list mount_table[MOUNT_BUCKETS];
+static int mount_depth;
+
 /*
  * Global lock to access mount point.
  */
@@ -68,6 +78,93 @@ static mutex_t mount_lock = MUTEX_INITIALIZER;
 #define MOUNT_UNLOCK()
 #endif
 
+/*
+ * Get the hash value from the first len bytes of path.
+ */
+static u_int
+mount_hash(char *path, size_t len)
+{
+	u_int val = 0;
+
+	while (len-- > 0)
+		val = ((val << 5) + val) + *path++;
+	return val;
+}
+
+/*
+ * Get the number of components in the path.
+ */
+static int
+mount_pathdepth(char *path)
+{
+	int depth = 0;
+
+	for (; *path != '\0'; path++) {
+		if (*path != '/' && (*(path + 1) == '/' || *(path + 1) == '\0'))
+			depth++;
+	}
+	return depth;
+}
+
+/*
+ * Insert the mount point to the mount list and hash table.
+ * Must be called with MOUNT_LOCK held.
+ */
+static void
+mount_insert(mount_t mp)
+{
+	int depth;
+
+	list_insert(&mount_list, &mp->m_link);
+	list_insert(&mount_table[mount_hash(mp->m_path, strlen(mp->m_path)) &
+				 (MOUNT_BUCKETS - 1)], &mp->m_hash);
+	depth = mount_pathdepth(mp->m_path);
+	if (depth > mount_depth)
+		mount_depth = depth;
+}
+
+/*
+ * Remove the mount point from the mount list and hash table.
+ * Must be called with MOUNT_LOCK held.
+ */
+static void
+mount_remove(mount_t mp)
+{
+	list_t head, n;
+	int depth;
+
+	list_remove(&mp->m_link);
+	list_remove(&mp->m_hash);
+
+	mount_depth = 0;
+	head = &mount_list;
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		depth = mount_pathdepth(list_entry(n, struct mount,
+						   m_link)->m_path);
+		if (depth > mount_depth)
+			mount_depth = depth;
+	}
+}
+
+/*
+ * Find the mount point whose path is the first len bytes of path.
+ * @val: hash value of the path.
+ */
+static mount_t
+mount_find(char *path, size_t len, u_int val)
+{
+	list_t head, n;
+	mount_t mp;
+
+	head = &mount_table[val & (MOUNT_BUCKETS - 1)];
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		mp = list_entry(n, struct mount, m_hash);
+		if (!strncmp(mp->m_path, path, len) && mp->m_path[len] == '\0')
+			return mp;
+	}
+	return NULL;
+}
+
 /*
  * Lookup file system.
  */
@@ -136,6 +233,7 @@ sys_mount(char *dev, char *dir, char *fsname, int flags, void *data)
 	mp->m_op = fs->vs_op;
 	mp->m_flags = flags;
 	mp->m_dev = (dev_t)device;
+	list_init(&mp->m_dcache);
 	strlcpy(mp->m_path, dir, PATH_MAX);
 	mp->m_path[PATH_MAX - 1] = '\0';
 
@@ -146,7 +244,7 @@ sys_mount(char *dev, char *dir, char *fsname, int flags, void *data)
 		/* Ignore if it mounts to global root directory. */
 		vp_covered = NULL;
 	} else {
-		if ((err = namei(dir, &vp_covered)) != 0) {
+		if ((err = namei(NULL, dir, &vp_covered)) != 0) {
 			err = ENOENT;
 			goto err2;
 		}
@@ -154,6 +252,12 @@ sys_mount(char *dev, char *dir, char *fsname, int flags, void *data)
 			err = ENOTDIR;
 			goto err3;
 		}
+		if (vp_covered->v_mountedhere != NULL) {
+			err = EBUSY;
+			goto err3;
+		}
+		/* Forget the names under the directory to be covered. */
+		dcache_purge(vp_covered, NULL);
 	}
 	mp->m_covered = vp_covered;
 
@@ -179,13 +283,15 @@ sys_mount(char *dev, char *dir, char *fsname, int flags, void *data)
 	 * Keep reference count for root/covered vnode.
 	 */
 	vn_unlock(vp);
-	if (vp_covered)
+	if (vp_covered) {
+		vp_covered->v_mountedhere = mp;
 		vn_unlock(vp_covered);
+	}
 
 	/*
 	 * Insert to mount list
 	 */
-	list_insert(&mount_list, &mp->m_link);
+	mount_insert(mp);
 	MOUNT_UNLOCK();
 	return 0;
  err4:
@@ -230,11 +336,15 @@ sys_umount(char *path)
 		err = EINVAL;
 		goto out;
 	}
+	/* Release vnodes held by the name cache */
+	dcache_purge(mp->m_root, NULL);
+
 	if ((err = VFS_UNMOUNT(mp)) != 0)
 		goto out;
-	list_remove(&mp->m_link);
+	mount_remove(mp);
 
 	/* Decrement referece count of root vnode */
+	mp->m_covered->v_mountedhere = NULL;
 	vrele(mp->m_covered);
 
 	/* Release all vnodes */
@@ -265,34 +375,7 @@ sys_sync(void)
 		VFS_SYNC(mp);
 	}
 	MOUNT_UNLOCK();
-	bio_sync();
-	return 0;
-}
-
-/*
- * Compare two path strings. Return matched length.
- * @path: target path.
- * @root: vfs root path as mount point.
- */
-static size_t
-count_match(char *path, char *mount_root)
-{
-	size_t len = 0;
-
-	while (*path && *mount_root) {
-		if (*path++ != *mount_root++)
-			break;
-		len++;
-	}
-	if (*mount_root != '\0')
-		return 0;
-
-	if (len == 1 && *(path - 1) == '/')
-		return 1;
-
-	if (*path == '\0' || *path == '/')
-		return len;
-	return 0;
+	return bio_sync();
 }
 
 /*
@@ -305,23 +388,35 @@ int
 vfs_findroot(char *path, mount_t *mp, char **root)
 {
 	mount_t m, tmp;
-	list_t head, n;
 	size_t len, max_len = 0;
+	u_int val;
+	int depth;
 
-	if (!path)
+	if (!path || *path != '/')
 		return -1;
 
-	/* Find mount point from nearest path */
+	/*
+	 * Find mount point from nearest path.  The prefixes of
+	 * the path are looked up from the shortest, so the last
+	 * match is the nearest one.
+	 */
 	MOUNT_LOCK();
-	m = NULL;
-	head = &mount_list;
-	for (n = list_first(head); n != head; n = list_next(n)) {
-		tmp = list_entry(n, struct mount, m_link);
-		len = count_match(path, tmp->m_path);
-		if (len > max_len) {
-			max_len = len;
-			m = tmp;
+	val = mount_hash(path, 1);
+	if ((m = mount_find(path, 1, val)) != NULL)
+		max_len = 1;
+	depth = 0;
+	for (len = 1; depth < mount_depth; len++) {
+		if ((path[len] == '/' || path[len] == '\0') &&
+		    path[len - 1] != '/') {
+			depth++;
+			if ((tmp = mount_find(path, len, val)) != NULL) {
+				m = tmp;
+				max_len = len;
+			}
 		}
+		if (path[len] == '\0')
+			break;
+		val = ((val << 5) + val) + path[len];
 	}
 	MOUNT_UNLOCK();
 	if (m == NULL)
@@ -358,6 +453,15 @@ vfs_unbusy(mount_t mp)
 	MOUNT_UNLOCK();
 }
 
+void
+mount_init(void)
+{
+	int i;
+
+	for (i = 0; i < MOUNT_BUCKETS; i++)
+		list_init(&mount_table[i]);
+}
+
 int
 vfs_nullop(void)
 {
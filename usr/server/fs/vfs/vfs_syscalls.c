@@ -33,6 +33,7 @@
  */
 
 #include <prex/prex.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/vnode.h>
 #include <sys/file.h>
@@ -54,7 +55,7 @@
 int blocking_count;
 
 int
-sys_open(char *path, int flags, mode_t mode, file_t *pfp)
+sys_open(vnode_t cdvp, char *path, int flags, mode_t mode, file_t *pfp)
 {
 	vnode_t vp, dvp;
 	file_t fp;
@@ -68,10 +69,10 @@ sys_open(char *path, int flags, mode_t mode, file_t *pfp)
 	if  ((flags & (FREAD | FWRITE)) == 0)
 		return EINVAL;
 	if (flags & O_CREAT) {
-		err = namei(path, &vp);
+		err = namei(cdvp, path, &vp);
 		if (err == ENOENT) {
 			/* Create new file. */
-			if ((err = lookup(path, &dvp, &filename)) != 0)
+			if ((err = lookup(cdvp, path, &dvp, &filename)) != 0)
 				return err;
 			if (dvp->v_mount->m_flags & MNT_RDONLY) {
 				vput(dvp);
@@ -80,10 +81,12 @@ sys_open(char *path, int flags, mode_t mode, file_t *pfp)
 			mode &= ~S_IFMT;
 			mode |= S_IFREG;
 			err = VOP_CREATE(dvp, filename, flags, mode);
+			if (!err)
+				dcache_purge(dvp, filename);
 			vput(dvp);
 			if (err)
 				return err;
-			if ((err = namei(path, &vp)) != 0)
+			if ((err = namei(cdvp, path, &vp)) != 0)
 				return err;
 			flags &= ~O_TRUNC;
 		} else if (err) {
@@ -98,7 +101,7 @@ sys_open(char *path, int flags, mode_t mode, file_t *pfp)
 		}
 	} else {
 		/* Open */
-		if ((err = namei(path, &vp)) != 0)
+		if ((err = namei(cdvp, path, &vp)) != 0)
 			return err;
 	}
 	if ((flags & O_CREAT) == 0) {
@@ -213,6 +216,194 @@ sys_write(file_t fp, void *buf, size_t size, size_t *count)
 	return err;
 }
 
+/*
+ * Read into each element of iov in turn, stopping at the first
+ * short transfer.  If offset is -1 the file offset is used and
+ * advanced, otherwise the file offset is left as it was.  The
+ * buffers must already be mapped into our address space.
+ */
+int
+sys_preadv(file_t fp, struct iovec *iov, int iovcnt, off_t offset,
+	   size_t *count)
+{
+	vnode_t vp;
+	off_t saved;
+	size_t total, bytes;
+	int i, err = 0;
+
+	DPRINTF(VFSDB_SYSCALL, ("sys_preadv: fp=%x iovcnt=%d offset=%d\n",
+				(u_int)fp, iovcnt, (int)offset));
+
+	if ((fp->f_flags & FREAD) == 0)
+		return EPERM;
+	vp = fp->f_vnode;
+	if (offset != -1 && (vp->v_type == VFIFO || vp->v_type == VSOCK))
+		return ESPIPE;
+
+	vn_lock(vp);
+	saved = fp->f_offset;
+	if (offset != -1)
+		fp->f_offset = offset;
+	total = 0;
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		err = VOP_READ(vp, fp, iov[i].iov_base, iov[i].iov_len,
+			       &bytes);
+		if (err)
+			break;
+		total += bytes;
+		if (bytes < iov[i].iov_len)
+			break;
+	}
+	if (offset != -1)
+		fp->f_offset = saved;
+	vn_unlock(vp);
+
+	*count = total;
+	return total ? 0 : err;
+}
+
+/*
+ * Write counterpart of sys_preadv().
+ */
+int
+sys_pwritev(file_t fp, struct iovec *iov, int iovcnt, off_t offset,
+	    size_t *count)
+{
+	vnode_t vp;
+	off_t saved;
+	size_t total, bytes;
+	int i, err = 0;
+
+	DPRINTF(VFSDB_SYSCALL, ("sys_pwritev: fp=%x iovcnt=%d offset=%d\n",
+				(u_int)fp, iovcnt, (int)offset));
+
+	if ((fp->f_flags & FWRITE) == 0)
+		return EPERM;
+	vp = fp->f_vnode;
+	if (offset != -1 && (vp->v_type == VFIFO || vp->v_type == VSOCK))
+		return ESPIPE;
+
+	vn_lock(vp);
+	saved = fp->f_offset;
+	if (offset != -1)
+		fp->f_offset = offset;
+	total = 0;
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		err = VOP_WRITE(vp, fp, iov[i].iov_base, iov[i].iov_len,
+				&bytes);
+		if (err)
+			break;
+		total += bytes;
+		if (bytes < iov[i].iov_len)
+			break;
+	}
+	if (offset != -1)
+		fp->f_offset = saved;
+	vn_unlock(vp);
+
+	*count = total;
+	return total ? 0 : err;
+}
+
+/*
+ * Read or write one chunk at *pos, or at the file offset if
+ * pos is NULL.  A positioned transfer leaves the file offset
+ * alone and advances *pos instead.
+ */
+static int
+copy_chunk(file_t fp, int rw, void *buf, size_t size, off_t *pos,
+	   size_t *count)
+{
+	vnode_t vp;
+	off_t saved;
+	int err;
+
+	vp = fp->f_vnode;
+	vn_lock(vp);
+	saved = fp->f_offset;
+	if (pos != NULL)
+		fp->f_offset = *pos;
+	if (rw == FREAD)
+		err = VOP_READ(vp, fp, buf, size, count);
+	else
+		err = VOP_WRITE(vp, fp, buf, size, count);
+	if (pos != NULL) {
+		fp->f_offset = saved;
+		if (!err)
+			*pos += *count;
+	}
+	vn_unlock(vp);
+	return err;
+}
+
+/*
+ * Copy up to size bytes from one file to another inside the
+ * server.  inoff and outoff are as for sys_preadv().  The copy
+ * stops at end of file or at the first short write.  Each vnode
+ * is locked only while its chunk is transferred, so in and out
+ * may be the same file.
+ */
+int
+sys_copy(file_t in, off_t inoff, file_t out, off_t outoff, size_t size,
+	 size_t *count)
+{
+	vnode_t ivp, ovp;
+	char *buf;
+	off_t *ipos, *opos;
+	size_t total, len, nr, nw;
+	int err = 0;
+
+	DPRINTF(VFSDB_SYSCALL, ("sys_copy: in=%x out=%x size=%d\n",
+				(u_int)in, (u_int)out, size));
+
+	if ((in->f_flags & FREAD) == 0 || (out->f_flags & FWRITE) == 0)
+		return EBADF;
+	ivp = in->f_vnode;
+	ovp = out->f_vnode;
+	if (ivp->v_type == VDIR || ovp->v_type == VDIR)
+		return EISDIR;
+	if ((inoff != -1 && (ivp->v_type == VFIFO || ivp->v_type == VSOCK)) ||
+	    (outoff != -1 && (ovp->v_type == VFIFO || ovp->v_type == VSOCK)))
+		return ESPIPE;
+
+	*count = 0;
+	if (size == 0)
+		return 0;
+	if ((buf = malloc(MIN(size, COPYBUFSZ))) == NULL)
+		return ENOMEM;
+	ipos = (inoff == -1) ? NULL : &inoff;
+	opos = (outoff == -1) ? NULL : &outoff;
+
+	total = 0;
+	while (total < size) {
+		len = MIN(size - total, COPYBUFSZ);
+		err = copy_chunk(in, FREAD, buf, len, ipos, &nr);
+		if (err || nr == 0)
+			break;
+		err = copy_chunk(out, FWRITE, buf, nr, opos, &nw);
+		if (err)
+			nw = 0;
+		total += nw;
+		if (nw < nr) {
+			/* Give back what was read but not written. */
+			if (ipos == NULL && ivp->v_type == VREG) {
+				vn_lock(ivp);
+				in->f_offset -= nr - nw;
+				vn_unlock(ivp);
+			}
+			break;
+		}
+	}
+	free(buf);
+
+	*count = total;
+	return total ? 0 : err;
+}
+
 int
 sys_lseek(file_t fp, off_t off, int type, off_t *origin)
 {
@@ -277,6 +468,36 @@ sys_ioctl(file_t fp, u_long request, void *buf)
 	return err;
 }
 
+/*
+ * Check the readiness of a file.  If nothing is ready and sem
+ * is given, the semaphore is left on the vnode to be posted
+ * when the file may become ready.
+ */
+int
+sys_poll(struct task *t, file_t fp, int events, sem_t sem, int *revents)
+{
+	vnode_t vp;
+	int err, gen;
+
+	DPRINTF(VFSDB_SYSCALL, ("sys_poll: fp=%x events=%x\n", fp, events));
+
+	vp = fp->f_vnode;
+	vn_lock(vp);
+	if (vp->v_type == VCHR || vp->v_type == VBLK) {
+		/* Devices are woken by the kernel. */
+		gen = devpoll_start();
+		err = VOP_POLL(vp, fp, events, revents);
+		if (err == 0 && *revents == 0 && sem != SEM_NULL)
+			err = devpoll_wait(t, sem, gen);
+	} else {
+		err = VOP_POLL(vp, fp, events, revents);
+		if (err == 0 && *revents == 0 && sem != SEM_NULL)
+			err = vn_pollwait(vp, t, sem);
+	}
+	vn_unlock(vp);
+	return err;
+}
+
 int
 sys_fsync(file_t fp)
 {
@@ -312,23 +533,24 @@ sys_fstat(file_t fp, struct stat *st)
 
 /*
  * Return 0 if directory is empty
+ * @dvp: locked directory vnode.
  */
 static int
-check_dir_empty(char *path)
+check_dir_empty(vnode_t dvp)
 {
-	int err;
-	file_t fp;
+	struct file f;
 	struct dirent dir;
+	int err;
 
-	if ((err = sys_opendir(path, &fp)) != 0)
-		return err;
+	memset(&f, 0, sizeof(struct file));
+	f.f_vnode = dvp;
+	f.f_count = 1;
 	do {
-		err = sys_readdir(fp, &dir);
+		err = VOP_READDIR(dvp, &f, &dir);
 		if (err)
 			break;
 	} while (!strcmp(dir.d_name, ".") || !strcmp(dir.d_name, ".."));
-
-	sys_closedir(fp);
+	VOP_CLOSE(dvp, &f);
 
 	if (err == ENOENT)
 		return 0;
@@ -338,7 +560,7 @@ check_dir_empty(char *path)
 }
 
 int
-sys_opendir(char *path, file_t *file)
+sys_opendir(vnode_t cdvp, char *path, file_t *file)
 {
 	vnode_t dvp;
 	file_t fp;
@@ -346,7 +568,7 @@ sys_opendir(char *path, file_t *file)
 
 	DPRINTF(VFSDB_SYSCALL, ("sys_opendir: path=%s\n", path));
 
-	if ((err = sys_open(path, O_RDONLY, 0, &fp)) != 0)
+	if ((err = sys_open(cdvp, path, O_RDONLY, 0, &fp)) != 0)
 		return err;
 
 	dvp = fp->f_vnode;
@@ -400,6 +622,60 @@ sys_readdir(file_t fp, struct dirent *dir)
 	return err;
 }
 
+/*
+ * Read as many directory entries as fit in buf.  Each entry is
+ * packed as a struct dirent cut down to d_reclen bytes.  The
+ * position of the first entry is returned in base, and 0 bytes
+ * are returned at the end of the directory.
+ */
+int
+sys_getdents(file_t fp, void *buf, size_t size, size_t *count, off_t *base)
+{
+	vnode_t dvp;
+	struct dirent dir;
+	char *p;
+	off_t off;
+	size_t len;
+	int err;
+
+	DPRINTF(VFSDB_SYSCALL, ("sys_getdents: fp=%x size=%d\n",
+				(u_int)fp, size));
+
+	dvp = fp->f_vnode;
+	vn_lock(dvp);
+	if (dvp->v_type != VDIR) {
+		vn_unlock(dvp);
+		return ENOTDIR;
+	}
+	*base = fp->f_offset;
+	p = buf;
+	for (;;) {
+		off = fp->f_offset;
+		dir.d_size = 0;
+		dir.d_mode = 0;
+		dir.d_pad = 0;
+		if ((err = VOP_READDIR(dvp, fp, &dir)) != 0)
+			break;
+		len = _DIRENT_RECLEN(dir.d_namlen);
+		if (p + len > (char *)buf + size) {
+			/* Leave this entry for the next call. */
+			fp->f_offset = off;
+			break;
+		}
+		dir.d_reclen = (uint16_t)len;
+		memcpy(p, &dir, len);
+		p += len;
+	}
+	vn_unlock(dvp);
+
+	*count = p - (char *)buf;
+	if (*count == 0 && err == 0)
+		return EINVAL;		/* buffer too small */
+	if (err == ENOENT || *count > 0)
+		err = 0;
+	return err;
+}
+
 int
 sys_rewinddir(file_t fp)
 {
@@ -449,7 +725,7 @@ sys_telldir(file_t fp, long *loc)
 }
 
 int
-sys_mkdir(char *path, mode_t mode)
+sys_mkdir(vnode_t cdvp, char *path, mode_t mode)
 {
 	char *name;
 	vnode_t vp, dvp;
@@ -457,14 +733,14 @@ sys_mkdir(char *path, mode_t mode)
 
 	DPRINTF(VFSDB_SYSCALL, ("sys_mkdir: path=%s mode=%d\n",	path, mode));
 
-	if ((err = namei(path, &vp)) == 0) {
+	if ((err = namei(cdvp, path, &vp)) == 0) {
 		/* File already exists */
 		vput(vp);
 		return EEXIST;
 	}
 	/* Notice: vp is invalid here! */
 
-	if ((err = lookup(path, &dvp, &name)) != 0) {
+	if ((err = lookup(cdvp, path, &dvp, &name)) != 0) {
 		/* Directory already exists */
 		return err;
 	}
@@ -476,13 +752,15 @@ sys_mkdir(char *path, mode_t mode)
 	mode |= S_IFDIR;
 
 	err = VOP_MKDIR(dvp, name, mode);
+	if (!err)
+		dcache_purge(dvp, name);
  out:
 	vput(dvp);
 	return err;
 }
 
 int
-sys_rmdir(char *path)
+sys_rmdir(vnode_t cdvp, char *path)
 {
 	vnode_t vp, dvp;
 	int err;
@@ -490,10 +768,9 @@ sys_rmdir(char *path)
 
 	DPRINTF(VFSDB_SYSCALL, ("sys_rmdir: path=%s\n", path));
 
-	if ((err = check_dir_empty(path)) != 0)
-		return err;
-	if ((err = namei(path, &vp)) != 0)
+	if ((err = namei(cdvp, path, &vp)) != 0)
 		return err;
+	dcache_purge(vp, NULL);
 
 	if (vp->v_mount->m_flags & MNT_RDONLY) {
 		err = EROFS;
@@ -503,11 +780,13 @@ sys_rmdir(char *path)
 		err = ENOTDIR;
 		goto out;
 	}
-	if (vp->v_flags & VROOT || vcount(vp) >= 2) {
+	if ((err = check_dir_empty(vp)) != 0)
+		goto out;
+	if (vp->v_flags & VROOT || vp->v_mountedhere || vcount(vp) >= 2) {
 		err = EBUSY;
 		goto out;
 	}
-	if ((err = lookup(path, &dvp, &name)) != 0)
+	if ((err = lookup(cdvp, path, &dvp, &name)) != 0)
 		goto out;
 
 	err = VOP_RMDIR(dvp, vp, name);
@@ -522,7 +801,7 @@ sys_rmdir(char *path)
 }
 
 int
-sys_mkfifo(char *path, mode_t mode)
+sys_mkfifo(vnode_t cdvp, char *path, mode_t mode)
 {
 	char *name;
 	vnode_t vp, dvp;
@@ -530,14 +809,14 @@ sys_mkfifo(char *path, mode_t mode)
 
 	dprintf("sys_mkfifo: path=%s mode=%d\n", path, mode);
 
-	if ((err = namei(path, &vp)) == 0) {
+	if ((err = namei(cdvp, path, &vp)) == 0) {
 		/* File already exists */
 		vput(vp);
 		return EEXIST;
 	}
 	/* Notice: vp is invalid here! */
 
-	if ((err = lookup(path, &dvp, &name)) != 0) {
+	if ((err = lookup(cdvp, path, &dvp, &name)) != 0) {
 		/* Directory already exists */
 		return err;
 	}
@@ -559,13 +838,15 @@ sys_mkfifo(char *path, mode_t mode)
 	mode |= S_IFIFO;
 
 	err = VOP_MKFIFO(dvp, name, mode);
+	if (!err)
+		dcache_purge(dvp, name);
  out:
 	vput(dvp);
 	return err;
 }
 
 int
-sys_mknod(char *path, mode_t mode)
+sys_mknod(vnode_t cdvp, char *path, mode_t mode)
 {
 	char *name;
 	vnode_t vp, dvp;
@@ -584,12 +865,12 @@ sys_mknod(char *path, mode_t mode)
 		return EINVAL;
 	}
 
-	if ((err = namei(path, &vp)) == 0) {
+	if ((err = namei(cdvp, path, &vp)) == 0) {
 		vput(vp);
 		return EEXIST;
 	}
 
-	if ((err = lookup(path, &dvp, &name)) != 0)
+	if ((err = lookup(cdvp, path, &dvp, &name)) != 0)
 		return err;
 
 	if (dvp->v_mount->m_flags & MNT_RDONLY) {
@@ -604,47 +885,50 @@ sys_mknod(char *path, mode_t mode)
 		err = VOP_MKFIFO(dvp, name, mode);
 	else
 		err = VOP_CREATE(dvp, name, flags, mode);
-
+	if (!err)
+		dcache_purge(dvp, name);
  out:
 	vput(dvp);
 	return err;
 }
 
+/*
+ * Rename a file or directory.
+ * @sdvp: directory vnode to start the lookup of src, or NULL.
+ * @ddvp: directory vnode to start the lookup of dest, or NULL.
+ */
 int
-sys_rename(char *src, char *dest)
+sys_rename(vnode_t sdvp, char *src, vnode_t ddvp, char *dest)
 {
 	vnode_t vp1, vp2 = 0, dvp1, dvp2;
 	char *sname, *dname;
 	int err;
 	size_t len;
-	char root[] = "/";
 
 	DPRINTF(VFSDB_SYSCALL, ("sys_rename: src=%s dest=%s\n", src, dest));
 
-	if ((err = namei(src, &vp1)) != 0)
+	if ((err = namei(sdvp, src, &vp1)) != 0)
 		return err;
+	dcache_purge(vp1, NULL);
 	if (vp1->v_mount->m_flags & MNT_RDONLY) {
 		err = EROFS;
 		goto err1;
 	}
-	/* If source and dest are the same, do nothing */
-	if (!strncmp(src, dest, PATH_MAX))
-		goto err1;
-
-	/* Check if target is directory of source */
-	len = strlen(dest);
-	if (!strncmp(src, dest, len)) {
-		err = EINVAL;
-		goto err1;
-	}
 	/* Is the source busy ? */
-	if (vcount(vp1) >= 2) {
+	if (vp1->v_flags & VROOT || vp1->v_mountedhere || vcount(vp1) >= 2) {
 		err = EBUSY;
 		goto err1;
 	}
 	/* Check type of source & target */
-	err = namei(dest, &vp2);
+	err = namei(ddvp, dest, &vp2);
 	if (err == 0) {
+		/* If source and dest are the same, do nothing */
+		if (vp2 == vp1) {
+			vput(vp2);
+			vp2 = 0;
+			goto err1;
+		}
+		dcache_purge(vp2, NULL);
 		/* target exists */
 		if (vp1->v_type == VDIR && vp2->v_type != VDIR) {
 			err = ENOTDIR;
@@ -653,32 +937,23 @@ sys_rename(char *src, char *dest)
 			err = EISDIR;
 			goto err2;
 		}
-		if (vp2->v_type == VDIR && check_dir_empty(dest)) {
+		if (vp2->v_type == VDIR && check_dir_empty(vp2)) {
 			err = EEXIST;
 			goto err2;
 		}
 
-		if (vcount(vp2) >= 2) {
+		if (vp2->v_mountedhere || vcount(vp2) >= 2) {
 			err = EBUSY;
 			goto err2;
 		}
+	} else {
+		vp2 = 0;
 	}
 
-	dname = strrchr(dest, '/');
-	if (dname == NULL) {
-		err = ENOTDIR;
-		goto err2;
-	}
-	if (dname == dest)
-		dest = root;
-
-	*dname = 0;
-	dname++;
-
-	if ((err = lookup(src, &dvp1, &sname)) != 0)
+	if ((err = lookup(sdvp, src, &dvp1, &sname)) != 0)
 		goto err2;
 
-	if ((err = namei(dest, &dvp2)) != 0)
+	if ((err = lookup(ddvp, dest, &dvp2, &dname)) != 0)
 		goto err3;
 
 	/* The source and dest must be same file system */
@@ -686,7 +961,16 @@ sys_rename(char *src, char *dest)
 		err = EXDEV;
 		goto err4;
 	}
+	/* Check if target is directory of source */
+	len = strlen(vp1->v_path);
+	if (!strncmp(dvp2->v_path, vp1->v_path, len) &&
+	    (dvp2->v_path[len] == '\0' || dvp2->v_path[len] == '/')) {
+		err = EINVAL;
+		goto err4;
+	}
 	err = VOP_RENAME(dvp1, vp1, sname, dvp2, vp2, dname);
+	if (!err)
+		dcache_purge(dvp2, dname);
  err4:
 	vput(dvp2);
  err3:
@@ -700,7 +984,7 @@ sys_rename(char *src, char *dest)
 }
 
 int
-sys_unlink(char *path)
+sys_unlink(vnode_t cdvp, char *path)
 {
 	char *name;
 	vnode_t vp, dvp;
@@ -708,8 +992,9 @@ sys_unlink(char *path)
 
 	DPRINTF(VFSDB_SYSCALL, ("sys_unlink: path=%s\n", path));
 
-	if ((err = namei(path, &vp)) != 0)
+	if ((err = namei(cdvp, path, &vp)) != 0)
 		return err;
+	dcache_purge(vp, NULL);
 
 	if (vp->v_mount->m_flags & MNT_RDONLY) {
 		err = EROFS;
@@ -723,7 +1008,7 @@ sys_unlink(char *path)
 		err = EBUSY;
 		goto out;
 	}
-	if ((err = lookup(path, &dvp, &name)) != 0)
+	if ((err = lookup(cdvp, path, &dvp, &name)) != 0)
 		goto out;
 
 	if (vp->v_type == VFIFO)
@@ -741,14 +1026,14 @@ sys_unlink(char *path)
 }
 
 int
-sys_access(char *path, int mode)
+sys_access(vnode_t cdvp, char *path, int mode)
 {
 	vnode_t vp;
 	int err;
 
 	DPRINTF(VFSDB_SYSCALL, ("sys_access: path=%s\n", path));
 
-	if ((err = namei(path, &vp)) != 0)
+	if ((err = namei(cdvp, path, &vp)) != 0)
 		return err;
 
 	err = EACCES;
@@ -765,12 +1050,12 @@ sys_access(char *path, int mode)
 }
 
 int
-sys_stat(char *path, struct stat *st)
+sys_stat(vnode_t cdvp, char *path, struct stat *st)
 {
 	vnode_t vp;
 	int err;
 
-	if ((err = namei(path, &vp)) != 0)
+	if ((err = namei(cdvp, path, &vp)) != 0)
 		return err;
 	err = vn_stat(vp, st);
 	vput(vp);
@@ -32,23 +32,27 @@
 
 #include <prex/prex.h>
 #include <sys/list.h>
+#include <sys/hash.h>
+#include <sys/param.h>
 
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "vfs.h"
 
-#define TASK_MAXBUCKETS	32		/* number of task hash buckets */
+#define TASK_MINBUCKETS	32		/* initial number of task hash buckets */
 
-#define TASKHASH(x)        (int)((x) & (TASK_MAXBUCKETS - 1))
+/* Task ids are aligned kernel addresses. */
+#define TASKHASH(x)        ((u_int)(x) >> 4)
 
 /*
  * Hash table for task.
  */
-static struct list task_table[TASK_MAXBUCKETS];
+static struct htable task_table;
 
 /*
  * Global lock for task access.
@@ -69,16 +73,15 @@ static mutex_t task_lock = MUTEX_INITIALIZER;
 struct task *
 task_lookup(task_t task)
 {
-	list_t head, n;
+	struct hnode *hn = NULL;
 	struct task *t;
 
 	if (task == TASK_NULL)
 		return NULL;
 
 	TASK_LOCK();
-	head = &task_table[TASKHASH(task)];
-	for (n = list_first(head); n != head; n = list_next(n)) {
-		t = list_entry(n, struct task, link);
+	while ((hn = hash_lookup(&task_table, TASKHASH(task), hn)) != NULL) {
+		t = hash_entry(hn, struct task, link);
 		ASSERT(t->task);
 		if (t->task == task) {
 			TASK_UNLOCK();
@@ -109,10 +112,14 @@ task_alloc(task_t task, struct task **pt)
 	memset(t, 0, sizeof(struct task));
 	t->task = task;
 	strcpy(t->cwd, "/");
+	t->file = t->dfile;
+	t->fdmap = t->dfdmap;
+	t->nfiles = MIN(NDFILE, OPEN_MAX);
 	mutex_init(&t->lock);
+	list_init(&t->poll);
 
 	TASK_LOCK();
-	list_insert(&task_table[TASKHASH(task)], &t->link);
+	hash_insert(&task_table, &t->link, TASKHASH(task));
 	TASK_UNLOCK();
 	*pt = t;
 	return 0;
@@ -124,9 +131,16 @@ task_alloc(task_t task, struct task **pt)
 void
 task_free(struct task *t)
 {
+	void **blk;
+
+	vn_pollcancel(t, SEM_NULL);
+	while ((blk = t->ftables) != NULL) {
+		t->ftables = *blk;
+		free(blk);
+	}
 
 	TASK_LOCK();
-	list_remove(&t->link);
+	hash_remove(&task_table, &t->link);
 	mutex_unlock(&t->lock);
 	mutex_destroy(&t->lock);
 	free(t);
@@ -141,9 +155,9 @@ task_update(struct task *t, task_t task)
 {
 
 	TASK_LOCK();
-	list_remove(&t->link);
+	hash_remove(&task_table, &t->link);
 	t->task = task;
-	list_insert(&task_table[TASKHASH(task)], &t->link);
+	hash_insert(&task_table, &t->link, TASKHASH(task));
 	TASK_UNLOCK();
 }
 
@@ -161,31 +175,152 @@ file_t
 task_getfp(struct task *t, int fd)
 {
 
-	if (fd >= OPEN_MAX)
+	if (fd < 0 || fd >= t->nfiles)
 		return NULL;
 
 	return t->file[fd];
 }
 
+/*
+ * Get the directory vnode to start the lookup of path.
+ * @t:    task structure
+ * @fd:   directory descriptor, or AT_FDCWD for the cwd
+ * @path: target path
+ * @dvp:  vnode to be returned
+ *
+ * The returned vnode is referenced, and must be released by
+ * vrele().  NULL is returned for an absolute path, or for the
+ * cwd of the global root.
+ */
+int
+task_getdir(struct task *t, int fd, char *path, vnode_t *dvp)
+{
+	file_t fp;
+
+	*dvp = NULL;
+	path[PATH_MAX - 1] = '\0';
+	if (path[0] == '\0')
+		return ENOENT;
+	if (path[0] == '/')
+		return 0;
+	if (fd == AT_FDCWD)
+		fp = t->cwdfp;
+	else if ((fp = task_getfp(t, fd)) == NULL)
+		return EBADF;
+	if (fp == NULL)
+		return 0;
+	if (fp->f_vnode->v_type != VDIR)
+		return ENOTDIR;
+	vref(fp->f_vnode);
+	*dvp = fp->f_vnode;
+	return 0;
+}
+
+/*
+ * Grow the file table to hold the descriptor fd.
+ *
+ * The size is doubled until fd fits.  The file pointers and the
+ * bitmap are allocated in one block.  A replaced table is not
+ * freed until the task exits, because the other threads of the
+ * task look up files without the task lock.
+ */
+static int
+task_growfd(struct task *t, int fd)
+{
+	void **blk;
+	file_t *file;
+	u_char *map;
+	int n;
+
+	if (fd >= OPEN_MAX)
+		return EMFILE;
+	n = t->nfiles;
+	while (n <= fd)
+		n *= 2;
+	if (n > OPEN_MAX)
+		n = OPEN_MAX;
+
+	blk = malloc(sizeof(void *) + n * sizeof(file_t) + howmany(n, NBBY));
+	if (blk == NULL)
+		return ENOMEM;
+	file = (file_t *)(blk + 1);
+	map = (u_char *)(file + n);
+	memcpy(file, t->file, t->nfiles * sizeof(file_t));
+	memset(file + t->nfiles, 0, (n - t->nfiles) * sizeof(file_t));
+	memcpy(map, t->fdmap, howmany(t->nfiles, NBBY));
+	memset(map + howmany(t->nfiles, NBBY), 0,
+	       howmany(n, NBBY) - howmany(t->nfiles, NBBY));
+
+	*blk = t->ftables;
+	t->ftables = blk;
+	t->file = file;
+	t->fdmap = map;
+	t->nfiles = n;
+	return 0;
+}
+
 /*
  * Get new file descriptor in the task.
- * Find the smallest empty slot in the fd array.
+ * Find the smallest empty slot from minfd, and reserve it.
+ * The caller must set the file with task_setfd(), or release
+ * the slot with task_setfd(t, fd, NULL).
  * Returns -1 if there is no empty slot.
  */
 int
-task_newfd(struct task *t)
+task_newfd(struct task *t, int minfd)
 {
-	int fd;
+	int fd, i, n, lowest;
+
+	lowest = (minfd <= t->fdfree);
+	fd = MAX(minfd, t->fdfree);
 
-	for (fd = 0; fd < OPEN_MAX; fd++)
-		if (t->file[fd] == NULL)
+	/* Skip full bytes of the bitmap. */
+	n = howmany(t->nfiles, NBBY);
+	for (i = fd / NBBY; i < n; i++) {
+		if (t->fdmap[i] != 0xff)
 			break;
-	if (fd == OPEN_MAX)
+	}
+	if (i * NBBY > fd)
+		fd = i * NBBY;
+	while (fd < t->nfiles && isset(t->fdmap, fd))
+		fd++;
+	if (fd >= t->nfiles && task_growfd(t, fd) != 0)
 		return -1;	/* slot full */
 
+	setbit(t->fdmap, fd);
+	if (lowest)
+		t->fdfree = fd + 1;
 	return fd;
 }
 
+/*
+ * Set the file of a descriptor.  The file table grows if fd
+ * is beyond its end.  NULL releases the descriptor.
+ */
+int
+task_setfd(struct task *t, int fd, file_t fp)
+{
+	int err;
+
+	if (fd < 0 || fd >= OPEN_MAX)
+		return EBADF;
+	if (fd >= t->nfiles) {
+		if (fp == NULL)
+			return 0;
+		if ((err = task_growfd(t, fd)) != 0)
+			return err;
+	}
+	t->file[fd] = fp;
+	if (fp != NULL)
+		setbit(t->fdmap, fd);
+	else {
+		clrbit(t->fdmap, fd);
+		if (fd < t->fdfree)
+			t->fdfree = fd;
+	}
+	return 0;
+}
+
 /*
  * Convert to full path from the cwd of task and path.
  * @t:    task structure
@@ -264,21 +399,16 @@ void
 task_dump(void)
 {
 #ifdef DEBUG_VFS
-	list_t head, n;
+	struct hnode *hn = NULL;
 	struct task *t;
-	int i;
 
 	TASK_LOCK();
 	dprintf("Dump file data\n");
 	dprintf(" task     opens   cwd\n");
 	dprintf(" -------- ------- ------------------------------\n");
-	for (i = 0; i < TASK_MAXBUCKETS; i++) {
-		head = &task_table[i];
-		for (n = list_first(head); n != head; n = list_next(n)) {
-			t = list_entry(n, struct task, link);
-			dprintf(" %08x %7x %s\n", (int)t->task, t->nopens,
-			       t->cwd);
-		}
+	while ((hn = hash_walk(&task_table, hn)) != NULL) {
+		t = hash_entry(hn, struct task, link);
+		dprintf(" %08x %7x %s\n", (int)t->task, t->nopens, t->cwd);
 	}
 	dprintf("\n");
 	TASK_UNLOCK();
@@ -289,25 +419,22 @@ task_dump(void)
 void
 task_init(void)
 {
-	int i;
 
-	for (i = 0; i < TASK_MAXBUCKETS; i++)
-		list_init(&task_table[i]);
+	if (hash_init(&task_table, TASK_MINBUCKETS))
+		sys_panic("VFS: task_init");
 }
 
 #ifdef DEBUG_VFS
 void
 task_debug(void)
 {
-	int i;
-	list_t head;
-
-	for (i = 0; i < TASK_MAXBUCKETS; i++) {
-		head = &task_table[i];
-		dprintf("head=%x head->next=%x head->prev=%x\n", head,
-			head->next, head->prev);
-		ASSERT(head->next);
-		ASSERT(head->prev);
+	struct hnode *hn = NULL;
+
+	while ((hn = hash_walk(&task_table, hn)) != NULL) {
+		dprintf("node=%x node->next=%x node->prev=%x\n", hn,
+			hn->h_link.next, hn->h_link.prev);
+		ASSERT(hn->h_link.next);
+		ASSERT(hn->h_link.prev);
 	}
 }
 #endif
@@ -33,8 +33,10 @@
 
 #include <prex/prex.h>
 #include <sys/list.h>
+#include <sys/hash.h>
 #include <sys/vnode.h>
 #include <sys/mount.h>
+#include <sys/poll.h>
 
 #include <limits.h>
 #include <unistd.h>
@@ -58,14 +60,15 @@
  * vrele      -1        *
  */
 
-#define VNODE_BUCKETS 32		/* size of vnode hash table */
+#define VNODE_MINBUCKETS 32		/* initial size of vnode hash table */
 
 /*
  * vnode table.
  * All active (opened) vnodes are stored on this hash table.
- * They can be accessed by its path name.
+ * They can be accessed by its path name.  The table grows
+ * with the number of active vnodes.
  */
-static struct list vnode_table[VNODE_BUCKETS];
+static struct htable vnode_table;
 
 /*
  * Global lock to access all vnodes and vnode table.
@@ -81,6 +84,34 @@ static mutex_t vnode_lock = MUTEX_INITIALIZER;
 #define VNODE_UNLOCK()
 #endif
 
+/*
+ * Poll waiter.
+ * A task that polls a vnode which is not ready leaves its
+ * semaphore on the vnode, and the semaphore is posted when the
+ * vnode may have become ready. The waiter is also linked to the
+ * task so that it can be cancelled without knowing the vnode.
+ *
+ * Drivers can not find the vnodes of their devices, so the
+ * waiters of all devices are kept on one list.  The kernel
+ * posts devpoll_sem when any device may have become ready, and
+ * all of them are woken.
+ */
+struct pollent {
+	struct list	pe_link;	/* link on vnode poll list */
+	struct list	pe_tlink;	/* link on task poll list */
+	sem_t		pe_sem;		/* semaphore of the poller */
+	task_t		pe_task;	/* task of the poller */
+};
+
+sem_t devpoll_sem;			/* posted by the kernel */
+static struct list devpoll_list = LIST_INIT(devpoll_list);
+static int devpoll_gen;			/* count of device wakeups */
+
+/* The device poll thread runs even with one fs thread. */
+static mutex_t poll_lock = MUTEX_INITIALIZER;
+#define POLL_LOCK()	mutex_lock(&poll_lock)
+#define POLL_UNLOCK()	mutex_unlock(&poll_lock)
+
 
 /*
  * Get the hash value from the mount point and path name.
@@ -88,13 +119,8 @@ static mutex_t vnode_lock = MUTEX_INITIALIZER;
 static u_int
 vn_hash(mount_t mp, char *path)
 {
-	u_int val = 0;
 
-	if (path) {
-		while (*path)
-			val = ((val << 5) + val) + *path++;
-	}
-	return (val ^ (u_int)mp) & (VNODE_BUCKETS - 1);
+	return hash_string(path) ^ (u_int)mp;
 }
 
 /*
@@ -104,13 +130,14 @@ vn_hash(mount_t mp, char *path)
 vnode_t
 vn_lookup(mount_t mp, char *path)
 {
-	list_t head, n;
+	struct hnode *hn = NULL;
 	vnode_t vp;
+	u_int val;
 
 	VNODE_LOCK();
-	head = &vnode_table[vn_hash(mp, path)];
-	for (n = list_first(head); n != head; n = list_next(n)) {
-		vp = list_entry(n, struct vnode, v_link);
+	val = vn_hash(mp, path);
+	while ((hn = hash_lookup(&vnode_table, val, hn)) != NULL) {
+		vp = hash_entry(hn, struct vnode, v_link);
 		if (vp->v_mount == mp &&
 		    !strncmp(vp->v_path, path, PATH_MAX)) {
 			vp->v_refcnt++;
@@ -179,6 +206,7 @@ vget(mount_t mp, char *path)
 	strcpy(vp->v_path, path);
 	mutex_init(&vp->v_lock);
 	vp->v_cond = COND_INITIALIZER;
+	list_init(&vp->v_poll);
 	vp->v_nrlocks = 0;
 
 	/*
@@ -195,7 +223,7 @@ vget(mount_t mp, char *path)
 	vp->v_nrlocks++;
 
 	VNODE_LOCK();
-	list_insert(&vnode_table[vn_hash(mp, path)], &vp->v_link);
+	hash_insert(&vnode_table, &vp->v_link, vn_hash(mp, path));
 	VNODE_UNLOCK();
 	return vp;
 }
@@ -218,7 +246,7 @@ vput(vnode_t vp)
 		return;
 	}
 	VNODE_LOCK();
-	list_remove(&vp->v_link);
+	hash_remove(&vnode_table, &vp->v_link);
 	VNODE_UNLOCK();
 
 	/*
@@ -226,6 +254,7 @@ vput(vnode_t vp)
 	 */
 	VOP_INACTIVE(vp);
 	vfs_unbusy(vp->v_mount);
+	vn_pollwakeup(vp);
 	vp->v_nrlocks--;
 	ASSERT(vp->v_nrlocks == 0);
 	mutex_unlock(&vp->v_lock);
@@ -262,7 +291,7 @@ void
 vrele(vnode_t vp)
 {
 	ASSERT(vp);
-	ASSERT(vp->v_nrlocks == 0);
+	ASSERT(vp->v_refcnt > 1 || vp->v_nrlocks == 0);
 	ASSERT(vp->v_refcnt > 0);
 
 	VNODE_LOCK();
@@ -273,7 +302,7 @@ vrele(vnode_t vp)
 		VNODE_UNLOCK();
 		return;
 	}
-	list_remove(&vp->v_link);
+	hash_remove(&vnode_table, &vp->v_link);
 	VNODE_UNLOCK();
 
 	/*
@@ -281,6 +310,7 @@ vrele(vnode_t vp)
 	 */
 	VOP_INACTIVE(vp);
 	vfs_unbusy(vp->v_mount);
+	vn_pollwakeup(vp);
 	mutex_destroy(&vp->v_lock);
 	free(vp->v_path);
 	free(vp);
@@ -296,8 +326,9 @@ vgone(vnode_t vp)
 
 	VNODE_LOCK();
 	DPRINTF(VFSDB_VNODE, ("vgone: %s\n", vp->v_path));
-	list_remove(&vp->v_link);
+	hash_remove(&vnode_table, &vp->v_link);
 	vfs_unbusy(vp->v_mount);
+	vn_pollwakeup(vp);
 	mutex_destroy(&vp->v_lock);
 	free(vp->v_path);
 	free(vp);
@@ -324,18 +355,14 @@ vcount(vnode_t vp)
 void
 vflush(mount_t mp)
 {
-	int i;
-	list_t head, n;
+	struct hnode *hn = NULL;
 	vnode_t vp;
 
 	VNODE_LOCK();
-	for (i = 0; i < VNODE_BUCKETS; i++) {
-		head = &vnode_table[i];
-		for (n = list_first(head); n != head; n = list_next(n)) {
-			vp = list_entry(n, struct vnode, v_link);
-			if (vp->v_mount == mp) {
-				/* XXX: */
-			}
+	while ((hn = hash_walk(&vnode_table, hn)) != NULL) {
+		vp = hash_entry(hn, struct vnode, v_link);
+		if (vp->v_mount == mp) {
+			/* XXX: */
 		}
 	}
 	VNODE_UNLOCK();
@@ -394,8 +421,7 @@ vn_stat(vnode_t vp, struct stat *st)
 void
 vnode_dump(void)
 {
-	int i;
-	list_t head, n;
+	struct hnode *hn = NULL;
 	vnode_t vp;
 	mount_t mp;
 	char type[][6] = { "VNON ", "VREG ", "VDIR ", "VBLK ", "VCHR ",
@@ -406,24 +432,158 @@ vnode_dump(void)
 	dprintf(" vnode    mount    type  refcnt blkno    path\n");
 	dprintf(" -------- -------- ----- ------ -------- ------------------------------\n");
 
-	for (i = 0; i < VNODE_BUCKETS; i++) {
-		head = &vnode_table[i];
-		for (n = list_first(head); n != head; n = list_next(n)) {
-			vp = list_entry(n, struct vnode, v_link);
-			mp = vp->v_mount;
-
-			dprintf(" %08x %08x %s %6d %8d %s%s\n", (u_int)vp,
-				(u_int)mp, type[vp->v_type], vp->v_refcnt,
-				(u_int)vp->v_blkno,
-				(strlen(mp->m_path) == 1) ? "\0" : mp->m_path,
-				vp->v_path);
-		}
+	while ((hn = hash_walk(&vnode_table, hn)) != NULL) {
+		vp = hash_entry(hn, struct vnode, v_link);
+		mp = vp->v_mount;
+
+		dprintf(" %08x %08x %s %6d %8d %s%s\n", (u_int)vp,
+			(u_int)mp, type[vp->v_type], vp->v_refcnt,
+			(u_int)vp->v_blkno,
+			(strlen(mp->m_path) == 1) ? "\0" : mp->m_path,
+			vp->v_path);
 	}
 	dprintf("\n");
 	VNODE_UNLOCK();
 }
 #endif
 
+/*
+ * Leave the semaphore of a polling task on a vnode.
+ * The caller must hold the vnode lock, so that the vnode
+ * cannot become ready between its poll and this call.
+ */
+int
+vn_pollwait(vnode_t vp, struct task *t, sem_t sem)
+{
+	struct pollent *pe;
+
+	if (!(pe = malloc(sizeof(struct pollent))))
+		return ENOMEM;
+	pe->pe_sem = sem;
+	pe->pe_task = t->task;
+
+	POLL_LOCK();
+	list_insert(&vp->v_poll, &pe->pe_link);
+	list_insert(&t->poll, &pe->pe_tlink);
+	POLL_UNLOCK();
+	return 0;
+}
+
+/*
+ * Post and remove the poll waiters on a list.
+ * The poll lock must be held.
+ */
+static void
+pollwakeup(list_t head)
+{
+	struct pollent *pe;
+	task_t owner;
+	list_t n;
+
+	while (!list_empty(head)) {
+		n = list_first(head);
+		pe = list_entry(n, struct pollent, pe_link);
+		/* The poller may have destroyed it in the meantime. */
+		if (sem_owner(&pe->pe_sem, &owner) == 0 &&
+		    owner == pe->pe_task)
+			sem_post(&pe->pe_sem);
+		list_remove(&pe->pe_link);
+		list_remove(&pe->pe_tlink);
+		free(pe);
+	}
+}
+
+/*
+ * Wake up all tasks polling a vnode.
+ * Each semaphore is posted once, and the waiters are removed.
+ * The tasks poll again to find out what is ready.
+ */
+void
+vn_pollwakeup(vnode_t vp)
+{
+
+	POLL_LOCK();
+	pollwakeup(&vp->v_poll);
+	POLL_UNLOCK();
+}
+
+/*
+ * Return the count of device wakeups.  A device poll reads
+ * it before the device is asked, and passes it to
+ * devpoll_wait() to find a wakeup in between.
+ */
+int
+devpoll_start(void)
+{
+
+	return devpoll_gen;
+}
+
+/*
+ * Leave the semaphore of a task polling a device.
+ * If a device has woken up since devpoll_start(), the
+ * semaphore is posted at once.
+ */
+int
+devpoll_wait(struct task *t, sem_t sem, int gen)
+{
+	struct pollent *pe;
+
+	if (!(pe = malloc(sizeof(struct pollent))))
+		return ENOMEM;
+	pe->pe_sem = sem;
+	pe->pe_task = t->task;
+
+	POLL_LOCK();
+	if (gen != devpoll_gen) {
+		POLL_UNLOCK();
+		free(pe);
+		sem_post(&sem);
+		return 0;
+	}
+	list_insert(&devpoll_list, &pe->pe_link);
+	list_insert(&t->poll, &pe->pe_tlink);
+	POLL_UNLOCK();
+	return 0;
+}
+
+/*
+ * Wake up all tasks polling devices.
+ */
+void
+devpoll_wakeup(void)
+{
+
+	POLL_LOCK();
+	devpoll_gen++;
+	pollwakeup(&devpoll_list);
+	POLL_UNLOCK();
+}
+
+/*
+ * Remove the poll waiters of a task that use the specified
+ * semaphore. SEM_NULL removes all of them.
+ */
+void
+vn_pollcancel(struct task *t, sem_t sem)
+{
+	struct pollent *pe;
+	list_t head, n, next;
+
+	POLL_LOCK();
+	head = &t->poll;
+	for (n = list_first(head); n != head; n = next) {
+		next = list_next(n);
+		pe = list_entry(n, struct pollent, pe_tlink);
+		if (sem == SEM_NULL || pe->pe_sem == sem) {
+			list_remove(&pe->pe_link);
+			list_remove(&pe->pe_tlink);
+			free(pe);
+		}
+	}
+	POLL_UNLOCK();
+}
+
 int
 vop_nullop(void)
 {
@@ -438,11 +598,21 @@ vop_einval(void)
 	return EINVAL;
 }
 
+/*
+ * Poll routine for files that never block.
+ */
+int
+vop_pollready(vnode_t vp, file_t fp, int events, int *revents)
+{
+
+	*revents = events & (POLLIN | POLLRDNORM | POLLOUT);
+	return 0;
+}
+
 void
 vnode_init(void)
 {
-	int i;
 
-	for (i = 0; i < VNODE_BUCKETS; i++)
-		list_init(&vnode_table[i]);
+	if (hash_init(&vnode_table, VNODE_MINBUCKETS))
+		sys_panic("VFS: vnode_init");
 }
@@ -31,18 +31,28 @@
  * hash.c - pid/pgid mapping tables.
  */
 
+#include <prex/prex.h>
 #include <server/stdmsg.h>
 #include <sys/list.h>
+#include <sys/hash.h>
 #include <unistd.h>
 
 #include "proc.h"
 
+/* Task ids are aligned kernel addresses. */
+#define TASKHASH(x)	((u_int)(x) >> 4)
+
 /*
  * Hash tables for ID mapping
  */
-static struct list pid_hash[ID_MAXBUCKETS];	/* mapping: pid  -> proc */
-static struct list task_hash[ID_MAXBUCKETS];	/* mapping: task -> proc */
-static struct list pgid_hash[ID_MAXBUCKETS];	/* mapping: pgid -> pgrp */
+static struct htable pid_hash;		/* mapping: pid  -> proc */
+static struct htable task_hash;		/* mapping: task -> proc */
+static struct htable pgid_hash;		/* mapping: pgid -> pgrp */
+
+/*
+ * Bitmap of the pids in pid_hash.
+ */
+static u_char pid_map[howmany(PID_MAX, NBBY)];
 
 /*
  * Find process by pid.
@@ -50,16 +60,15 @@ static struct list pgid_hash[ID_MAXBUCKETS];	/* mapping: pgid -> pgrp */
 struct proc *
 proc_find(pid_t pid)
 {
-	list_t head, n;
-	struct proc *p = NULL;
+	struct hnode *hn = NULL;
+	struct proc *p;
 
-	head = &pid_hash[IDHASH(pid)];
-	n = list_first(head);
-	while (n != head) {
-		p = list_entry(n, struct proc, p_pid_link);
+	if (pid < 0 || pid >= PID_MAX || isclr(pid_map, pid))
+		return NULL;
+	while ((hn = hash_lookup(&pid_hash, (u_int)pid, hn)) != NULL) {
+		p = hash_entry(hn, struct proc, p_pid_link);
 		if (p->p_pid == pid)
 			return p;
-		n = list_next(n);
 	}
 	return NULL;
 }
@@ -70,16 +79,13 @@ proc_find(pid_t pid)
 struct pgrp *
 pgrp_find(pid_t pgid)
 {
-	list_t head, n;
-	struct pgrp *g = NULL;
+	struct hnode *hn = NULL;
+	struct pgrp *g;
 
-	head = &pgid_hash[IDHASH(pgid)];
-	n = list_first(head);
-	while (n != head) {
-		g = list_entry(n, struct pgrp, pg_link);
+	while ((hn = hash_lookup(&pgid_hash, (u_int)pgid, hn)) != NULL) {
+		g = hash_entry(hn, struct pgrp, pg_link);
 		if (g->pg_pgid == pgid)
 			return g;
-		n = list_next(n);
 	}
 	return NULL;
 }
@@ -90,17 +96,13 @@ pgrp_find(pid_t pgid)
 struct proc *
 task_to_proc(task_t task)
 {
-	list_t head, n;
-	struct proc *p = NULL;
+	struct hnode *hn = NULL;
+	struct proc *p;
 
-	head = &task_hash[IDHASH(task)];
-	n = list_first(head);
-
-	while (n != head) {
-		p = list_entry(n, struct proc, p_task_link);
+	while ((hn = hash_lookup(&task_hash, TASKHASH(task), hn)) != NULL) {
+		p = hash_entry(hn, struct proc, p_task_link);
 		if (p->p_task == task)
 			return p;
-		n = list_next(n);
 	}
 	return NULL;
 }
@@ -113,8 +115,9 @@ void
 proc_add(struct proc *p)
 {
 
-	list_insert(&pid_hash[IDHASH(p->p_pid)], &p->p_pid_link);
-	list_insert(&task_hash[IDHASH(p->p_task)], &p->p_task_link);
+	hash_insert(&pid_hash, &p->p_pid_link, (u_int)p->p_pid);
+	hash_insert(&task_hash, &p->p_task_link, TASKHASH(p->p_task));
+	setbit(pid_map, p->p_pid);
 }
 
 /*
@@ -124,8 +127,9 @@ void
 proc_remove(struct proc *p)
 {
 
-	list_remove(&p->p_pid_link);
-	list_remove(&p->p_task_link);
+	hash_remove(&pid_hash, &p->p_pid_link);
+	hash_remove(&task_hash, &p->p_task_link);
+	clrbit(pid_map, p->p_pid);
 }
 
 /*
@@ -136,7 +140,7 @@ void
 pgrp_add(struct pgrp *pgrp)
 {
 
-	list_insert(&pgid_hash[IDHASH(pgrp->pg_pgid)], &pgrp->pg_link);
+	hash_insert(&pgid_hash, &pgrp->pg_link, (u_int)pgrp->pg_pgid);
 }
 
 /*
@@ -146,7 +150,30 @@ void
 pgrp_remove(struct pgrp *pgrp)
 {
 
-	list_remove(&pgrp->pg_link);
+	hash_remove(&pgid_hash, &pgrp->pg_link);
+}
+
+/*
+ * Find the smallest unused pid from the specified pid.
+ * Returns 0 if all pids up to PID_MAX are used.
+ */
+pid_t
+pid_findfree(pid_t pid)
+{
+	int i;
+
+	/* Skip the bytes of the bitmap which are full. */
+	for (i = pid / NBBY; i < howmany(PID_MAX, NBBY); i++) {
+		if (pid_map[i] != 0xff)
+			break;
+	}
+	if (i * NBBY > pid)
+		pid = i * NBBY;
+	while (pid < PID_MAX && isset(pid_map, pid))
+		pid++;
+	if (pid >= PID_MAX)
+		return 0;
+	return pid;
 }
 
 /*
@@ -155,11 +182,9 @@ pgrp_remove(struct pgrp *pgrp)
 void
 table_init(void)
 {
-	int i;
 
-	for (i = 0; i < ID_MAXBUCKETS; i++) {
-		list_init(&pid_hash[i]);
-		list_init(&task_hash[i]);
-		list_init(&pgid_hash[i]);
-	}
+	if (hash_init(&pid_hash, ID_MINBUCKETS) ||
+	    hash_init(&task_hash, ID_MINBUCKETS) ||
+	    hash_init(&pgid_hash, ID_MINBUCKETS))
+		sys_panic("proc: fail to allocate tables");
 }
@@ -253,6 +253,9 @@ proc_debug(struct msg *msg)
 			stat[p->p_stat], p->p_task);
 	}
 	dprintf("\n");
+#endif
+#ifdef DEBUG
+	malloc_stats();
 #endif
 	return 0;
 }
@@ -53,6 +53,7 @@ static pid_t last_pid = 1;
 
 /*
  * Assign new pid.
+ * The search starts after the last pid, and wraps around to 1.
  * Returns pid on sucess, or 0 on failure.
  */
 pid_t
@@ -60,16 +61,8 @@ pid_assign(void)
 {
 	pid_t pid;
 
-	pid = last_pid + 1;
-	if (pid >= PID_MAX)
-		pid = 1;
-	while (pid != last_pid) {
-		if (proc_find(pid) == NULL)
-			break;
-		if (++pid >= PID_MAX)
-			pid = 1;
-	}
-	if (pid == last_pid)
+	if ((pid = pid_findfree(last_pid + 1)) == 0 &&
+	    (pid = pid_findfree(1)) == 0)
 		return 0;
 	last_pid = pid;
 	return pid;
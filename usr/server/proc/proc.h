@@ -34,6 +34,7 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/list.h>
+#include <sys/hash.h>
 #include <server/proc.h>
 #include <server/stdmsg.h>
 #include <prex/capability.h>
@@ -55,8 +56,7 @@
 #define PRIO_PROC	130		/* priority of process server */
 #define PID_MAX		0x8000		/* max number for PID */
 
-#define ID_MAXBUCKETS	32
-#define IDHASH(x)	((x) & (ID_MAXBUCKETS - 1))
+#define ID_MINBUCKETS	32		/* initial size of ID hash tables */
 
 struct proc;
 
@@ -74,7 +74,7 @@ struct session {
  * Process group
  */
 struct pgrp {
-	struct list	pg_link;	/* link for pgid hash */
+	struct hnode	pg_link;	/* link for pgid hash */
 	struct list	pg_members;	/* list head of processes */
 	struct session	*pg_session;	/* pointer to session */
 	pid_t		pg_pgid;	/* pgrp id */
@@ -88,8 +88,8 @@ struct proc {
 	struct proc 	*p_parent;	/* pointer to parent process */
 	struct list 	p_children;	/* list head of child processes */
 	struct list 	p_sibling;	/* link for sibling processes */
-	struct list 	p_pid_link;	/* link for pid hash */
-	struct list 	p_task_link;	/* link for task hash */
+	struct hnode 	p_pid_link;	/* link for pid hash */
+	struct hnode 	p_task_link;	/* link for task hash */
 	struct list 	p_pgrp_link;	/* link for process group */
 	struct pgrp 	*p_pgrp;	/* pointer to process group */
 	int		p_stat;		/* process status S* */
@@ -121,6 +121,7 @@ struct proc *proc_find(pid_t);
 struct pgrp *pgrp_find(pid_t);
 struct proc *task_to_proc(task_t);
 pid_t	pid_assign(void);
+pid_t	pid_findfree(pid_t);
 void	proc_add(struct proc *);
 void	proc_remove(struct proc *);
 void	pgrp_add(struct pgrp *);
@@ -0,0 +1,186 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * at.c - test openat, fstatat, mkdirat, renameat and unlinkat
+ */
+
+#include <prex/prex.h>
+#include <sys/fcntl.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int nerrs;
+
+static void
+check(int ok, const char *msg)
+{
+
+	if (!ok) {
+		printf("error: %s\n", msg);
+		nerrs++;
+	}
+}
+
+/*
+ * Create, stat, rename and remove a file relative to a
+ * directory descriptor.
+ */
+static void
+test_relative(int tmpfd)
+{
+	struct stat st;
+	int dfd, fd;
+
+	printf("relative lookup\n");
+
+	check(mkdirat(tmpfd, "atdir", 0755) == 0, "mkdirat");
+	if ((dfd = openat(tmpfd, "atdir", O_RDONLY)) == -1) {
+		check(0, "openat dir");
+		return;
+	}
+	fd = openat(dfd, "f", O_CREAT | O_WRONLY, 0644);
+	check(fd != -1, "openat create");
+	check(write(fd, "abc", 3) == 3, "write");
+	close(fd);
+
+	check(fstatat(dfd, "f", &st, 0) == 0 && S_ISREG(st.st_mode),
+	      "fstatat file");
+	check(st.st_size == 3, "fstatat size");
+	check(fstatat(tmpfd, "atdir/f", &st, 0) == 0, "fstatat subpath");
+	check(fstatat(tmpfd, "f", &st, 0) == -1 && errno == ENOENT,
+	      "fstatat wrong dir");
+
+	/* Move the file from one directory to the other. */
+	check(renameat(dfd, "f", tmpfd, "atfile") == 0, "renameat");
+	check(fstatat(dfd, "f", &st, 0) == -1, "old name gone");
+	check(fstatat(tmpfd, "atfile", &st, 0) == 0, "new name");
+
+	/* An absolute path ignores the descriptor. */
+	check(fstatat(dfd, "/tmp/atfile", &st, 0) == 0, "absolute path");
+
+	/* A file descriptor is not a directory. */
+	fd = openat(tmpfd, "atfile", O_RDONLY);
+	check(fd != -1, "openat file");
+	check(openat(fd, "x", O_RDONLY) == -1 && errno == ENOTDIR,
+	      "openat non-directory fd");
+	check(fstatat(fd, "x", &st, 0) == -1 && errno == ENOTDIR,
+	      "fstatat non-directory fd");
+	close(fd);
+	check(openat(999, "x", O_RDONLY) == -1 && errno == EBADF,
+	      "openat bad fd");
+
+	/* The current directory is used with AT_FDCWD. */
+	if (chdir("/tmp/atdir") == 0) {
+		check(fstatat(AT_FDCWD, "../atfile", &st, 0) == 0,
+		      "fstatat AT_FDCWD");
+		chdir("/");
+	} else
+		check(0, "chdir");
+
+	close(dfd);
+}
+
+/*
+ * ".." from the root of a mounted file system must continue
+ * in the covered directory.
+ */
+static void
+test_dotdot(int tmpfd)
+{
+	struct stat st;
+	int bootfd, fd;
+
+	printf("'..' across a mount point\n");
+
+	check(fstatat(tmpfd, "..", &st, 0) == 0 && S_ISDIR(st.st_mode),
+	      "fstatat ..");
+	bootfd = openat(tmpfd, "../boot", O_RDONLY);
+	if (bootfd == -1) {
+		check(0, "openat ../boot");
+		return;
+	}
+	check(fstatat(bootfd, "../tmp/atfile", &st, 0) == 0,
+	      "fstatat up from mount root");
+	fd = openat(bootfd, "../tmp/atdir", O_RDONLY);
+	check(fd != -1, "openat up from mount root");
+	if (fd != -1)
+		close(fd);
+	close(bootfd);
+}
+
+/*
+ * unlinkat removes a directory only with AT_REMOVEDIR.
+ */
+static void
+test_removedir(int tmpfd)
+{
+	struct stat st;
+
+	printf("unlinkat\n");
+
+	check(unlinkat(tmpfd, "atdir", 0) == -1, "unlink directory");
+	check(unlinkat(tmpfd, "atfile", AT_REMOVEDIR) == -1,
+	      "rmdir file");
+	check(unlinkat(tmpfd, "atdir", AT_REMOVEDIR) == 0, "rmdir");
+	check(fstatat(tmpfd, "atdir", &st, 0) == -1, "directory gone");
+	check(unlinkat(tmpfd, "atfile", 0) == 0, "unlink");
+	check(fstatat(tmpfd, "atfile", &st, 0) == -1, "file gone");
+	check(unlinkat(tmpfd, "atfile", 0x8000) == -1 && errno == EINVAL,
+	      "unlinkat bad flags");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int tmpfd;
+
+	printf("at test program\n");
+
+	if ((tmpfd = open("/tmp", O_RDONLY)) == -1) {
+		perror("open");
+		exit(1);
+	}
+	test_relative(tmpfd);
+	test_dotdot(tmpfd);
+	test_removedir(tmpfd);
+	close(tmpfd);
+
+	if (nerrs) {
+		printf("Test failed: %d error(s)\n", nerrs);
+		exit(1);
+	}
+	printf("Test OK!\n");
+	return 0;
+}
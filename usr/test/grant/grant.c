@@ -0,0 +1,209 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * grant.c - test program for object_grant().
+ *
+ * A child task asks this task for a handle of a private object.
+ * It is granted with the send right only, and the child checks
+ * that it can not receive on it or grant it further, and that
+ * the handle becomes stale when the object is destroyed.
+ */
+
+#include <prex/prex.h>
+#include <prex/message.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define REQ_GRANT	1	/* grant the private object */
+#define REQ_DESTROY	2	/* destroy the private object */
+#define REQ_DONE	3	/* report the result */
+
+struct grant_msg {
+	struct msg_header hdr;
+	object_t obj;		/* granted handle */
+	int	nerrs;		/* errors found by the child */
+};
+
+static object_t srvobj;		/* request object */
+static object_t privobj;	/* object to grant */
+
+static char child_stack[1024];
+static char recv_stack[1024];
+
+/*
+ * Run specified thread in the task.
+ */
+static int
+thread_run(task_t task, void (*start)(void), void *stack)
+{
+	thread_t th;
+	int err;
+
+	if ((err = thread_create(task, &th)) != 0)
+		return err;
+	if ((err = thread_load(th, start, stack)) != 0)
+		return err;
+	return thread_resume(th);
+}
+
+static int
+request(int code, struct grant_msg *m)
+{
+
+	m->hdr.code = code;
+	if (msg_send(srvobj, m, sizeof(*m), 0) != 0)
+		return -1;
+	return m->hdr.status;
+}
+
+/*
+ * Thread of the child task.  It can not print, so the errors
+ * are counted and reported to the parent.
+ */
+static void
+child_thread(void)
+{
+	struct grant_msg m;
+	object_t h, nh;
+	int nerrs = 0;
+
+	/* The inherited handle carries the send right only. */
+	if (msg_receive(srvobj, &m, sizeof(m), 0) != EACCES)
+		nerrs++;
+
+	if (request(REQ_GRANT, &m) != 0)
+		nerrs++;
+	h = m.obj;
+
+	/* Send is granted, receive and grant are not. */
+	if (msg_send(h, &m, sizeof(m), 0) != 0)
+		nerrs++;
+	if (msg_receive(h, &m, sizeof(m), 0) != EACCES)
+		nerrs++;
+	if (object_grant(h, task_self(), OBJ_SEND, &nh) != EACCES)
+		nerrs++;
+
+	/* The handle is stale once the owner destroys the object. */
+	if (request(REQ_DESTROY, &m) != 0)
+		nerrs++;
+	if (msg_send(h, &m, sizeof(m), 0) != EINVAL)
+		nerrs++;
+
+	m.nerrs = nerrs;
+	request(REQ_DONE, &m);
+	for (;;)
+		timer_sleep(1000, 0);
+}
+
+/*
+ * Answer the messages sent to the private object.
+ */
+static void
+recv_thread(void)
+{
+	struct grant_msg m;
+
+	while (msg_receive(privobj, &m, sizeof(m), 0) == 0) {
+		m.hdr.status = 0;
+		msg_reply(privobj, &m, sizeof(m));
+	}
+	for (;;)
+		timer_sleep(1000, 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct grant_msg m;
+	task_t child;
+	object_t nh;
+	int err, done = 0, nerrs = 0;
+
+	printf("Grant test program\n");
+
+	if (object_create(NULL, &srvobj) || object_create(NULL, &privobj))
+		panic("failed to create objects");
+
+	/* Unknown rights, and rights not held by the granter. */
+	if (object_grant(privobj, task_self(), 0x80, &nh) != EINVAL) {
+		printf("invalid rights accepted\n");
+		nerrs++;
+	}
+	if (thread_run(task_self(), recv_thread, recv_stack + 1024))
+		panic("failed to run thread");
+
+#ifdef CONFIG_MMU
+	err = task_create(task_self(), VM_COPY, &child);
+#else
+	err = task_create(task_self(), VM_SHARE, &child);
+#endif
+	if (err)
+		panic("task_create failed");
+	if (thread_run(child, child_thread, child_stack + 1024))
+		panic("failed to run child thread");
+
+	while (!done) {
+		if (msg_receive(srvobj, &m, sizeof(m), 0) != 0)
+			panic("msg_receive failed");
+		switch (m.hdr.code) {
+		case REQ_GRANT:
+			/* Grant a subset of the rights. */
+			m.hdr.status = object_grant(privobj, m.hdr.task,
+						    OBJ_SEND, &m.obj);
+			break;
+		case REQ_DESTROY:
+			m.hdr.status = object_destroy(privobj);
+			if (object_grant(privobj, m.hdr.task, OBJ_SEND,
+					 &nh) != EINVAL) {
+				printf("stale handle granted\n");
+				nerrs++;
+			}
+			break;
+		case REQ_DONE:
+			nerrs += m.nerrs;
+			m.hdr.status = 0;
+			done = 1;
+			break;
+		default:
+			m.hdr.status = EINVAL;
+			break;
+		}
+		msg_reply(srvobj, &m, sizeof(m));
+	}
+	task_terminate(child);
+
+	if (nerrs) {
+		printf("Test failed: %d error(s)\n", nerrs);
+		exit(1);
+	}
+	printf("Test OK!\n");
+	return 0;
+}
@@ -34,6 +34,7 @@
 #include <prex/prex.h>
 #include <server/stdmsg.h>
 #include <stdio.h>
+#include <errno.h>
 
 static char stack[1024];
 
@@ -137,20 +138,23 @@ main(int argc, char *argv[])
 
 	/*
 	 * Wait message from non-existing object
-	 * This must be error.
+	 * This must be EINVAL.
 	 */
 	o3 = 0x12345678;
 	err = msg_receive(o3, &msg, sizeof(msg), 0);
-	if (err == 0)
+	if (err != EINVAL)
 		panic("Oops! invalid object...");
 
 	/*
 	 * Wait message from object 'A'. However, it will be failed
-	 * because the sender thread will delete the object A.
+	 * because the sender thread will delete the object A, and
+	 * the handle becomes stale.
 	 */
 	printf("Wait message from object A\n");
 	err = msg_receive(o1, &msg, sizeof(msg), 0);
-	if (err)
+	if (err == EINVAL)
+		printf("Receive err - OK!\n");
+	else if (err)
 		printf("Receive err!\n");
 	else {
 		printf("Rreceive ok!\n");
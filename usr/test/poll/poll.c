@@ -0,0 +1,211 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll.c - test poll() with pipes and fifos
+ */
+
+#include <prex/prex.h>
+#include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <sys/errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#define FIFO_PATH	"/fifo/poll"
+
+static int nerrs;
+static int writefd;
+static char stack[1024];
+
+static void
+check(int ok, const char *msg)
+{
+
+	if (!ok) {
+		printf("error: %s\n", msg);
+		nerrs++;
+	}
+}
+
+/*
+ * Poll one descriptor, and return its revents or -1.
+ */
+static int
+poll1(int fd, int events, int timeout)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, timeout) == -1)
+		return -1;
+	return pfd.revents;
+}
+
+/*
+ * Write to the pipe after a while.
+ */
+static void
+writer_thread(void)
+{
+
+	timer_sleep(200, 0);
+	write(writefd, "x", 1);
+	for (;;)
+		timer_sleep(1000, 0);
+}
+
+static int
+thread_run(void (*start)(void), void *sp)
+{
+	thread_t th;
+	int err;
+
+	if ((err = thread_create(task_self(), &th)) != 0)
+		return err;
+	if ((err = thread_load(th, start, sp)) != 0)
+		return err;
+	return thread_resume(th);
+}
+
+static void
+test_pipe(void)
+{
+	int fd[2];
+	char c;
+
+	printf("pipe\n");
+	if (pipe(fd) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	check(poll1(fd[0], POLLIN, 0) == 0, "empty pipe is readable");
+	check(poll1(fd[1], POLLOUT, 0) == POLLOUT, "pipe is not writable");
+
+	write(fd[1], "a", 1);
+	check(poll1(fd[0], POLLIN, 0) == POLLIN, "pipe has no data");
+	read(fd[0], &c, 1);
+	check(poll1(fd[0], POLLIN, 0) == 0, "pipe still has data");
+
+	/* A writer in another thread wakes us up. */
+	writefd = fd[1];
+	if (thread_run(writer_thread, stack + sizeof(stack)))
+		panic("failed to run thread");
+	check(poll1(fd[0], POLLIN, -1) == POLLIN, "no wakeup by writer");
+	read(fd[0], &c, 1);
+
+	/* The read end hangs up when the writer closes. */
+	close(fd[1]);
+	check(poll1(fd[0], POLLIN, 0) == POLLHUP, "no POLLHUP on pipe");
+	close(fd[0]);
+	check(poll1(fd[0], POLLIN, 0) == POLLNVAL, "no POLLNVAL");
+}
+
+static void
+test_timeout(void)
+{
+	int fd[2];
+	u_long start, end, msec;
+
+	printf("timeout\n");
+	if (pipe(fd) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	sys_time(&start);
+	check(poll1(fd[0], POLLIN, 300) == 0, "poll did not time out");
+	sys_time(&end);
+	msec = (end - start) * 1000 / CONFIG_HZ;
+	printf("waited %d msec\n", (int)msec);
+	check(msec >= 250 && msec < 1000, "bad timeout");
+
+	/* No descriptors, just sleep. */
+	sys_time(&start);
+	check(poll(NULL, 0, 100) == 0, "poll without descriptors");
+	sys_time(&end);
+	msec = (end - start) * 1000 / CONFIG_HZ;
+	check(msec >= 50, "poll without descriptors did not sleep");
+	close(fd[0]);
+	close(fd[1]);
+}
+
+static void
+test_fifo(void)
+{
+	int rfd, wfd;
+	char c;
+
+	printf("fifo\n");
+	if (mknod(FIFO_PATH, S_IFIFO | 0666, 0) == -1) {
+		perror("mkfifo");
+		exit(1);
+	}
+	rfd = open(FIFO_PATH, O_RDONLY | O_NONBLOCK);
+	wfd = open(FIFO_PATH, O_WRONLY);
+	if (rfd == -1 || wfd == -1) {
+		perror("open");
+		exit(1);
+	}
+	check(poll1(rfd, POLLIN, 0) == 0, "empty fifo is readable");
+	check(poll1(wfd, POLLOUT, 0) == POLLOUT, "fifo is not writable");
+
+	write(wfd, "b", 1);
+	check(poll1(rfd, POLLIN, 100) == POLLIN, "fifo has no data");
+	read(rfd, &c, 1);
+	check(c == 'b', "bad data from fifo");
+
+	close(wfd);
+	check(poll1(rfd, POLLIN, 0) == POLLHUP, "no POLLHUP on fifo");
+	close(rfd);
+	unlink(FIFO_PATH);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	printf("poll test program\n");
+
+	test_pipe();
+	test_timeout();
+	test_fifo();
+
+	if (nerrs) {
+		printf("Test failed: %d error(s)\n", nerrs);
+		exit(1);
+	}
+	printf("Test OK!\n");
+	return 0;
+}
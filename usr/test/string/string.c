@@ -0,0 +1,315 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * string.c - correctness and throughput test for string routines.
+ */
+
+#include <prex/prex.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define MAXALIGN	8		/* alignments to test */
+#define MAXLEN		80		/* string lengths to test */
+#define BUFSIZE		(MAXALIGN + MAXLEN + 16)
+
+#define BENCHSIZE	4096		/* bytes per benchmark pass */
+#define BENCHLOOP	2000		/* passes per benchmark */
+
+static char buf1[BUFSIZE], buf2[BUFSIZE];
+static char dst1[BUFSIZE], dst2[BUFSIZE];
+static char bench1[BENCHSIZE + 1], bench2[BENCHSIZE + 1];
+
+static int nr_errors;
+static struct info_timer timer_info;
+
+/*
+ * Reference byte-at-a-time implementations.
+ */
+static size_t
+ref_strlen(const char *s)
+{
+	size_t n = 0;
+
+	while (*s++)
+		n++;
+	return n;
+}
+
+static int
+ref_strcmp(const char *s1, const char *s2)
+{
+	while (*s1 == *s2) {
+		if (*s1 == '\0')
+			return 0;
+		s1++;
+		s2++;
+	}
+	return *(const unsigned char *)s1 - *(const unsigned char *)s2;
+}
+
+static int
+ref_strncmp(const char *s1, const char *s2, size_t n)
+{
+	for (; n != 0; n--, s1++, s2++) {
+		if (*s1 != *s2)
+			return *(const unsigned char *)s1 -
+				*(const unsigned char *)s2;
+		if (*s1 == '\0')
+			break;
+	}
+	return 0;
+}
+
+static char *
+ref_strchr(const char *s, int c)
+{
+	for (;; s++) {
+		if (*s == (char)c)
+			return (char *)s;
+		if (*s == '\0')
+			return NULL;
+	}
+}
+
+static void *
+ref_memchr(const void *s, int c, size_t n)
+{
+	const unsigned char *p = s;
+
+	for (; n != 0; n--, p++)
+		if (*p == (unsigned char)c)
+			return (void *)p;
+	return NULL;
+}
+
+static int
+ref_memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *p1 = s1, *p2 = s2;
+
+	for (; n != 0; n--, p1++, p2++)
+		if (*p1 != *p2)
+			return *p1 - *p2;
+	return 0;
+}
+
+static int
+sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+static void
+error(const char *func, int a1, int a2, int len)
+{
+	printf("Error: %s failed (align %d/%d, length %d)\n",
+	       func, a1, a2, len);
+	nr_errors++;
+}
+
+/*
+ * Fill a buffer with a short alphabet so that strings often match,
+ * then terminate it at the given length.
+ */
+static void
+fill(char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < BUFSIZE; i++)
+		buf[i] = 'a' + (random() & 3);
+	buf[len] = '\0';
+}
+
+static void
+test_compare(int a1, int a2, int len)
+{
+	char *s1, *s2;
+	int n, c;
+
+	fill(buf1, a1 + len);
+	memcpy(buf2, buf1, BUFSIZE);
+	s1 = buf1 + a1;
+	s2 = buf2 + a2;
+	memmove(s2, s1, len + 1);
+	if (len > 0 && (random() & 1))
+		s2[random() % len] = (random() & 1) ? '\0' : '\xfe';
+
+	if (strlen(s1) != ref_strlen(s1))
+		error("strlen", a1, a2, len);
+	if (sign(strcmp(s1, s2)) != sign(ref_strcmp(s1, s2)))
+		error("strcmp", a1, a2, len);
+	for (n = 0; n <= len + 1; n++) {
+		if (sign(strncmp(s1, s2, n)) != sign(ref_strncmp(s1, s2, n)))
+			error("strncmp", a1, a2, n);
+		if (sign(memcmp(s1, s2, n)) != sign(ref_memcmp(s1, s2, n)))
+			error("memcmp", a1, a2, n);
+	}
+	for (c = 'a'; c <= 'e'; c++) {
+		if (strchr(s1, c) != ref_strchr(s1, c))
+			error("strchr", a1, a2, len);
+		if (memchr(s1, c, len) != ref_memchr(s1, c, len))
+			error("memchr", a1, a2, len);
+	}
+	if (strchr(s1, '\0') != s1 + len)
+		error("strchr", a1, a2, len);
+}
+
+static void
+test_copy(int a1, int a2, int len)
+{
+	char *s, *d1, *d2;
+	int i;
+
+	fill(buf1, a1 + len);
+	s = buf1 + a1;
+
+	/* memcpy must not touch anything outside the target */
+	memset(dst1, 'x', BUFSIZE);
+	memset(dst2, 'x', BUFSIZE);
+	d1 = dst1 + a2;
+	d2 = dst2 + a2;
+	memcpy(d1, s, len);
+	for (i = 0; i < len; i++)
+		d2[i] = s[i];
+	if (memcmp(dst1, dst2, BUFSIZE))
+		error("memcpy", a1, a2, len);
+
+	memset(d1, 'y', len);
+	for (i = 0; i < len; i++)
+		d2[i] = 'y';
+	if (memcmp(dst1, dst2, BUFSIZE))
+		error("memset", a1, a2, len);
+
+	strncpy(d1, s, len / 2 + 4);
+	for (i = 0; i < len / 2 + 4; i++)
+		d2[i] = (i <= len) ? s[i] : '\0';
+	if (memcmp(dst1, dst2, BUFSIZE))
+		error("strncpy", a1, a2, len);
+
+	if (strlcpy(d1, s, len / 2 + 1) != (size_t)len ||
+	    strlen(d1) != (size_t)len / 2 || memcmp(d1, s, len / 2))
+		error("strlcpy", a1, a2, len);
+
+	/* Overlapping moves in both directions */
+	memcpy(dst1, buf1, BUFSIZE);
+	memcpy(dst2, buf1, BUFSIZE);
+	memmove(dst1 + a2, dst1 + a1, len);
+	for (i = 0; i < len; i++)
+		buf2[i] = dst2[a1 + i];
+	for (i = 0; i < len; i++)
+		dst2[a2 + i] = buf2[i];
+	if (memcmp(dst1, dst2, BUFSIZE))
+		error("memmove", a1, a2, len);
+}
+
+static void
+test_correctness(void)
+{
+	int a1, a2, len;
+
+	printf("Checking correctness...\n");
+	for (a1 = 0; a1 < MAXALIGN; a1++) {
+		for (a2 = 0; a2 < MAXALIGN; a2++) {
+			for (len = 0; len < MAXLEN; len++) {
+				test_compare(a1, a2, len);
+				test_copy(a1, a2, len);
+			}
+		}
+	}
+	printf("%d error(s)\n", nr_errors);
+}
+
+static void
+report(const char *name, u_long start, u_long end)
+{
+	u_long msec, kbps;
+
+	msec = (end - start) * 1000 / timer_info.hz;
+	kbps = msec ? (u_long)BENCHSIZE * BENCHLOOP / msec : 0;
+	printf("%-10s %6d msec %8d KB/s\n", name, (int)msec, (int)kbps);
+}
+
+#define BENCH(name, expr)				\
+do {							\
+	u_long start, end;				\
+	int i;						\
+							\
+	sys_time(&start);				\
+	for (i = 0; i < BENCHLOOP; i++)			\
+		(void)(expr);				\
+	sys_time(&end);					\
+	report(name, start, end);			\
+} while (0)
+
+static void
+test_throughput(void)
+{
+	volatile size_t sink;
+
+	printf("Measuring throughput (%d x %d bytes)...\n",
+	       BENCHLOOP, BENCHSIZE);
+
+	memset(bench1, 'a', BENCHSIZE);
+	memset(bench2, 'a', BENCHSIZE);
+	bench1[BENCHSIZE] = '\0';
+	bench2[BENCHSIZE] = '\0';
+
+	BENCH("strlen", sink = strlen(bench1));
+	BENCH("ref_strlen", sink = ref_strlen(bench1));
+	BENCH("strcmp", sink = strcmp(bench1, bench2));
+	BENCH("ref_strcmp", sink = ref_strcmp(bench1, bench2));
+	BENCH("strchr", sink = (size_t)strchr(bench1, 'z'));
+	BENCH("ref_strchr", sink = (size_t)ref_strchr(bench1, 'z'));
+	BENCH("memchr", sink = (size_t)memchr(bench1, 'z', BENCHSIZE));
+	BENCH("ref_memchr", sink = (size_t)ref_memchr(bench1, 'z', BENCHSIZE));
+	BENCH("memcmp", sink = memcmp(bench1, bench2, BENCHSIZE));
+	BENCH("ref_memcmp", sink = ref_memcmp(bench1, bench2, BENCHSIZE));
+	BENCH("memcpy", sink = (size_t)memcpy(bench2, bench1, BENCHSIZE));
+	BENCH("memset", sink = (size_t)memset(bench2, 'a', BENCHSIZE));
+	(void)sink;
+}
+
+int
+main(int argc, char *argv[])
+{
+	printf("String routine test program\n");
+
+	sys_info(INFO_TIMER, &timer_info);
+	if (timer_info.hz == 0)
+		panic("can not get timer tick rate");
+
+	test_correctness();
+	test_throughput();
+
+	printf("Test completed\n");
+	return 0;
+}
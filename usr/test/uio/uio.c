@@ -0,0 +1,150 @@
+/*-
+ * Copyright (c) 2009, Andrew Dennison
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * uio.c - test readv, writev, pread and pwrite
+ */
+
+#include <prex/prex.h>
+#include <sys/fcntl.h>
+#include <sys/uio.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_FILE	"/tmp/uio"
+
+static int nerrs;
+
+static void
+check(int ok, const char *msg)
+{
+
+	if (!ok) {
+		printf("error: %s\n", msg);
+		nerrs++;
+	}
+}
+
+static void
+test_vector(int fd)
+{
+	struct iovec iov[3];
+	char a[4], b[8], c[16];
+
+	printf("readv/writev\n");
+
+	/* Gather three buffers into the file. */
+	iov[0].iov_base = "abc";
+	iov[0].iov_len = 3;
+	iov[1].iov_base = "";
+	iov[1].iov_len = 0;
+	iov[2].iov_base = "defghij";
+	iov[2].iov_len = 7;
+	check(writev(fd, iov, 3) == 10, "writev");
+	check(lseek(fd, 0, SEEK_CUR) == 10, "offset after writev");
+
+	/* Scatter it again.  The file is short of the buffers. */
+	lseek(fd, 0, SEEK_SET);
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	memset(c, 0, sizeof(c));
+	iov[0].iov_base = a;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = b;
+	iov[1].iov_len = 4;
+	iov[2].iov_base = c;
+	iov[2].iov_len = sizeof(c);
+	check(readv(fd, iov, 3) == 10, "short readv");
+	check(!memcmp(a, "abcd", 4), "readv data 1");
+	check(!memcmp(b, "efgh", 4), "readv data 2");
+	check(!memcmp(c, "ij", 2) && c[2] == '\0', "readv data 3");
+	check(lseek(fd, 0, SEEK_CUR) == 10, "offset after readv");
+	check(readv(fd, iov, 3) == 0, "readv at end of file");
+
+	/* Bad vectors. */
+	check(readv(fd, iov, 0) == -1, "readv with no vector");
+	check(writev(fd, iov, IOV_MAX + 1) == -1, "writev with too many");
+}
+
+static void
+test_positioned(int fd)
+{
+	char buf[16];
+
+	printf("pread/pwrite\n");
+
+	lseek(fd, 2, SEEK_SET);
+
+	/* Positioned calls leave the file offset alone. */
+	check(pwrite(fd, "XY", 2, 4) == 2, "pwrite");
+	check(lseek(fd, 0, SEEK_CUR) == 2, "offset after pwrite");
+
+	memset(buf, 0, sizeof(buf));
+	check(pread(fd, buf, 4, 3) == 4, "pread");
+	check(!memcmp(buf, "dXYg", 4), "pread data");
+	check(lseek(fd, 0, SEEK_CUR) == 2, "offset after pread");
+
+	/* Short at the end of file, and nothing past it. */
+	check(pread(fd, buf, sizeof(buf), 7) == 3, "short pread");
+	check(!memcmp(buf, "hij", 3), "short pread data");
+	check(pread(fd, buf, sizeof(buf), 10) == 0, "pread at end of file");
+	check(pread(fd, buf, sizeof(buf), -1) == -1, "pread at bad offset");
+
+	/* A plain read goes on from the kept offset. */
+	check(read(fd, buf, 2) == 2 && !memcmp(buf, "cd", 2),
+	      "read after pread");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd;
+
+	printf("uio test program\n");
+
+	if ((fd = open(TEST_FILE, O_CREAT | O_TRUNC | O_RDWR, 0644)) == -1) {
+		perror("open");
+		exit(1);
+	}
+	test_vector(fd);
+	test_positioned(fd);
+	close(fd);
+	unlink(TEST_FILE);
+
+	if (nerrs) {
+		printf("Test failed: %d error(s)\n", nerrs);
+		exit(1);
+	}
+	printf("Test OK!\n");
+	return 0;
+}